@@ -9,36 +9,65 @@
 #include "queue.h"
 #include "synch.h"
 #include "common.h"
+#include "machineprimitives.h"
+#include "portos_stats.h"
 
 // ---- Global variables ---- //
-extern const int INTERRUPT_PERIOD_IN_MILLISECONDS; //clock interrupt period in milliseconds
-extern uint64_t g_interruptCount; //global counter to count how many interrupts has passed. This value should not overflow for years.
 queue_t* g_alarmsQueue = NULL; //global queue that holds our alarms in sorted order according to when they should be set off
-uint64_t g_smallestInterruptToWake = 0; //Tracks the first item's interruptToWake in g_alarmsQueue
+uint64_t g_nextAlarmDeadline = UINT64_MAX; //deadline of the first alarm in g_alarmsQueue, UINT64_MAX if there is none
+
+portos_stat_t* g_alarmsFiredStat = NULL; //statistics, registered by alarm_initialize()
+portos_stat_t* g_alarmLatenessStat = NULL; //microseconds from the deadline of an alarm to when it went off
 
 //struct for our alarm
 typedef struct alarm {
-	uint64_t interruptToWake; //tracks at which global interrupt the alarm should go off
+	uint64_t deadline; //when the alarm should go off, in microseconds of the monotonic clock (see currentTimeMicros())
 	void* alarmHandlerArg; //argument to alarm handler
 	alarm_handler_t alarmHandler; //method to execute when alarm goes off
 } alarm_t;
 
+// This function updates g_nextAlarmDeadline after the first alarm changed. Caller must disable interrupts.
+static void update_next_deadline()
+{
+	alarm_t* first = NULL;
+	g_nextAlarmDeadline = (queue_peek(g_alarmsQueue, (void**)&first) == 0) ? first->deadline : UINT64_MAX;
+}
+
+// This function reads the # of alarms waiting to go off
+static long long read_pending(void* arg)
+{
+	return (g_alarmsQueue == NULL) ? 0 : queue_length(g_alarmsQueue);
+}
+
+/* see alarm.h */
+void
+alarm_initialize() {
+	g_alarmsFiredStat = portos_stats_counter("alarm", "fired");
+	g_alarmLatenessStat = portos_stats_histogram("alarm", "lateness_us");
+	portos_stats_register("alarm", "pending", PORTOS_STAT_GAUGE, read_pending, NULL);
+}
+
 /* see alarm.h */
 alarm_id
 register_alarm(int delay, alarm_handler_t alarm, void *arg) {
-	//if delay period is invalid or alarm is null, return NULL
-	if (delay < 0 || alarm == NULL) return NULL;
+	//if delay period is invalid, return NULL
+	if (delay < 0) return NULL;
+
+	return register_alarm_at(currentTimeMicros() + (uint64_t)delay * 1000, alarm, arg); //the clock keeps running while the process does not
+}
+
+/* see alarm.h */
+alarm_id
+register_alarm_at(uint64_t deadline, alarm_handler_t alarm, void *arg) {
+	//if alarm is null, return NULL
+	if (alarm == NULL) return NULL;
     
 	alarm_t* newAlarm = malloc(sizeof(alarm_t)); //create a new alarm
-	if (alarm == NULL) return NULL; //return NULL if malloc errored
+	if (newAlarm == NULL) return NULL; //return NULL if malloc errored
 
 	newAlarm->alarmHandler = alarm;
 	newAlarm->alarmHandlerArg = arg; 
-
-	//calculate at which global interrupt the alarm should go off at, round up so thread sleeps at least that amount
-	uint64_t numInterruptsToSleep = (delay + INTERRUPT_PERIOD_IN_MILLISECONDS / 2) / INTERRUPT_PERIOD_IN_MILLISECONDS; // # of interrupts, round to closest int 
-	if (numInterruptsToSleep == 0) numInterruptsToSleep++; // make sure it delay at least one interrupt
-	newAlarm->interruptToWake = g_interruptCount + numInterruptsToSleep;
+	newAlarm->deadline = deadline;
 
 	//disable interrupts as we begin access of global vars
 	interrupt_level_t old_level = set_interrupt_level(DISABLED);
@@ -46,19 +75,18 @@ register_alarm(int delay, alarm_handler_t alarm, void *arg) {
 	//if this is first alarm being added, initialize alarms queue
 	if (g_alarmsQueue == NULL) {
 		g_alarmsQueue = queue_new();
-		AbortOnCondition(g_alarmsQueue == NULL, "Failed to initialize alarms queue in register_alarm()");
+		AbortOnCondition(g_alarmsQueue == NULL, "Failed to initialize alarms queue in register_alarm_at()");
 	}
 
-	//insert alarm into global alarms queue
-	int insertSuccess = queue_ordered_insert(g_alarmsQueue, newAlarm, ((alarm_t*)newAlarm)->interruptToWake);
+	//insert alarm into global alarms queue, alarms with equal deadlines go off in the order they were registered
+	int insertSuccess = queue_ordered_insert(g_alarmsQueue, newAlarm, newAlarm->deadline);
 	if (insertSuccess != 0) { //insertion failed, free alarm and set newAlarm = NULL so we return NULL
 		free(newAlarm);
 		newAlarm = NULL;
 	}
-
-	//update g_smallestInteruptToWake if needed
-	if (g_smallestInterruptToWake > newAlarm->interruptToWake)
-		g_smallestInterruptToWake = newAlarm->interruptToWake;
+	else if (newAlarm->deadline < g_nextAlarmDeadline) {
+		g_nextAlarmDeadline = newAlarm->deadline;
+	}
 
 	//restore interrupts to old level as we exit critical section
 	set_interrupt_level(old_level);
@@ -74,6 +102,10 @@ deregister_alarm(alarm_id alarm) {
 	//disable interrupts as we access our global queue
 	interrupt_level_t old_level = set_interrupt_level(DISABLED);
 	int alarmExecuted = queue_delete(g_alarmsQueue, alarm); //if alarm has executed, it would not be in the queue and queue_delete would return -1.
+	if (alarmExecuted == 0) {
+		update_next_deadline();
+		free(alarm); //an executed alarm was freed when it went off
+	}
 	set_interrupt_level(old_level); //restore interrupts as we leave crit section
 
 	return (alarmExecuted == -1); //return 1 if alarm has been excuted, 0 otherwise
@@ -84,13 +116,16 @@ deregister_alarm(alarm_id alarm) {
 */
 int 
 alarm_check_and_run() {
-	assert(g_interruptCount > 0); //self check
-
 	//disable interrupts as we begin access of our global variables
 	interrupt_level_t old_level = set_interrupt_level(DISABLED);
 
-	//if no alarms have been added or the smallest interrupt to wake has not been reached, do nothing
-	if (g_alarmsQueue == NULL || g_smallestInterruptToWake > g_interruptCount) {
+	//if no alarm is due, do nothing
+	if (g_nextAlarmDeadline == UINT64_MAX) {
+		set_interrupt_level(old_level);
+		return 0;
+	}
+	uint64_t now = currentTimeMicros();
+	if (g_nextAlarmDeadline > now) {
 		set_interrupt_level(old_level);
 		return 0;
 	}
@@ -104,20 +139,20 @@ alarm_check_and_run() {
 		}
 		
 		assert(currAlarm != NULL); //self check
-		if (currAlarm->interruptToWake > g_interruptCount) {
-			g_smallestInterruptToWake = currAlarm->interruptToWake; //set the next smallest interrupt to wake to the first elem in our queue
-			break; //if first alarm in our queue is not set to go off, neither are rest of alarms
-		}
-		else { //first alarm is scheduled to go off
-			int dequeueSuccess = queue_dequeue(g_alarmsQueue, (void**)&currAlarm); //remove first alarm from queue
-			if (dequeueSuccess == -1) {
-				set_interrupt_level(old_level); //restore interrupt level
-				return -1; //failed to dequeue
-			}
-			currAlarm->alarmHandler(currAlarm->alarmHandlerArg); //call alarm's alarm handler
-			free(currAlarm); 
+		if (currAlarm->deadline > now) break; //if first alarm in our queue is not set to go off, neither are rest of alarms
+
+		//first alarm is scheduled to go off
+		int dequeueSuccess = queue_dequeue(g_alarmsQueue, (void**)&currAlarm); //remove first alarm from queue
+		if (dequeueSuccess == -1) {
+			set_interrupt_level(old_level); //restore interrupt level
+			return -1; //failed to dequeue
 		}
+		portos_stats_add(g_alarmsFiredStat, 1);
+		portos_stats_record(g_alarmLatenessStat, now - currAlarm->deadline);
+		currAlarm->alarmHandler(currAlarm->alarmHandlerArg); //call alarm's alarm handler
+		free(currAlarm); 
 	}
+	update_next_deadline();
 
 	set_interrupt_level(old_level); //restore interrupt level
 	return 0;
@@ -1,6 +1,8 @@
 #ifndef __ALARM_H__
 #define __ALARM_H__ 1
 
+#include <stdint.h>
+
 /*
  * This is the alarm interface. You should implement the functions for these
  * prototypes, though you may have to modify some other files to do so.
@@ -14,13 +16,25 @@
 typedef void (*alarm_handler_t)(void*);
 typedef void *alarm_id;
 
+/* registers the statistics of the alarms; called by minithread_system_initialize().
+ */
+void alarm_initialize();
+
 /* register an alarm to go off in "delay" milliseconds.  Returns a handle to
- * the alarm.
+ * the alarm.  The delay is measured on the monotonic clock, so it passes
+ * while the process is blocked or descheduled too; due alarms go off at the
+ * next clock tick, or as soon as the idle thread runs.
  */
 alarm_id register_alarm(int delay, alarm_handler_t func, void *arg);
 
+/* register an alarm to go off once currentTimeMicros() reaches "deadline".
+ * Alarms with equal deadlines go off in the order they were registered.
+ */
+alarm_id register_alarm_at(uint64_t deadline, alarm_handler_t func, void *arg);
+
 /* unregister an alarm.  Returns 0 if the alarm had not been executed, 1
- * otherwise.
+ * otherwise.  The handle is freed when the alarm goes off or is
+ * unregistered, whichever comes first.
  */
 int deregister_alarm(alarm_id id);
 
@@ -0,0 +1,61 @@
+/* bench-alarm.c
+
+   Alarm costs: registering an alarm and deregistering it again, while 0,
+   100 or 1000 other alarms are pending. The pending alarms are due long
+   after the benchmark ends, and the timed alarm after all of them, so that
+   both calls walk the whole queue.
+
+   USAGE: ./bench-alarm
+*/
+
+#include "minithread.h"
+#include "alarm.h"
+#include "benchmark.h"
+#include "defs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SAMPLES 200
+#define OPS 1000 // # of register/deregister pairs timed by a sample
+#define PENDING_DELAY_MS 100000000 // delay of the pending alarms
+#define DELAY_MS (2 * PENDING_DELAY_MS) // delay of the timed alarms
+
+void handler(void* arg) {
+}
+
+void run(int pending) {
+  static char name[32];
+  sprintf(name, "alarm-register-%d", pending);
+
+  alarm_id* ids = malloc(pending * sizeof(alarm_id));
+  for (int i = 0; i < pending; i++) ids[i] = register_alarm(PENDING_DELAY_MS + i, handler, NULL);
+
+  benchmark_t* bench = benchmark_create(name, SAMPLES, OPS);
+  while (!benchmark_done(bench)) {
+    benchmark_start(bench);
+    for (int i = 0; i < OPS; i++) {
+      alarm_id id = register_alarm(DELAY_MS, handler, NULL);
+      AbortOnCondition(id == NULL || deregister_alarm(id) != 0, "register_alarm() or deregister_alarm() failed");
+    }
+    benchmark_stop(bench);
+  }
+  benchmark_report(bench);
+  benchmark_destroy(bench);
+
+  for (int i = 0; i < pending; i++) deregister_alarm(ids[i]);
+  free(ids);
+}
+
+int main_thread(int* arg) {
+  run(0);
+  run(100);
+  run(1000);
+
+  exit(0); // the system never stops on its own
+}
+
+int main(int argc, char** argv) {
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}
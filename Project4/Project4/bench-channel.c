@@ -0,0 +1,265 @@
+/* bench-channel.c
+
+   Producer/consumer pipelines built from a pair of semaphores around a
+   shared ring, as buffer.c and sieve.c used to be, against channels:
+
+     buffer-sema      -- a producer passes ITEMS integers to a consumer
+                         through a ring of BUFFER_SIZE guarded by two
+                         semaphores; the time per item
+     buffer-channel   -- the same through a channel, one item at a time
+     buffer-batch     -- the same through a channel, BUFFER_SIZE items at
+                         a time
+     sieve-sema       -- the primes up to SIEVE_MAX with a filter thread
+                         per prime, each stage a rendezvous of two
+                         semaphores as in the old sieve.c; the time per
+                         number
+     sieve-channel    -- the same with a channel per stage, moving numbers
+                         in batches as sieve.c does
+
+   USAGE: ./bench-channel
+*/
+
+#include "minithread.h"
+#include "synch.h"
+#include "channel.h"
+#include "benchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ITEMS 10000
+#define BUFFER_SIZE 16
+#define BUFFER_SAMPLES 50
+#define SIEVE_MAX 5000
+#define SIEVE_PRIMES 669 // # of primes up to SIEVE_MAX
+#define SIEVE_SAMPLES 10
+
+semaphore_t* done;
+
+int ring[BUFFER_SIZE];
+int head, tail;
+semaphore_t* empty;
+semaphore_t* full;
+channel_t* channel;
+
+int sema_consumer(int* arg) {
+  for (int i = 0; i < ITEMS; i++) {
+    semaphore_P(empty);
+    tail = (tail + 1) % BUFFER_SIZE;
+    semaphore_V(full);
+  }
+  semaphore_V(done);
+  return 0;
+}
+
+void buffer_sema() {
+  minithread_fork(sema_consumer, NULL);
+  for (int i = 0; i < ITEMS; i++) {
+    semaphore_P(full);
+    ring[head] = i;
+    head = (head + 1) % BUFFER_SIZE;
+    semaphore_V(empty);
+  }
+  semaphore_P(done);
+}
+
+int channel_consumer(int* arg) {
+  int value;
+  for (int i = 0; i < ITEMS; i++) channel_receive(channel, &value);
+  semaphore_V(done);
+  return 0;
+}
+
+void buffer_channel() {
+  minithread_fork(channel_consumer, NULL);
+  for (int i = 0; i < ITEMS; i++) channel_send(channel, &i);
+  semaphore_P(done);
+}
+
+int batch_consumer(int* arg) {
+  int values[BUFFER_SIZE];
+  for (int received = 0; received < ITEMS; ) received += channel_receive_batch(channel, values, BUFFER_SIZE);
+  semaphore_V(done);
+  return 0;
+}
+
+void buffer_batch() {
+  int values[BUFFER_SIZE];
+  minithread_fork(batch_consumer, NULL);
+  for (int sent = 0; sent < ITEMS; sent += BUFFER_SIZE) {
+    for (int i = 0; i < BUFFER_SIZE; i++) values[i] = sent + i;
+    channel_send_batch(channel, values, BUFFER_SIZE);
+  }
+  semaphore_P(done);
+}
+
+/* the sieve of the old sieve.c */
+typedef struct {
+  int value;
+  semaphore_t* produce;
+  semaphore_t* consume;
+} rendezvous_t;
+
+typedef struct {
+  void* left;
+  void* right;
+  int prime;
+} filter_t;
+
+int primes;
+
+rendezvous_t* rendezvous_new() {
+  rendezvous_t* r = malloc(sizeof(rendezvous_t));
+  r->produce = semaphore_create();
+  semaphore_initialize(r->produce, 0);
+  r->consume = semaphore_create();
+  semaphore_initialize(r->consume, 0);
+  return r;
+}
+
+void rendezvous_free(rendezvous_t* r) {
+  semaphore_destroy(r->produce);
+  semaphore_destroy(r->consume);
+  free(r);
+}
+
+int sema_source(int* arg) {
+  rendezvous_t* r = (rendezvous_t*)arg;
+  for (int i = 2; i <= SIEVE_MAX + 1; i++) {
+    r->value = (i <= SIEVE_MAX) ? i : -1;
+    semaphore_V(r->consume);
+    semaphore_P(r->produce);
+  }
+  return 0;
+}
+
+int sema_filter(int* arg) {
+  filter_t* f = (filter_t*)arg;
+  rendezvous_t* left = f->left;
+  rendezvous_t* right = f->right;
+  int value;
+  do {
+    semaphore_P(left->consume);
+    value = left->value;
+    semaphore_V(left->produce);
+    if (value == -1 || value % f->prime != 0) {
+      right->value = value;
+      semaphore_V(right->consume);
+      semaphore_P(right->produce);
+    }
+  } while (value != -1);
+  free(f);
+  semaphore_V(done);
+  return 0;
+}
+
+void sieve_sema() {
+  rendezvous_t* r = rendezvous_new();
+  rendezvous_t* stages[SIEVE_PRIMES + 1];
+  int value;
+  primes = 0;
+  stages[0] = r;
+  minithread_fork(sema_source, (int*)r);
+  for (;;) {
+    semaphore_P(r->consume);
+    value = r->value;
+    semaphore_V(r->produce);
+    if (value == -1) break;
+
+    filter_t* f = malloc(sizeof(filter_t));
+    f->left = r;
+    f->prime = value;
+    r = f->right = stages[++primes] = rendezvous_new();
+    minithread_fork(sema_filter, (int*)f);
+  }
+  for (int i = 0; i < primes; i++) semaphore_P(done); // let the filters finish before freeing their stages
+  for (int i = 0; i <= primes; i++) rendezvous_free(stages[i]);
+}
+
+/* the sieve of sieve.c */
+int channel_source(int* arg) {
+  channel_t* c = (channel_t*)arg;
+  int values[BUFFER_SIZE];
+  int n = 0;
+  for (int i = 2; i <= SIEVE_MAX; i++) {
+    values[n++] = i;
+    if (n == BUFFER_SIZE || i == SIEVE_MAX) {
+      channel_send_batch(c, values, n);
+      n = 0;
+    }
+  }
+  channel_close(c);
+  return 0;
+}
+
+int channel_filter(int* arg) {
+  filter_t* f = (filter_t*)arg;
+  int values[BUFFER_SIZE];
+  int n;
+  while ((n = channel_receive_batch(f->left, values, BUFFER_SIZE)) > 0) {
+    int kept = 0;
+    for (int i = 0; i < n; i++) {
+      if (values[i] % f->prime != 0) values[kept++] = values[i];
+    }
+    channel_send_batch(f->right, values, kept);
+  }
+  channel_close(f->right);
+  channel_destroy(f->left); //its sender closed it and returned
+  free(f);
+  return 0;
+}
+
+void sieve_channel() {
+  channel_t* c = channel_create(sizeof(int), BUFFER_SIZE);
+  int value;
+  primes = 0;
+  minithread_fork(channel_source, (int*)c);
+  while (channel_receive(c, &value) == 0) {
+    filter_t* f = malloc(sizeof(filter_t));
+    f->left = c;
+    f->prime = value;
+    c = f->right = channel_create(sizeof(int), BUFFER_SIZE);
+    primes++;
+    minithread_fork(channel_filter, (int*)f);
+  }
+  channel_destroy(c);
+}
+
+void run(const char* name, void (*proc)(), int samples, int ops) {
+  benchmark_t* bench = benchmark_create(name, samples, ops);
+
+  proc(); // warm up
+  while (!benchmark_done(bench)) {
+    benchmark_start(bench);
+    proc();
+    benchmark_stop(bench);
+  }
+
+  benchmark_report(bench);
+  benchmark_destroy(bench);
+}
+
+int main_thread(int* arg) {
+  done = semaphore_create();
+  semaphore_initialize(done, 0);
+  empty = semaphore_create();
+  semaphore_initialize(empty, 0);
+  full = semaphore_create();
+  semaphore_initialize(full, BUFFER_SIZE);
+  channel = channel_create(sizeof(int), BUFFER_SIZE);
+
+  run("buffer-sema", buffer_sema, BUFFER_SAMPLES, ITEMS);
+  run("buffer-channel", buffer_channel, BUFFER_SAMPLES, ITEMS);
+  run("buffer-batch", buffer_batch, BUFFER_SAMPLES, ITEMS);
+  run("sieve-sema", sieve_sema, SIEVE_SAMPLES, SIEVE_MAX);
+  if (primes != SIEVE_PRIMES) printf("ERROR: sieve-sema found %d primes.\n", primes);
+  run("sieve-channel", sieve_channel, SIEVE_SAMPLES, SIEVE_MAX);
+  if (primes != SIEVE_PRIMES) printf("ERROR: sieve-channel found %d primes.\n", primes);
+
+  exit(0); // the system never stops on its own
+}
+
+int main(int argc, char** argv) {
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}
@@ -0,0 +1,112 @@
+/* bench-fork.c
+
+   Fork and exit throughput: forks threads that exit right away, and waits
+   for each of them. The time per thread covers getting its stack and
+   control block, running it, and recycling them. For comparison, the same
+   calls are run by a thread pool.
+
+     fork-exit        -- fork a thread, wait for it through a semaphore
+     fork-exit-batch  -- fork THREADS threads, then wait for all of them
+     fork-join        -- fork a joinable thread and join it
+     pool-call        -- submit a call to a pool of WORKERS threads, wait
+                         for its future
+     pool-batch       -- submit THREADS calls to the pool as a batch, then
+                         wait for all of their futures
+
+   USAGE: ./bench-fork
+*/
+
+#include "minithread.h"
+#include "synch.h"
+#include "threadpool.h"
+#include "benchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SAMPLES 200
+#define THREADS 100 // # of threads forked by a sample
+#define WORKERS 4
+
+minithread_pool_t* pool;
+semaphore_t* done;
+
+int child(int* arg) {
+  semaphore_V(done);
+  return 0;
+}
+
+int child_joinable(int* arg) {
+  return 0;
+}
+
+// forks THREADS threads, one after the other
+void fork_all() {
+  for (int i = 0; i < THREADS; i++) {
+    minithread_fork(child, NULL);
+    semaphore_P(done);
+  }
+}
+
+// forks THREADS joinable threads, one after the other, joining each
+void fork_join() {
+  for (int i = 0; i < THREADS; i++) minithread_join(minithread_fork_joinable(child_joinable, NULL), NULL);
+}
+
+// forks THREADS threads, then waits for all of them
+void fork_batch() {
+  for (int i = 0; i < THREADS; i++) minithread_fork(child, NULL);
+  for (int i = 0; i < THREADS; i++) semaphore_P(done);
+}
+
+// submits THREADS calls to the pool, one after the other, waiting for each
+void pool_call() {
+  minithread_future_t* future;
+  for (int i = 0; i < THREADS; i++) {
+    minithread_pool_submit(pool, child_joinable, NULL, &future);
+    minithread_future_wait(future);
+  }
+}
+
+// submits THREADS calls to the pool at once, then waits for all of them
+void pool_batch() {
+  static arg_t args[THREADS];
+  minithread_future_t* futures[THREADS];
+  minithread_pool_submit_batch(pool, child_joinable, args, THREADS, futures);
+  for (int i = 0; i < THREADS; i++) minithread_future_wait(futures[i]);
+}
+
+void run(const char* name, void (*proc)()) {
+  benchmark_t* bench = benchmark_create(name, SAMPLES, THREADS);
+
+  proc(); // warm up
+  while (!benchmark_done(bench)) {
+    benchmark_start(bench);
+    proc();
+    benchmark_stop(bench);
+  }
+
+  benchmark_report(bench);
+  benchmark_destroy(bench);
+}
+
+int main_thread(int* arg) {
+  done = semaphore_create();
+  semaphore_initialize(done, 0);
+
+  run("fork-exit", fork_all);
+  run("fork-exit-batch", fork_batch);
+  run("fork-join", fork_join);
+
+  pool = minithread_pool_create(WORKERS, THREADS);
+  run("pool-call", pool_call);
+  run("pool-batch", pool_batch);
+  minithread_pool_destroy(pool);
+
+  exit(0); // the system never stops on its own
+}
+
+int main(int argc, char** argv) {
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}
@@ -0,0 +1,170 @@
+/* bench-network.c
+
+   Loopback throughput of the network layers, and what its packets cost:
+
+     packet-malloc     -- malloc() and free() a packet (what the polling
+                          thread does for every packet it receives)
+     packet-objcache   -- the same through a per-thread object cache (what
+                          loopback packets do)
+     minimsg-<size>B   -- a thread sends a message of <size> bytes to its own
+                          unbound port and receives it; the time per message
+     minisocket-KB     -- a thread sends 64 KB chunks over a minisocket to a
+                          receiving thread; the time per KB
+
+   The minimsg and minisocket lines are followed by the throughput at the
+   median.
+
+   USAGE: ./bench-network [<udp port>]
+
+   where <udp port> is the UDP port of the simulated network, 9200 by default.
+*/
+
+#include "minithread.h"
+#include "minimsg.h"
+#include "minisocket.h"
+#include "synch.h"
+#include "benchmark.h"
+#include "network.h"
+#include "objcache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MSG_SAMPLES 200
+#define MSGS 100 // # of messages timed by a sample
+#define SOCKET_SAMPLES 50
+#define CHUNK_KB 64 // # of KB timed by a sample
+#define SOCKET_PORT 80
+#define PACKET_SAMPLES 200
+#define PACKETS 10000 // # of packets timed by a sample
+#define PACKETS_HELD 4 // # of packets allocated at once, as when some wait in a port
+
+char buffer[CHUNK_KB * 1024];
+semaphore_t* done;
+
+void bench_packets(objcache_t* cache) {
+  void* packets[PACKETS_HELD];
+  int size = sizeof(network_interrupt_arg_t);
+
+  benchmark_t* bench = benchmark_create((cache == NULL) ? "packet-malloc" : "packet-objcache", PACKET_SAMPLES, PACKETS);
+  while (!benchmark_done(bench)) {
+    benchmark_start(bench);
+    for (int i = 0; i < PACKETS; i += PACKETS_HELD) {
+      for (int j = 0; j < PACKETS_HELD; j++) {
+	packets[j] = (cache == NULL) ? malloc(size) : objcache_alloc(cache);
+	*(volatile char*)packets[j] = 0; // touch it, as the packet's header is written
+      }
+      for (int j = 0; j < PACKETS_HELD; j++) {
+	if (cache == NULL) free(packets[j]);
+	else objcache_free(cache, packets[j]);
+      }
+    }
+    benchmark_stop(bench);
+  }
+  benchmark_report(bench);
+  benchmark_destroy(bench);
+}
+
+void bench_minimsg(int size) {
+  static char name[32];
+  sprintf(name, "minimsg-%dB", size);
+
+  network_address_t my_address;
+  network_get_my_address(my_address);
+  miniport_t* listen_port = miniport_create_unbound(0);
+  miniport_t* send_port = miniport_create_bound(my_address, 0);
+
+  benchmark_t* bench = benchmark_create(name, MSG_SAMPLES, MSGS);
+  while (!benchmark_done(bench)) {
+    benchmark_start(bench);
+    for (int i = 0; i < MSGS; i++) {
+      miniport_t* from;
+      int length = size;
+      minimsg_send(listen_port, send_port, buffer, size);
+      minimsg_receive(listen_port, &from, buffer, &length);
+      miniport_destroy(from);
+    }
+    benchmark_stop(bench);
+  }
+  benchmark_report(bench);
+  uint64_t p50 = benchmark_percentile(bench, 50);
+  printf("!$BENCH: %-28s MB/s   p50 %llu\n", name, (p50 > 0) ? (unsigned long long)size * 1000 / p50 : 0ULL);
+  benchmark_destroy(bench);
+
+  miniport_destroy(send_port);
+  miniport_destroy(listen_port);
+}
+
+int receiver(int* arg) {
+  static char inbuf[CHUNK_KB * 1024];
+  network_address_t my_address;
+  minisocket_error error;
+
+  network_get_my_address(my_address);
+  minisocket_t* socket = minisocket_client_create(my_address, SOCKET_PORT, &error);
+  if (socket == NULL) {
+    printf("ERROR: client_create failed with error %d.\n", error);
+    exit(-1);
+  }
+
+  int total = (SOCKET_SAMPLES + 1) * CHUNK_KB * 1024; // one more chunk to warm up
+  for (int received = 0; received < total; ) {
+    int n = minisocket_receive(socket, inbuf, sizeof(inbuf), &error);
+    if (n == -1) {
+      printf("ERROR: receive failed with error %d.\n", error);
+      exit(-1);
+    }
+    received += n;
+  }
+
+  semaphore_V(done);
+  return 0;
+}
+
+void bench_minisocket() {
+  minisocket_error error;
+
+  minithread_fork(receiver, NULL);
+  minisocket_t* socket = minisocket_server_create(SOCKET_PORT, &error);
+  if (socket == NULL) {
+    printf("ERROR: server_create failed with error %d.\n", error);
+    exit(-1);
+  }
+
+  minisocket_send(socket, buffer, sizeof(buffer), &error); // warm up
+  benchmark_t* bench = benchmark_create("minisocket-KB", SOCKET_SAMPLES, CHUNK_KB);
+  while (!benchmark_done(bench)) {
+    benchmark_start(bench);
+    if (minisocket_send(socket, buffer, sizeof(buffer), &error) != sizeof(buffer)) {
+      printf("ERROR: send failed with error %d.\n", error);
+      exit(-1);
+    }
+    benchmark_stop(bench);
+  }
+  semaphore_P(done);
+
+  benchmark_report(bench);
+  uint64_t p50 = benchmark_percentile(bench, 50);
+  printf("!$BENCH: %-28s MB/s   p50 %llu\n", "minisocket-KB", (p50 > 0) ? 1000000000ULL / 1024 / p50 : 0ULL);
+  benchmark_destroy(bench);
+}
+
+int main_thread(int* arg) {
+  done = semaphore_create();
+  semaphore_initialize(done, 0);
+
+  bench_packets(NULL);
+  bench_packets(objcache_create(sizeof(network_interrupt_arg_t), PACKETS_HELD));
+  bench_minimsg(64);
+  bench_minimsg(MINIMSG_MAX_MSG_SIZE);
+  bench_minisocket();
+
+  exit(0); // the system never stops on its own
+}
+
+int main(int argc, char** argv) {
+  short port = (argc > 1) ? atoi(argv[1]) : 9200;
+  network_udp_ports(port, port);
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}
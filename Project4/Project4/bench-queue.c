@@ -0,0 +1,105 @@
+/* bench-queue.c
+
+   Queue costs, without threads:
+
+     queue-append-dequeue-N      -- append an item to a queue holding N items
+                                    and dequeue the head
+     queue-ordered-insert-N      -- insert an item in order into a queue
+                                    holding N items and dequeue the head
+     mlqueue-enqueue-dequeue     -- enqueue an item at the lowest level of an
+                                    empty four level queue and dequeue it,
+                                    searching from the top level
+
+   USAGE: ./bench-queue
+*/
+
+#include "queue.h"
+#include "multilevel_queue.h"
+#include "benchmark.h"
+#include "defs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SAMPLES 200
+#define OPS 10000 // # of operations timed by a sample
+#define MLQ_LEVELS 4
+
+int dummy; // the item every queue holds, the queues refuse NULL items
+
+void bench_fifo(int depth) {
+  static char name[48];
+  sprintf(name, "queue-append-dequeue-%d", depth);
+
+  queue_t* q = queue_new();
+  void* item = NULL;
+  for (int i = 0; i < depth; i++) AbortOnCondition(queue_append(q, &dummy) != 0, "queue_append() failed");
+
+  benchmark_t* bench = benchmark_create(name, SAMPLES, OPS);
+  while (!benchmark_done(bench)) {
+    benchmark_start(bench);
+    for (int i = 0; i < OPS; i++) {
+      AbortOnCondition(queue_append(q, &dummy) != 0, "queue_append() failed");
+      AbortOnCondition(queue_dequeue(q, &item) != 0, "queue_dequeue() failed");
+    }
+    benchmark_stop(bench);
+  }
+  benchmark_report(bench);
+  benchmark_destroy(bench);
+
+  while (queue_dequeue(q, &item) == 0) ;
+  queue_free(q);
+}
+
+void bench_ordered(int depth) {
+  static char name[48];
+  sprintf(name, "queue-ordered-insert-%d", depth);
+
+  queue_t* q = queue_new();
+  void* item = NULL;
+  uint64_t key = 0;
+  for (int i = 0; i < depth; i++) AbortOnCondition(queue_ordered_insert(q, &dummy, key++) != 0, "queue_ordered_insert() failed");
+
+  benchmark_t* bench = benchmark_create(name, SAMPLES, OPS);
+  while (!benchmark_done(bench)) {
+    benchmark_start(bench);
+    for (int i = 0; i < OPS; i++) {
+      AbortOnCondition(queue_ordered_insert(q, &dummy, key++) != 0, "queue_ordered_insert() failed"); // later than all the others, like a new alarm
+      AbortOnCondition(queue_dequeue(q, &item) != 0, "queue_dequeue() failed");
+    }
+    benchmark_stop(bench);
+  }
+  benchmark_report(bench);
+  benchmark_destroy(bench);
+
+  while (queue_dequeue(q, &item) == 0) ;
+  queue_free(q);
+}
+
+void bench_multilevel() {
+  multilevel_queue_t* q = multilevel_queue_new(MLQ_LEVELS);
+  void* item = NULL;
+
+  benchmark_t* bench = benchmark_create("mlqueue-enqueue-dequeue", SAMPLES, OPS);
+  while (!benchmark_done(bench)) {
+    benchmark_start(bench);
+    for (int i = 0; i < OPS; i++) {
+      AbortOnCondition(multilevel_queue_enqueue(q, MLQ_LEVELS - 1, &dummy) != 0, "multilevel_queue_enqueue() failed");
+      AbortOnCondition(multilevel_queue_dequeue(q, 0, &item) != MLQ_LEVELS - 1, "multilevel_queue_dequeue() failed");
+    }
+    benchmark_stop(bench);
+  }
+  benchmark_report(bench);
+  benchmark_destroy(bench);
+
+  multilevel_queue_free(q);
+}
+
+int main(int argc, char** argv) {
+  bench_fifo(0);
+  bench_fifo(1000);
+  bench_ordered(10);
+  bench_ordered(1000);
+  bench_multilevel();
+  return 0;
+}
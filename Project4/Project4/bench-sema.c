@@ -0,0 +1,182 @@
+/* bench-sema.c
+
+   Semaphore and mutex costs:
+
+     interrupt-level    -- disable interrupts, then restore them, as every
+                           critical section of the library does
+     sema-PV            -- P then V on a free semaphore, nobody waits
+     mutex-lock-unlock  -- lock then unlock a free mutex
+     sema-pingpong      -- two threads wake each other up through two
+                           semaphores; the time from a V to the return from
+                           the matching P in the other thread
+     sema-pingpong-handoff -- the same in handoff mode (see
+                           semaphore_set_handoff())
+     condvar-broadcast-N -- one condvar_broadcast() to N waiting threads,
+                           which should not grow with N
+
+   USAGE: ./bench-sema
+*/
+
+#include "minithread.h"
+#include "synch.h"
+#include "interrupts.h"
+#include "benchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SAMPLES 200
+#define OPS 10000 // # of operations timed by a sample
+
+semaphore_t* ping;
+semaphore_t* pong;
+semaphore_t* done;
+volatile int stop;
+
+mutex_t* lock;
+condvar_t* arrived; // the last waiter to arrive signals it
+condvar_t* go;      // broadcast to the waiters
+int numArrived;
+int generation;
+
+void bench_interrupt_level() {
+  benchmark_t* bench = benchmark_create("interrupt-level", SAMPLES, OPS);
+
+  while (!benchmark_done(bench)) {
+    benchmark_start(bench);
+    for (int i = 0; i < OPS; i++) {
+      interrupt_level_t old_level = set_interrupt_level(DISABLED);
+      set_interrupt_level(old_level);
+    }
+    benchmark_stop(bench);
+  }
+
+  benchmark_report(bench);
+  benchmark_destroy(bench);
+}
+
+void bench_uncontended() {
+  semaphore_t* sem = semaphore_create();
+  mutex_t* mutex = mutex_create();
+  benchmark_t* pv = benchmark_create("sema-PV", SAMPLES, OPS);
+  benchmark_t* lock = benchmark_create("mutex-lock-unlock", SAMPLES, OPS);
+  semaphore_initialize(sem, 1);
+
+  while (!benchmark_done(pv)) {
+    benchmark_start(pv);
+    for (int i = 0; i < OPS; i++) {
+      semaphore_P(sem);
+      semaphore_V(sem);
+    }
+    benchmark_stop(pv);
+  }
+
+  while (!benchmark_done(lock)) {
+    benchmark_start(lock);
+    for (int i = 0; i < OPS; i++) {
+      mutex_lock(mutex);
+      mutex_unlock(mutex);
+    }
+    benchmark_stop(lock);
+  }
+
+  benchmark_report(pv);
+  benchmark_report(lock);
+  benchmark_destroy(pv);
+  benchmark_destroy(lock);
+  mutex_destroy(mutex);
+  semaphore_destroy(sem);
+}
+
+int ponger(int* arg) {
+  while (1) {
+    semaphore_P(pong);
+    if (stop) break;
+    semaphore_V(ping);
+  }
+  semaphore_V(done);
+  return 0;
+}
+
+void bench_pingpong(const char* name, int handoff) {
+  benchmark_t* bench = benchmark_create(name, SAMPLES, 2 * OPS); // a round trip is two wakeups
+  semaphore_set_handoff(ping, handoff);
+  semaphore_set_handoff(pong, handoff);
+
+  stop = 0;
+  minithread_fork(ponger, NULL);
+  while (!benchmark_done(bench)) {
+    benchmark_start(bench);
+    for (int i = 0; i < OPS; i++) {
+      semaphore_V(pong);
+      semaphore_P(ping);
+    }
+    benchmark_stop(bench);
+  }
+  stop = 1;
+  semaphore_V(pong);
+  semaphore_P(done);
+
+  benchmark_report(bench);
+  benchmark_destroy(bench);
+}
+
+int broadcast_waiter(int* arg) {
+  int waiters = *arg;
+  mutex_lock(lock);
+  for (int i = 0; i < SAMPLES; i++) {
+    int g = generation;
+    if (++numArrived == waiters) condvar_signal(arrived);
+    while (generation == g) condvar_wait(go, lock);
+  }
+  mutex_unlock(lock);
+  semaphore_V(done);
+  return 0;
+}
+
+void bench_broadcast(const char* name, int waiters) {
+  benchmark_t* bench = benchmark_create(name, SAMPLES, 1);
+  numArrived = 0;
+  for (int i = 0; i < waiters; i++) minithread_fork(broadcast_waiter, &waiters);
+
+  mutex_lock(lock);
+  while (!benchmark_done(bench)) {
+    while (numArrived < waiters) condvar_wait(arrived, lock);
+    numArrived = 0;
+    generation++;
+    benchmark_start(bench);
+    condvar_broadcast(go);
+    benchmark_stop(bench);
+  }
+  mutex_unlock(lock);
+  for (int i = 0; i < waiters; i++) semaphore_P(done);
+
+  benchmark_report(bench);
+  benchmark_destroy(bench);
+}
+
+int main_thread(int* arg) {
+  ping = semaphore_create();
+  pong = semaphore_create();
+  done = semaphore_create();
+  semaphore_initialize(ping, 0);
+  semaphore_initialize(pong, 0);
+  semaphore_initialize(done, 0);
+  lock = mutex_create();
+  arrived = condvar_create();
+  go = condvar_create();
+
+  bench_interrupt_level();
+  bench_uncontended();
+  bench_pingpong("sema-pingpong", 0);
+  bench_pingpong("sema-pingpong-handoff", 1);
+  bench_broadcast("condvar-broadcast-16", 16);
+  bench_broadcast("condvar-broadcast-256", 256);
+
+  exit(0); // the system never stops on its own
+}
+
+int main(int argc, char** argv) {
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}
@@ -0,0 +1,90 @@
+/* bench-yield.c
+
+   Yield ping-pong: N threads call minithread_yield() in a loop, so that
+   every yield is a context switch to the next of them. Reports the time
+   per switch for 2, 4 and 16 threads, or for the given number of threads.
+
+   USAGE: ./bench-yield [<threads>]
+*/
+
+#include "minithread.h"
+#include "synch.h"
+#include "benchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_THREADS 64
+#define SAMPLES 200
+#define SWITCHES 10000 // # of switches timed by a sample
+
+int num_threads;
+int ids[MAX_THREADS];
+volatile int stop;
+semaphore_t* done;
+benchmark_t* bench;
+
+int yielder(int* arg) {
+  int rounds = SWITCHES / num_threads; // each round, every thread yields once
+
+  if (*arg == 0) { // thread 0 times the samples
+    for (int i = 0; i < rounds; i++) minithread_yield(); // warm up
+    while (!benchmark_done(bench)) {
+      benchmark_start(bench);
+      for (int i = 0; i < rounds; i++) minithread_yield();
+      benchmark_stop(bench);
+    }
+    stop = 1;
+  }
+  else {
+    while (!stop) minithread_yield();
+  }
+
+  semaphore_V(done);
+  return 0;
+}
+
+void run(int threads) {
+  static char name[32];
+  sprintf(name, "yield-%d", threads);
+
+  num_threads = threads;
+  stop = 0;
+  bench = benchmark_create(name, SAMPLES, (SWITCHES / threads) * threads);
+  for (int i = 0; i < threads; i++) {
+    ids[i] = i;
+    minithread_fork(yielder, &ids[i]);
+  }
+  for (int i = 0; i < threads; i++) semaphore_P(done);
+
+  benchmark_report(bench);
+  benchmark_destroy(bench);
+}
+
+int main_thread(int* arg) {
+  done = semaphore_create();
+  semaphore_initialize(done, 0);
+
+  if (*arg > 0) run(*arg);
+  else {
+    run(2);
+    run(4);
+    run(16);
+  }
+
+  exit(0); // the system never stops on its own
+}
+
+int main(int argc, char** argv) {
+  static int threads = 0;
+  if (argc > 1) {
+    threads = atoi(argv[1]);
+    if (threads < 2 || threads > MAX_THREADS) {
+      printf("The number of threads must be between 2 and %d.\n", MAX_THREADS);
+      return -1;
+    }
+  }
+
+  minithread_system_initialize(main_thread, &threads);
+  return -1;
+}
@@ -0,0 +1,133 @@
+/*
+ * Implementation of the microbenchmark support.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "benchmark.h"
+
+struct benchmark {
+	const char* name;		// printed in the report
+	int maxSamples;			// size of samplesNs
+	int numSamples;			// # of samples taken so far
+	uint64_t opsPerSample;	// # of operations timed by one sample
+	uint64_t* samplesNs;	// time per operation of each sample
+	uint64_t startNs;		// when the current sample started, see benchmark_start()
+};
+
+// ---- Internal Functions ---- //
+static int compare_samples(const void* a, const void* b)
+{
+	uint64_t x = *(const uint64_t*)a;
+	uint64_t y = *(const uint64_t*)b;
+	return (x > y) - (x < y);
+}
+
+// the sample below which percent percent of the sorted samples fall
+static uint64_t percentile(const uint64_t* sorted, int n, int percent)
+{
+	int i = (n * percent) / 100;
+	return sorted[(i < n) ? i : n - 1];
+}
+
+// ---- Benchmarks ---- //
+uint64_t benchmark_now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+benchmark_t* benchmark_create(const char* name, int maxSamples, uint64_t opsPerSample)
+{
+	if (name == NULL || maxSamples <= 0 || opsPerSample == 0) return NULL;
+
+	benchmark_t* b = malloc(sizeof(benchmark_t));
+	if (b == NULL) return NULL;
+
+	b->samplesNs = malloc(maxSamples * sizeof(uint64_t));
+	if (b->samplesNs == NULL)
+	{
+		free(b); //free memory just allocated
+		return NULL;
+	}
+
+	b->name = name;
+	b->maxSamples = maxSamples;
+	b->numSamples = 0;
+	b->opsPerSample = opsPerSample;
+	b->startNs = 0;
+	return b;
+}
+
+void benchmark_destroy(benchmark_t* b)
+{
+	if (b == NULL) return;
+
+	free(b->samplesNs);
+	free(b);
+}
+
+void benchmark_start(benchmark_t* b)
+{
+	b->startNs = benchmark_now_ns();
+}
+
+void benchmark_stop(benchmark_t* b)
+{
+	benchmark_record(b, benchmark_now_ns() - b->startNs);
+}
+
+void benchmark_record(benchmark_t* b, uint64_t elapsedNs)
+{
+	if (b->numSamples == b->maxSamples) return;
+
+	b->samplesNs[b->numSamples++] = elapsedNs / b->opsPerSample;
+}
+
+int benchmark_done(benchmark_t* b)
+{
+	return b->numSamples == b->maxSamples;
+}
+
+// returns the samples of b sorted, NULL on failure; the caller frees them
+static uint64_t* sorted_samples(benchmark_t* b)
+{
+	uint64_t* sorted = malloc(b->numSamples * sizeof(uint64_t));
+	if (sorted == NULL) return NULL;
+
+	memcpy(sorted, b->samplesNs, b->numSamples * sizeof(uint64_t));
+	qsort(sorted, b->numSamples, sizeof(uint64_t), compare_samples);
+	return sorted;
+}
+
+uint64_t benchmark_percentile(benchmark_t* b, int percent)
+{
+	if (b->numSamples == 0) return 0;
+
+	uint64_t* sorted = sorted_samples(b);
+	if (sorted == NULL) return 0;
+	uint64_t value = percentile(sorted, b->numSamples, percent);
+	free(sorted);
+	return value;
+}
+
+void benchmark_report(benchmark_t* b)
+{
+	if (b->numSamples == 0) {
+		printf("!$BENCH: %-28s no samples\n", b->name);
+		return;
+	}
+
+	uint64_t* sorted = sorted_samples(b);
+	if (sorted == NULL) return;
+
+	int n = b->numSamples;
+	printf("!$BENCH: %-28s ns/op  min %llu  p50 %llu  p90 %llu  p99 %llu  max %llu  (%d x %llu)\n", b->name,
+		(unsigned long long)sorted[0], (unsigned long long)percentile(sorted, n, 50),
+		(unsigned long long)percentile(sorted, n, 90), (unsigned long long)percentile(sorted, n, 99),
+		(unsigned long long)sorted[n - 1], n, (unsigned long long)b->opsPerSample);
+	free(sorted);
+}
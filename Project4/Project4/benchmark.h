@@ -0,0 +1,76 @@
+/*
+ * Microbenchmark support for the bench-* programs.
+ *
+ *      A benchmark times an operation in samples of a fixed number of
+ *      operations each, and reports the distribution of the time per
+ *      operation over the samples. The median is what to compare between
+ *      two builds: a sample hit by the clock interrupt or by the host only
+ *      moves the upper percentiles.
+ *
+ *      Every report line starts with "!$BENCH:" so that the results of a
+ *      run can be picked out of the programs' output:
+ *
+ *        !$BENCH: yield-2                      ns/op  min 98  p50 101  p90 104  p99 130  max 210  (200 x 10000)
+ */
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+#include <stdint.h>
+
+typedef struct benchmark benchmark_t;
+
+/*
+ * uint64_t benchmark_now_ns()
+ *  Current time in nanoseconds from a monotonic clock.
+ */
+uint64_t benchmark_now_ns();
+
+/*
+ * benchmark_t* benchmark_create(const char* name, int maxSamples, uint64_t opsPerSample)
+ *  Allocate a benchmark that keeps up to maxSamples samples of
+ *  opsPerSample operations each. Returns NULL on failure.
+ */
+benchmark_t* benchmark_create(const char* name, int maxSamples, uint64_t opsPerSample);
+
+/*
+ * benchmark_destroy(benchmark_t* b)
+ *  Deallocate a benchmark.
+ */
+void benchmark_destroy(benchmark_t* b);
+
+/*
+ * benchmark_start(benchmark_t* b)
+ * benchmark_stop(benchmark_t* b)
+ *  Time one sample: the operations run between the two calls.
+ */
+void benchmark_start(benchmark_t* b);
+void benchmark_stop(benchmark_t* b);
+
+/*
+ * benchmark_record(benchmark_t* b, uint64_t elapsedNs)
+ *  Add a sample of opsPerSample operations that took elapsedNs, for samples
+ *  timed elsewhere (for instance across threads). Samples beyond maxSamples
+ *  are dropped.
+ */
+void benchmark_record(benchmark_t* b, uint64_t elapsedNs);
+
+/*
+ * int benchmark_done(benchmark_t* b)
+ *  Returns 1 once maxSamples samples have been taken, 0 before.
+ */
+int benchmark_done(benchmark_t* b);
+
+/*
+ * uint64_t benchmark_percentile(benchmark_t* b, int percent)
+ *  Returns the time per operation below which percent percent of the
+ *  samples fall (50 for the median), 0 if there are no samples.
+ */
+uint64_t benchmark_percentile(benchmark_t* b, int percent);
+
+/*
+ * benchmark_report(benchmark_t* b)
+ *  Print the distribution of the time per operation to stdout.
+ */
+void benchmark_report(benchmark_t* b);
+
+#endif /*__BENCHMARK_H__*/
@@ -0,0 +1,82 @@
+/* broadcast.c
+
+   Broadcasts over a two-host topology made of this host and 127.0.0.2,
+   which also reaches this process, with loopback on: each broadcast must
+   arrive twice, once through the link and once from ourselves, and nothing
+   else may arrive.
+
+   USAGE: ./broadcast <port>
+
+   where <port> is the UDP port to use
+*/
+
+#include "minithread.h"
+#include "minimsg.h"
+#include "network.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NUM_BROADCASTS 5
+#define PORT 7
+#define TIMEOUT_MS 2000
+
+char topologyFile[] = "/tmp/portos-topologyXXXXXX";
+
+int watchdog(int* arg) {
+  minithread_sleep_with_timeout(TIMEOUT_MS);
+  printf("FAILED: timed out.\n");
+  unlink(topologyFile);
+  exit(0);
+}
+
+int main_thread(int* arg) {
+  char text[] = "broadcast";
+  char buffer[MINIMSG_MAX_MSG_SIZE];
+  miniport_t* from;
+  int errors = 0;
+
+  miniport_t* port = miniport_create_unbound(PORT);
+  minithread_fork(watchdog, NULL);
+  for (int i = 0; i < NUM_BROADCASTS; i++) {
+    if (minimsg_broadcast(port, PORT, text, sizeof(text)) != sizeof(text)) errors++;
+    for (int copy = 0; copy < 2; copy++) {
+      int length = sizeof(buffer);
+      minimsg_receive(port, &from, buffer, &length);
+      if (length != sizeof(text) || strcmp(buffer, text) != 0) errors++;
+      miniport_destroy(from);
+    }
+  }
+
+  minithread_sleep_with_timeout(100); // a third copy would have arrived by now
+  miniport_stats_t stats;
+  miniport_get_stats(port, &stats);
+  if (stats.queue_depth != 0) errors++;
+
+  printf("%d broadcasts received twice each, %d errors.\n", NUM_BROADCASTS, errors);
+  printf((errors == 0) ? "Broadcast works.\n" : "FAILED.\n");
+  unlink(topologyFile);
+  exit(0); // the system never stops on its own
+}
+
+int main(int argc, char** argv) {
+  char hostname[64];
+  int fd = mkstemp(topologyFile);
+  FILE* topology = (fd == -1) ? NULL : fdopen(fd, "w");
+  if (argc < 2 || topology == NULL || gethostname(hostname, sizeof(hostname)) != 0) {
+    printf("FAILED.\n");
+    return -1;
+  }
+
+  // the hosts, a blank line, then the links: this host -> 127.0.0.2
+  fprintf(topology, "%s\n127.0.0.2\n\n.x\n..\n", hostname);
+  fclose(topology);
+
+  short port = atoi(argv[1]);
+  network_udp_ports(port, port);
+  network_enable_broadcast(topologyFile, 1);
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}
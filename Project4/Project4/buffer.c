@@ -2,41 +2,37 @@
  * Bounded buffer example. 
  *
  * Sample program that implements a single producer-single consumer
- * system. To be used to test the correctness of the threading and
- * synchronization implementations.
+ * system over a channel, moving the items in batches. To be used to test
+ * the correctness of the threading and synchronization implementations.
  * 
  * Change MAXCOUNT to vary the number of items produced by the producer.
  */
 #include <stdio.h>
 #include <stdlib.h>
 #include "minithread.h"
-#include "synch.h"
+#include "channel.h"
 #include "random.h"
 #define BUFFER_SIZE 16
 
 #define MAXCOUNT  1000
 
-int buffer[BUFFER_SIZE];
-int size, head, tail;
-
-semaphore_t* empty = NULL;
-semaphore_t* full = NULL;
+channel_t* buffer = NULL;
 
 int consumer(int* arg) {
-  int n, i;
+  int items[BUFFER_SIZE];
+  int n, i, got;
   int out = 0;
 
   while (out < *arg) {
     n = genintrand(BUFFER_SIZE);
     n = (n <= *arg - out) ? n : *arg - out;
     printf("Consumer wants to get %d items out of buffer ...\n", n);
-    for (i=0; i<n; i++) {
-      semaphore_P(empty);
-      out = buffer[tail];
-      printf("Consumer is taking %d out of buffer.\n", out);
-      tail = (tail + 1) % BUFFER_SIZE;
-      size--;
-      semaphore_V(full);
+    for (got = 0; got < n; got += i) {
+      i = channel_receive_batch(buffer, items, n - got);
+      for (int j = 0; j < i; j++) {
+        out = items[j];
+        printf("Consumer is taking %d out of buffer.\n", out);
+      }
     }
   }
 
@@ -45,6 +41,7 @@ int consumer(int* arg) {
 }
 
 int producer(int* arg) {
+  int items[BUFFER_SIZE];
   int count = 1;
   int n, i;
 
@@ -57,13 +54,10 @@ int producer(int* arg) {
     n = (n <= *arg - count + 1) ? n : *arg - count + 1;
     printf("Producer wants to put %d items into buffer ...\n", n);
     for (i=0; i<n; i++) {
-      semaphore_P(full);
       printf("Producer is putting %d into buffer.\n", count);
-      buffer[head] = count++;
-      head = (head + 1) % BUFFER_SIZE;
-      size++;
-      semaphore_V(empty);
+      items[i] = count++;
     }
+    channel_send_batch(buffer, items, n);
   }
 
   return 0;
@@ -73,11 +67,8 @@ int
 main(int argc, char * argv[]) {
   int maxcount = MAXCOUNT;
   
-  size = head = tail = 0;
-  empty = semaphore_create();
-  semaphore_initialize(empty, 0);
-  full = semaphore_create();
-  semaphore_initialize(full, BUFFER_SIZE);
+  buffer = channel_create(sizeof(int), BUFFER_SIZE);
+  channel_set_handoff(buffer, true); /* each side runs as soon as the other made room or items for it */
 
   minithread_system_initialize(producer, &maxcount);
   return -1;
@@ -0,0 +1,171 @@
+/*
+ * Implementation of the channels.
+ */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "defs.h"
+#include "channel.h"
+#include "minithread.h"
+#include "interrupts.h"
+#include "queue.h"
+
+struct channel {
+	char* items;			//the ring buffer, capacity items
+	size_t itemSize;
+	int capacity;
+	int head;				//index of the oldest item
+	int length;				//# of items in the channel
+	bool closed;
+	bool handoff;			//whether a call switches to the thread it wakes up, see channel_set_handoff()
+	queue_t* senders;		//threads waiting for room, oldest first
+	queue_t* receivers;		//threads waiting for items, oldest first
+};
+
+// This function starts the oldest thread of a wait queue, if any, switching to it if handoff is set. Caller must
+// disable interrupts, which are disabled again on return.
+static void wake_one(queue_t* waiters, bool handoff)
+{
+	minithread_t* t = NULL;
+	if (queue_dequeue(waiters, (void**)&t) != 0) return;
+	if (!handoff) {
+		minithread_start(t);
+		return;
+	}
+	minithread_handoff(t); //this reenables interrupts if it switches
+	set_interrupt_level(DISABLED);
+}
+
+// This function stops the caller on a wait queue until it is woken up. Caller must disable interrupts, which are
+// disabled again on return.
+static void wait_on(queue_t* waiters)
+{
+	int appendSuccess = queue_append(waiters, minithread_self());
+	AbortOnCondition(appendSuccess != 0, "Failed in queue_append operation in channel wait_on()");
+	minithread_stop(); //this reenables interrupts
+	set_interrupt_level(DISABLED);
+}
+
+channel_t* channel_create(size_t itemSize, int capacity)
+{
+	if (itemSize == 0 || capacity <= 0) return NULL;
+
+	channel_t* channel = malloc(sizeof(channel_t));
+	if (channel == NULL) return NULL;
+	channel->items = malloc(itemSize * capacity);
+	channel->senders = queue_new();
+	channel->receivers = queue_new();
+	if (channel->items == NULL || channel->senders == NULL || channel->receivers == NULL) {
+		free(channel->items);
+		if (channel->senders != NULL) queue_free(channel->senders);
+		if (channel->receivers != NULL) queue_free(channel->receivers);
+		free(channel);
+		return NULL;
+	}
+	channel->itemSize = itemSize;
+	channel->capacity = capacity;
+	channel->head = 0;
+	channel->length = 0;
+	channel->closed = false;
+	channel->handoff = false;
+	return channel;
+}
+
+void channel_destroy(channel_t* channel)
+{
+	AbortOnCondition(channel == NULL, "Null argument channel in channel_destroy()");
+	AbortOnCondition(queue_length(channel->senders) != 0 || queue_length(channel->receivers) != 0, "Threads wait on the channel in channel_destroy()");
+
+	queue_free(channel->senders);
+	queue_free(channel->receivers);
+	free(channel->items);
+	free(channel);
+}
+
+int channel_send(channel_t* channel, const void* item)
+{
+	return (channel_send_batch(channel, item, 1) == 1) ? 0 : -1;
+}
+
+int channel_send_batch(channel_t* channel, const void* items, int n)
+{
+	AbortOnCondition(channel == NULL || (items == NULL && n > 0), "Invalid arguments passed to channel_send_batch()");
+
+	const char* from = (const char*)items;
+	int sent = 0;
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //the ring is shared with the receivers
+	bool handoff = channel->handoff && old_level == ENABLED; //switching is only safe if the caller does not expect interrupts to stay off
+	while (sent < n && !channel->closed) {
+		if (channel->length == channel->capacity) {
+			wait_on(channel->senders);
+			continue;
+		}
+
+		// copy as many items as fit, in up to two pieces as the free entries may wrap around
+		int count = channel->capacity - channel->length;
+		if (count > n - sent) count = n - sent;
+		int tail = (channel->head + channel->length) % channel->capacity;
+		int first = (count < channel->capacity - tail) ? count : channel->capacity - tail;
+		memcpy(channel->items + tail * channel->itemSize, from, first * channel->itemSize);
+		memcpy(channel->items, from + first * channel->itemSize, (count - first) * channel->itemSize);
+		from += count * channel->itemSize;
+		channel->length += count;
+		sent += count;
+		wake_one(channel->receivers, handoff);
+	}
+	if (channel->length < channel->capacity && !channel->closed) wake_one(channel->senders, false); //pass on the room left
+	set_interrupt_level(old_level);
+	return sent;
+}
+
+int channel_receive(channel_t* channel, void* item)
+{
+	return (channel_receive_batch(channel, item, 1) == 1) ? 0 : -1;
+}
+
+int channel_receive_batch(channel_t* channel, void* items, int max)
+{
+	AbortOnCondition(channel == NULL || (items == NULL && max > 0), "Invalid arguments passed to channel_receive_batch()");
+	if (max <= 0) return 0;
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //the ring is shared with the senders
+	while (channel->length == 0) {
+		if (channel->closed) {
+			set_interrupt_level(old_level);
+			return 0;
+		}
+		wait_on(channel->receivers);
+	}
+
+	// copy as many items as there are, in up to two pieces as they may wrap around
+	int count = (channel->length < max) ? channel->length : max;
+	int first = (count < channel->capacity - channel->head) ? count : channel->capacity - channel->head;
+	char* to = (char*)items;
+	memcpy(to, channel->items + channel->head * channel->itemSize, first * channel->itemSize);
+	memcpy(to + first * channel->itemSize, channel->items, (count - first) * channel->itemSize);
+	channel->head = (channel->head + count) % channel->capacity;
+	channel->length -= count;
+
+	wake_one(channel->senders, false); //the receiver goes on with the items it got
+	if (channel->length > 0) wake_one(channel->receivers, false); //pass on the items left
+	set_interrupt_level(old_level);
+	return count;
+}
+
+void channel_close(channel_t* channel)
+{
+	AbortOnCondition(channel == NULL, "Null argument channel in channel_close()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	channel->closed = true;
+	while (queue_length(channel->senders) > 0) wake_one(channel->senders, false);
+	while (queue_length(channel->receivers) > 0) wake_one(channel->receivers, false);
+	set_interrupt_level(old_level);
+}
+
+void channel_set_handoff(channel_t* channel, bool handoff)
+{
+	AbortOnCondition(channel == NULL, "Null argument channel in channel_set_handoff()");
+	channel->handoff = handoff;
+}
@@ -0,0 +1,75 @@
+/*
+ * channel.h:
+ *  Bounded channels between minithreads.
+ *
+ *  A channel is a ring buffer of fixed size items. Sending copies items in
+ *  and blocks only while the channel is full; receiving copies them out
+ *  and blocks only while it is empty. Items are received in the order they
+ *  were sent. The batch calls move as many items as fit at once, and
+ *  whichever call changes the channel wakes at most one waiting thread,
+ *  which passes the wakeup on if there is more for the other waiters.
+ *
+ *  A closed channel takes no more items, and its remaining items can still
+ *  be received.
+ */
+#ifndef __CHANNEL_H__
+#define __CHANNEL_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct channel channel_t;
+
+/*
+ * channel_t* channel_create(size_t itemSize, int capacity)
+ *  Create a channel of capacity items of itemSize bytes. Returns NULL if
+ *  either is zero or if out of memory.
+ *
+ * channel_destroy(channel_t* channel)
+ *  Free a channel no thread waits on.
+ */
+channel_t* channel_create(size_t itemSize, int capacity);
+void channel_destroy(channel_t* channel);
+
+/*
+ * int channel_send(channel_t* channel, const void* item)
+ *  Send the item at item, waiting while the channel is full. Returns 0 on
+ *  success, -1 if the channel is closed.
+ *
+ * int channel_send_batch(channel_t* channel, const void* items, int n)
+ *  Send the n consecutive items at items, waiting whenever the channel is
+ *  full. Returns the number of items sent, which is less than n only if the
+ *  channel was closed meanwhile.
+ */
+int channel_send(channel_t* channel, const void* item);
+int channel_send_batch(channel_t* channel, const void* items, int n);
+
+/*
+ * int channel_receive(channel_t* channel, void* item)
+ *  Receive an item into item, waiting while the channel is empty. Returns
+ *  0 on success, -1 if the channel is closed and empty.
+ *
+ * int channel_receive_batch(channel_t* channel, void* items, int max)
+ *  Receive up to max items into the array items, waiting only while the
+ *  channel is empty. Returns the number of items received, 0 if the
+ *  channel is closed and empty.
+ */
+int channel_receive(channel_t* channel, void* item);
+int channel_receive_batch(channel_t* channel, void* items, int max);
+
+/*
+ * channel_close(channel_t* channel)
+ *  Close the channel: waiting senders fail, waiting receivers get the
+ *  remaining items and then fail.
+ */
+void channel_close(channel_t* channel);
+
+/*
+ * channel_set_handoff(channel_t* channel, bool handoff)
+ *  In handoff mode, a call that makes room or items for a waiting thread
+ *  switches straight to it (see minithread_handoff()), so that the items
+ *  move on while they are still in the cache. Off by default.
+ */
+void channel_set_handoff(channel_t* channel, bool handoff);
+
+#endif /*__CHANNEL_H__*/
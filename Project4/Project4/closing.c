@@ -0,0 +1,105 @@
+/* closing.c
+
+   Closing a minisocket while sends are using it. With every packet lost,
+   one thread sends a message and waits for ACKs, and a second one waits
+   for its turn to send. Closing the socket must fail both sends with
+   SOCKET_SENDERROR and return only once both have returned. The link is
+   mended just before the close, so the FIN must get its answer at once
+   instead of being retransmitted until the close gives up.
+
+   USAGE: ./closing <port>
+
+   where <port> is the UDP port to use
+*/
+
+#include "minithread.h"
+#include "minisocket.h"
+#include "network.h"
+#include "synch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define QUANTUM_MS 10
+#define PORT 7
+#define MESSAGE_SIZE 100000
+#define BLOCK_MS 30 // less than the first retransmission timeout
+#define MAX_CLOSE_MS 1000
+
+char buffer[MESSAGE_SIZE];
+minisocket_t* server;
+semaphore_t* connected;
+
+volatile int returned[2];
+minisocket_error errors[2];
+
+int client(int* arg) {
+  network_address_t my_address;
+  minisocket_error error;
+  network_get_my_address(my_address);
+  minisocket_t* socket = minisocket_client_create(my_address, PORT, &error);
+  semaphore_V(connected);
+  if (socket == NULL) return -1;
+  return 0; // the socket is left open, the process exits first
+}
+
+int sender(int* arg) {
+  int id = *arg;
+  minisocket_send(server, buffer, MESSAGE_SIZE, &errors[id]);
+  returned[id] = 1;
+  return 0;
+}
+
+void set_loss(double rate) {
+  network_sim_params_t params;
+  memset(&params, 0, sizeof(params));
+  params.loss_rate = rate;
+  params.seed = 1;
+  network_simulated_link(&params);
+}
+
+int main_thread(int* arg) {
+  static int ids[] = { 0, 1 };
+  minisocket_error error;
+  int failures = 0;
+
+  connected = semaphore_create();
+  semaphore_initialize(connected, 0);
+  minithread_fork(client, NULL);
+  server = minisocket_server_create(PORT, &error);
+  semaphore_P(connected);
+  if (server == NULL) {
+    printf("FAILED.\n");
+    exit(0);
+  }
+
+  set_loss(1.0);
+  minithread_fork(sender, &ids[0]);
+  minithread_fork(sender, &ids[1]);
+  minithread_sleep_with_timeout(BLOCK_MS); // the first sender waits for ACKs, the second for its turn
+  if (returned[0] || returned[1]) failures++;
+
+  set_loss(0.0);
+  unsigned long long start = currentTimeMillis();
+  minisocket_close(server);
+  unsigned long long elapsed = currentTimeMillis() - start;
+  printf("closed in %llu ms, sends returned: %d %d, errors: %d %d.\n", elapsed, returned[0], returned[1], errors[0], errors[1]);
+  if (!returned[0] || !returned[1] || errors[0] != SOCKET_SENDERROR || errors[1] != SOCKET_SENDERROR) failures++;
+  if (elapsed > MAX_CLOSE_MS) failures++;
+
+  printf((failures == 0) ? "Closing works.\n" : "FAILED.\n");
+  exit(0); // the system never stops on its own
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    printf("FAILED.\n");
+    return -1;
+  }
+  short port = atoi(argv[1]);
+  network_udp_ports(port, port);
+  minithread_set_quantum(QUANTUM_MS);
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}
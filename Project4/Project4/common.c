@@ -18,7 +18,7 @@ void minisocket_network_handler(network_interrupt_arg_t* arg);
 
 void free_network_arg(void * arg) // This is used in queue_free_nodes_and_queue()
 {
-	free((network_interrupt_arg_t*)arg);
+	network_free_pkt((network_interrupt_arg_t*)arg);
 }
 
 void common_network_handler(network_interrupt_arg_t* arg)
@@ -28,7 +28,7 @@ void common_network_handler(network_interrupt_arg_t* arg)
 	//if packet size is less than header size, don't enqueue it and just return. mini_header_t is smaller than mini_header_reliable_t
 	if (arg->size < sizeof(mini_header_t))
 	{
-		free(arg);
+		network_free_pkt(arg);
 		set_interrupt_level(old_level); //restore interrupt level
 		return;
 	}
@@ -37,18 +37,18 @@ void common_network_handler(network_interrupt_arg_t* arg)
 	switch (receivedHeaderPtr->protocol) {
 	case PROTOCOL_MINIDATAGRAM: //UDP
 		if (arg->size - sizeof(mini_header_t) > MINIMSG_MAX_MSG_SIZE) //discard the packet
-			free(arg);
+			network_free_pkt(arg);
 		else
 			minimsg_network_handler(arg);
 		break;
 	case PROTOCOL_MINISTREAM:	//TCP
 		if (arg->size < sizeof(mini_header_reliable_t) || arg->size > MAX_NETWORK_PKT_SIZE) //discard the packet
-			free(arg);
+			network_free_pkt(arg);
 		else
 			minisocket_network_handler(arg);
 		break;
 	default: // discard unknown packet
-		free(arg);
+		network_free_pkt(arg);
 		break;
 	}
 
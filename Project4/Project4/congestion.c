@@ -0,0 +1,109 @@
+/*
+ * Implementation of the minisocket congestion controllers.
+ */
+#include <assert.h>
+
+#include "congestion.h"
+
+// ---- Constants ---- //
+#define INITIAL_WINDOW_SEGMENTS		2		/* initial cwnd in segments */
+#define INITIAL_SSTHRESH			(64 * 1024 * 1024)	/* effectively unlimited until the first loss */
+
+// ---- Internal Functions ---- //
+// new slow start threshold after a loss: half the data in flight, but at least two segments
+static int half_flight(cc_state_t* cc, int flight)
+{
+	int half = flight / 2;
+	return (half < 2 * cc->mss) ? 2 * cc->mss : half;
+}
+
+// ---- NewReno ---- //
+static void newreno_init(cc_state_t* cc, int mss)
+{
+	assert(mss > 0);
+
+	cc->mss = mss;
+	cc->cwnd = INITIAL_WINDOW_SEGMENTS * mss;
+	cc->ssthresh = INITIAL_SSTHRESH;
+	cc->inRecovery = false;
+	cc->recover = 0;
+	cc->numFastRetransmits = 0;
+	cc->numTimeouts = 0;
+}
+
+static void newreno_on_ack(cc_state_t* cc, int ackedBytes)
+{
+	if (cc->inRecovery) return; // the window is held at ssthresh until recovery is done
+
+	if (cc->cwnd < cc->ssthresh) { // slow start: grow by the bytes acked (appropriate byte counting)
+		cc->cwnd += (ackedBytes < cc->mss) ? ackedBytes : cc->mss;
+	}
+	else { // congestion avoidance: grow by about one segment per window acked
+		int increase = (int)((long)cc->mss * ackedBytes / cc->cwnd);
+		cc->cwnd += (increase > 0) ? increase : 1;
+	}
+}
+
+static void newreno_on_fast_retransmit(cc_state_t* cc, int flight)
+{
+	cc->numFastRetransmits++;
+	cc->ssthresh = half_flight(cc, flight); // multiplicative decrease
+	cc->cwnd = cc->ssthresh;
+}
+
+static void newreno_on_recovery_done(cc_state_t* cc)
+{
+	cc->cwnd = cc->ssthresh; // deflate the window, continue in congestion avoidance
+}
+
+static void newreno_on_timeout(cc_state_t* cc, int flight)
+{
+	cc->numTimeouts++;
+	cc->ssthresh = half_flight(cc, flight);
+	cc->cwnd = cc->mss; // back to slow start from one segment
+}
+
+const cc_ops_t cc_newreno = {
+	"newreno",
+	newreno_init,
+	newreno_on_ack,
+	newreno_on_fast_retransmit,
+	newreno_on_recovery_done,
+	newreno_on_timeout
+};
+
+// ---- Stop and wait ---- //
+static void stop_and_wait_init(cc_state_t* cc, int mss)
+{
+	newreno_init(cc, mss);
+	cc->cwnd = mss;
+	cc->ssthresh = mss;
+}
+
+static void stop_and_wait_on_ack(cc_state_t* cc, int ackedBytes)
+{
+	// the window never grows
+}
+
+static void stop_and_wait_on_fast_retransmit(cc_state_t* cc, int flight)
+{
+	cc->numFastRetransmits++;
+}
+
+static void stop_and_wait_on_recovery_done(cc_state_t* cc)
+{
+}
+
+static void stop_and_wait_on_timeout(cc_state_t* cc, int flight)
+{
+	cc->numTimeouts++;
+}
+
+const cc_ops_t cc_stop_and_wait = {
+	"stop-and-wait",
+	stop_and_wait_init,
+	stop_and_wait_on_ack,
+	stop_and_wait_on_fast_retransmit,
+	stop_and_wait_on_recovery_done,
+	stop_and_wait_on_timeout
+};
@@ -0,0 +1,67 @@
+/*
+ * Congestion control for minisockets.
+ *
+ *      A congestion controller decides how many bytes a minisocket may have
+ *      in flight (its congestion window). The minisocket layer does the
+ *      sending, acking and retransmitting, and reports what happened to the
+ *      controller through the callbacks below. Controllers are selected per
+ *      socket (see minisocket_set_congestion_control() in minisocket.h).
+ */
+#ifndef __CONGESTION_H__
+#define __CONGESTION_H__
+
+#include <stdbool.h>
+
+/* # of duplicate ACKs in a row that trigger a fast retransmit */
+#define CC_DUPACK_THRESHOLD 3
+
+/*
+ * Congestion state of one socket. The window sizes are in bytes.
+ */
+typedef struct cc_state
+{
+	int cwnd;				// congestion window: max # of unacknowledged bytes in flight
+	int ssthresh;			// slow start threshold: slow start while cwnd < ssthresh
+	int mss;				// maximum segment size
+	bool inRecovery;		// a fast retransmit is being recovered from
+	unsigned int recover;	// highest sequence number sent when recovery started
+	unsigned int numFastRetransmits;	// # of fast retransmits so far
+	unsigned int numTimeouts;			// # of retransmission timeouts so far
+} cc_state_t;
+
+/*
+ * A congestion controller. Every callback is required.
+ *
+ *  init(cc, mss)                  -- set up the state of a new socket
+ *  on_ack(cc, ackedBytes)         -- an ACK acknowledged ackedBytes new bytes
+ *  on_fast_retransmit(cc, flight) -- CC_DUPACK_THRESHOLD duplicate ACKs were seen
+ *                                    with flight bytes outstanding; the socket
+ *                                    retransmits from the first unacked byte
+ *  on_recovery_done(cc)           -- everything outstanding at the fast
+ *                                    retransmit has been acknowledged
+ *  on_timeout(cc, flight)         -- the retransmission timer fired with flight
+ *                                    bytes outstanding
+ */
+typedef struct cc_ops
+{
+	const char* name;
+	void(*init)(cc_state_t* cc, int mss);
+	void(*on_ack)(cc_state_t* cc, int ackedBytes);
+	void(*on_fast_retransmit)(cc_state_t* cc, int flight);
+	void(*on_recovery_done)(cc_state_t* cc);
+	void(*on_timeout)(cc_state_t* cc, int flight);
+} cc_ops_t;
+
+/*
+ * NewReno-like AIMD: slow start, congestion avoidance, and fast retransmit /
+ * fast recovery on triple duplicate ACK. This is the default controller.
+ */
+extern const cc_ops_t cc_newreno;
+
+/*
+ * A window that is fixed at one segment, i.e. the original stop-and-wait
+ * behaviour of minisockets.
+ */
+extern const cc_ops_t cc_stop_and_wait;
+
+#endif /*__CONGESTION_H__*/
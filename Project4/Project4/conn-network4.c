@@ -0,0 +1,151 @@
+/*
+ *    conn-network test program 4
+ *
+ *    sends a big message to ourselves over a lossy simulated link, once
+ *    for each loss rate from 1% to 10%, and reports the throughput and
+ *    the congestion state of the sending socket after each transfer.
+ *    The link has a 10 ms one-way delay and carries 1 MB/s, so a window
+ *    of packets is in flight and a loss costs a round trip or a timeout.
+ *    The totals of all sockets are dumped at the end.
+ *
+ *    USAGE: ./conn-network4 [<congestion controller>]
+ *
+ *    where the controller is "newreno" (the default) or "stop-and-wait".
+*/
+
+#include <string.h>
+
+#include "defs.h"
+#include "minithread.h"
+#include "minisocket.h"
+#include "synch.h"
+#include "common.h"
+
+#define BUFFER_SIZE 200000
+#define MIN_LOSS_PERCENT 1
+#define MAX_LOSS_PERCENT 10
+#define LINK_DELAY_MS 10
+#define LINK_BANDWIDTH 1000000 // bytes per second
+
+// first port on which we do the communication, one port per loss rate
+int first_port=80;
+
+char buffer[BUFFER_SIZE];
+
+// the receiver closes its end after the transmitter, so that the two do not close at the same time
+semaphore_t* transmitter_closed;
+
+// forward declaration
+int receive(int* arg);
+
+int transmit(int* arg) {
+  // Fill in the buffer with numbers from 0 to BUFFER_SIZE-1
+  for (int i=0; i<BUFFER_SIZE; i++){
+    buffer[i]=(char)(i%256);
+  }
+
+  transmitter_closed = semaphore_create();
+  semaphore_initialize(transmitter_closed, 0);
+
+  for (int loss=MIN_LOSS_PERCENT; loss<=MAX_LOSS_PERCENT; loss++){
+    int port=first_port+loss;
+
+    network_sim_params_t params;
+    memset(&params, 0, sizeof(params));
+    params.loss_rate=loss/100.0;
+    params.delay_ms=LINK_DELAY_MS;
+    params.bandwidth=LINK_BANDWIDTH;
+    params.seed=loss;
+    network_simulated_link(&params);
+
+    minithread_fork(receive, &port);
+
+    minisocket_error error;
+    minisocket_t *socket = minisocket_server_create(port,&error);
+    if (socket==NULL){
+      printf("ERROR: server_create failed with error %d. Exiting. \n",error);
+      return -1;
+    }
+
+    unsigned long long start=currentTimeMicros();
+    int bytes_sent=minisocket_send(socket,buffer,BUFFER_SIZE,&error);
+    if (error!=SOCKET_NOERROR){
+      printf("ERROR: send failed with error %d after %d bytes. Exiting. \n",error,bytes_sent);
+      minisocket_close(socket);
+      return -1;
+    }
+    unsigned long long elapsed=currentTimeMicros()-start;
+
+    cc_state_t cc;
+    minisocket_get_congestion_state(socket,&cc);
+    printf("loss %2d%%: %d bytes in %llu ms (%llu KB/s), cwnd %d, ssthresh %d, %u fast retransmits, %u timeouts\n",
+	   loss, bytes_sent, elapsed/1000, bytes_sent*1000ULL/(elapsed+1),
+	   cc.cwnd, cc.ssthresh, cc.numFastRetransmits, cc.numTimeouts);
+
+    minisocket_close(socket);
+    semaphore_V(transmitter_closed);
+  }
+
+  printf("All transfers completed.\n");
+  minisocket_dump_stats(NULL);
+  return 0;
+}
+
+int receive(int* arg) {
+  static char inbuf[BUFFER_SIZE];
+  network_address_t my_address;
+  int port=*arg;
+
+  minithread_yield();
+
+  network_get_my_address(my_address);
+
+  // create a network connection to the local machine
+  minisocket_error error;
+  minisocket_t *socket = minisocket_client_create(my_address, port,&error);
+  if (socket==NULL){
+    printf("ERROR: client_create failed with error %d. Exiting. \n",error);
+    return -1;
+  }
+
+  // receive the message
+  int bytes_received=0;
+  while (bytes_received!=BUFFER_SIZE){
+    int received_bytes;
+    if ((received_bytes=minisocket_receive(socket,inbuf, BUFFER_SIZE-bytes_received, &error))==-1){
+      printf("ERROR: receive failed with error %d. Exiting. \n",error);
+      minisocket_close(socket);
+      return -1;
+    }
+
+    // test the information received
+    for (int i=0; i<received_bytes; i++){
+      if (inbuf[i]!=(char)( (bytes_received+i)%256 )){
+	printf("The %d'th byte received is wrong.\n",
+	       bytes_received+i);
+
+	minisocket_close(socket);
+	return -1;
+      }
+    }
+
+    bytes_received+=received_bytes;
+  }
+
+  semaphore_P(transmitter_closed);
+  minisocket_close(socket);
+
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "stop-and-wait") == 0)
+    minisocket_set_default_congestion_control(&cc_stop_and_wait);
+  else if (argc > 1 && strcmp(argv[1], "newreno") != 0) {
+    printf("Unknown congestion controller %s.\n", argv[1]);
+    return -1;
+  }
+
+  minithread_system_initialize(transmit, NULL);
+  return -1;
+}
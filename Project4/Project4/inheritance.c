@@ -0,0 +1,119 @@
+/* inheritance.c
+
+   Priority inheritance through chains of mutex owners. A low priority
+   thread C holds mutexes m2 and m3. D waits for m3, so C runs at D's
+   level. B holds m1 and waits for m2, and then A, at the highest priority,
+   waits for m1: B and, through B, C must run at A's level. Once C unlocks
+   m2 it must go back to D's level, which it still inherits through m3, and
+   once it unlocks m3 to its own.
+
+   USAGE: ./inheritance
+*/
+
+#include "minithread.h"
+#include "synch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WAIT_MS 10
+
+mutex_t* m1;
+mutex_t* m2;
+mutex_t* m3;
+semaphore_t* step; // V'd by a thread once it is done with a step
+semaphore_t* go;   // lets C do its next step
+
+int thread_c(int* arg) {
+  mutex_lock(m2);
+  mutex_lock(m3);
+  semaphore_V(step);
+  semaphore_P(go);
+  mutex_unlock(m2);
+  semaphore_V(step);
+  semaphore_P(go);
+  mutex_unlock(m3);
+  semaphore_V(step);
+  return 0;
+}
+
+int thread_b(int* arg) {
+  mutex_lock(m1);
+  semaphore_V(step);
+  mutex_lock(m2);
+  mutex_unlock(m2);
+  mutex_unlock(m1);
+  return 0;
+}
+
+int waiter(int* arg) {
+  mutex_t* m = (mutex_t*)arg;
+  mutex_lock(m);
+  mutex_unlock(m);
+  return 0;
+}
+
+minithread_t* start_thread(proc_t proc, arg_t arg, int priority) {
+  minithread_attr_t attrs;
+  minithread_attr_init(&attrs);
+  attrs.priority = priority;
+  attrs.joinable = 1;
+  minithread_t* t = minithread_create_with_attrs(proc, arg, &attrs);
+  minithread_start(t);
+  return t;
+}
+
+int level(minithread_t* t) {
+  minithread_stats_t stats;
+  minithread_get_stats(t, &stats);
+  return stats.level;
+}
+
+int main_thread(int* arg) {
+  int errors = 0;
+
+  m1 = mutex_create();
+  m2 = mutex_create();
+  m3 = mutex_create();
+  step = semaphore_create();
+  semaphore_initialize(step, 0);
+  go = semaphore_create();
+  semaphore_initialize(go, 0);
+
+  minithread_t* c = start_thread(thread_c, NULL, 3);
+  semaphore_P(step);
+  minithread_t* d = start_thread(waiter, (arg_t)m3, 1);
+  minithread_sleep_with_timeout(WAIT_MS); // D waits for m3
+  printf("C holds m2 and m3, D waits for m3: C at level %d.\n", level(c));
+  if (level(c) != 1) errors++;
+
+  minithread_t* b = start_thread(thread_b, NULL, 2);
+  semaphore_P(step);
+  minithread_sleep_with_timeout(WAIT_MS); // B waits for m2
+  minithread_t* a = start_thread(waiter, (arg_t)m1, 0);
+  minithread_sleep_with_timeout(WAIT_MS); // A waits for m1
+  printf("A waits for m1 held by B, which waits for m2 held by C: B at level %d, C at level %d.\n", level(b), level(c));
+  if (level(b) != 0 || level(c) != 0) errors++;
+
+  semaphore_V(go);
+  semaphore_P(step);
+  printf("C unlocked m2: C at level %d.\n", level(c));
+  if (level(c) != 1) errors++;
+
+  semaphore_V(go);
+  semaphore_P(step);
+  printf("C unlocked m3: C at level %d.\n", level(c));
+  if (level(c) != 3) errors++;
+
+  minithread_join(a, NULL);
+  minithread_join(b, NULL);
+  minithread_join(c, NULL);
+  minithread_join(d, NULL);
+  printf((errors == 0) ? "Priority inheritance works.\n" : "FAILED.\n");
+  exit(0); // the system never stops on its own
+}
+
+int main(int argc, char** argv) {
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}
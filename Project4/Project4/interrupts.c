@@ -75,11 +75,100 @@ static volatile int signal_handled = 0;
 sem_t interrupt_received_sema;
 
 /*
- * atomically sets interrupt level and returns the original
- * interrupt level
+ * Interrupts that arrive while they cannot be taken are deferred: a clock
+ * tick sets clock_pending, other interrupts are kept in a ring, oldest
+ * first. The signal handler adds to them and the minithreads take them
+ * out; both run on the same host thread, so the handler only ever
+ * interrupts the minithreads and compiler barriers suffice. Either sets
+ * interrupt_pending. They are taken wherever minithread code gets
+ * interrupts back:
+ * - set_interrupt_level(ENABLED) calls interrupt_take_pending();
+ * - minithread_switch() and the trampoline enable interrupts with a bare
+ *   store, so the minithreads call interrupt_take_pending() once a switch
+ *   returns and when a new thread starts, and take_interrupt() takes them
+ *   before returning to the trampoline. An interrupt deferred between that
+ *   and the trampoline's store waits for the next of these points;
+ * - before the handler of the next interrupt that is taken.
  */
-interrupt_level_t set_interrupt_level(interrupt_level_t newlevel) {
-    return swap(&interrupt_level, newlevel);
+#define DEFERRED_INTERRUPTS 64
+
+volatile int interrupt_pending = 0;
+static volatile int clock_pending = 0;
+static interrupt_t deferred[DEFERRED_INTERRUPTS];
+static volatile unsigned int deferred_head = 0;  /* # of interrupts ever taken out */
+static volatile unsigned int deferred_tail = 0;  /* # of interrupts ever deferred */
+
+/*
+ * Defer an interrupt, from the signal handler. Returns 0 if the ring is
+ * full, in which case the sender retries.
+ */
+static int
+defer_interrupt(interrupt_t *interrupt) {
+    if (deferred_tail - deferred_head == DEFERRED_INTERRUPTS)
+        return 0;
+    deferred[deferred_tail % DEFERRED_INTERRUPTS] = *interrupt;
+    __asm__ __volatile__("" ::: "memory");
+    deferred_tail++;
+    interrupt_pending = 1;
+    return 1;
+}
+
+/*
+ * Run the handlers of the deferred interrupts, with interrupts disabled.
+ */
+static void
+take_deferred() {
+    while (deferred_head != deferred_tail) {
+        interrupt_t interrupt = deferred[deferred_head % DEFERRED_INTERRUPTS];
+        __asm__ __volatile__("" ::: "memory");
+        deferred_head++;
+        interrupt.handler(interrupt.arg);
+    }
+}
+
+/*
+ * Run the handlers of the pending interrupts once, with interrupts
+ * disabled. The clock handler may switch to another thread, which comes
+ * back with interrupts enabled.
+ */
+static void
+take_pending() {
+    interrupt_pending = 0;
+    take_deferred();
+    if (clock_pending && mini_clock_handler != NULL) {
+        clock_pending = 0;
+        mini_clock_handler(NULL);
+    }
+}
+
+/*
+ * Where a taken interrupt starts, on the interrupted thread's stack with
+ * interrupts disabled: the deferred interrupts come first, so that they
+ * wait at most until the next interrupt is taken. The ones deferred while
+ * the handler ran are taken before the trampoline enables interrupts.
+ */
+static void
+take_interrupt(void *arg, interrupt_handler_t handler) {
+    take_deferred();
+    handler(arg);
+    while (interrupt_pending) {
+        interrupt_level = DISABLED;
+        take_pending();
+    }
+}
+
+/*
+ * Take the pending interrupts, with interrupts enabled: call the handlers
+ * as the trampoline would, and enable interrupts again once they return,
+ * as the trampoline does.
+ */
+void
+interrupt_take_pending() {
+    while (interrupt_pending && interrupt_level == ENABLED) {
+        interrupt_level = DISABLED;
+        take_pending();
+        interrupt_level = ENABLED;
+    }
 }
 
 
@@ -185,6 +274,10 @@ handle_interrupt(int sig, siginfo_t *si, ucontext_t *ucontext)
         if(ucontext->uc_mcontext.fpregs!=0){
             newsp -= sizeof(struct _fpstate)/sizeof(long);
             memcpy(newsp,ucontext->uc_mcontext.fpregs,sizeof(struct _fpstate));
+            /* only the legacy area is copied: clear the software bytes
+               (the last 48) so that sigreturn does not look for extended
+               state past it, which faults at the top of a mapped stack */
+            memset(&((struct _fpstate *)newsp)->__glibc_reserved1[12], 0, 12 * sizeof(__uint32_t));
             ucontext->uc_mcontext.fpregs = (void *)newsp;
         }
 
@@ -201,14 +294,17 @@ handle_interrupt(int sig, siginfo_t *si, ucontext_t *ucontext)
          */
         if(sig==SIGRTMAX-2){
             ucontext->uc_mcontext.gregs[RSP]=(unsigned long)newsp;
-            ucontext->uc_mcontext.gregs[RIP]=(unsigned long)((interrupt_t*)si->si_value.sival_ptr)->handler;
+            ucontext->uc_mcontext.gregs[RIP]=(unsigned long)take_interrupt;
             ucontext->uc_mcontext.gregs[RDI]=(unsigned long)((interrupt_t*)si->si_value.sival_ptr)->arg;
+            ucontext->uc_mcontext.gregs[RSI]=(unsigned long)((interrupt_t*)si->si_value.sival_ptr)->handler;
             set_interrupt_level(DISABLED);
         }
         else if(sig==SIGRTMAX-1){
             ucontext->uc_mcontext.gregs[RSP]=(unsigned long)newsp;
-            ucontext->uc_mcontext.gregs[RIP]=(unsigned long)mini_clock_handler;
+            ucontext->uc_mcontext.gregs[RIP]=(unsigned long)take_interrupt;
             ucontext->uc_mcontext.gregs[RDI]=(unsigned long)0;
+            ucontext->uc_mcontext.gregs[RSI]=(unsigned long)mini_clock_handler;
+            set_interrupt_level(DISABLED);
             if(DEBUG)
                 printf("SP=%p\n",newsp);
         }
@@ -220,6 +316,14 @@ handle_interrupt(int sig, siginfo_t *si, ucontext_t *ucontext)
         if(sig==SIGRTMAX-2)
             signal_handled = 1;
     }
+    else if(sig==SIGRTMAX-1){
+        clock_pending = 1;
+        interrupt_pending = 1;
+    }
+    else if(sig==SIGRTMAX-2){
+        if(defer_interrupt((interrupt_t*)si->si_value.sival_ptr))
+            signal_handled = 1;
+    }
 
     if(sig==SIGRTMAX-2){
         if(DEBUG)
@@ -251,12 +355,12 @@ void send_interrupt(int interrupt_type, interrupt_handler_t handler, void* arg){
         /* semaphore_P to wait for main thread signal */
         sem_wait(&interrupt_received_sema);
 
-        /* Check if interrupt was handled */
+        /* Check if interrupt was handled or deferred */
         if(signal_handled)
             break;
 
         sleep(0);
-        /* resend if necessary */
+        /* resend if the deferred interrupts are full */
     }
     pthread_mutex_unlock(&signal_mutex);
 }
@@ -12,9 +12,10 @@
  * Interrupts are disabled when running code that is not part of the
  * minithreads package (e.g. printf or gettimeofday), or if they are explicitly
  * disabled (see set_interrupt_level below).  Any interrupts that occur while
- * interrupts are disabled will be dropped.  Thus if you want to reliably
- * receive interrupts, you must avoid spending a large portion of time with
- * interrupts disabled.
+ * interrupts are disabled will be delayed: a clock tick is taken when
+ * interrupts are next enabled, other interrupts are retried.  Thus if you
+ * want to receive interrupts on time, you must avoid spending a large
+ * portion of time with interrupts disabled.
  *
  * YOU SHOULD NOT [NEED TO] MODIFY THIS FILE.
  */
@@ -51,9 +52,9 @@
  * to minithread_switch: the minithread switch code resets the interrupt
  * level to ENABLED itself.
  *
- * Interrupts that occur while interrupts are disabled are dropped, so you
+ * Interrupts that occur while interrupts are disabled are delayed, so you
  * should minimize the amount of time interrupts are disabled in order to
- * reduce the number of dropped interrupts.
+ * keep them on time.
  */
 
 typedef int interrupt_level_t;
@@ -62,13 +63,41 @@ extern interrupt_level_t interrupt_level;
 #define DISABLED 0
 #define ENABLED 1
 
-extern interrupt_level_t set_interrupt_level(interrupt_level_t newlevel);
+/*
+ * A clock tick that could not be taken, because interrupts were disabled or
+ * the processor was outside the minithreads package, is kept pending and
+ * taken as soon as interrupts are enabled again: the tick is not lost, it
+ * just comes late.
+ *
+ * Setting the level is a plain load and store: interrupts come from a
+ * signal to the same host thread, so no atomic instruction or memory fence
+ * is needed, only compiler barriers to keep the protected code in between.
+ * An interrupt taken between the load and the store returns with the level
+ * it found, so the old level read stays right.
+ *
+ * interrupt_take_pending() takes the pending interrupts if interrupts are
+ * enabled. Code that enables interrupts other than through
+ * set_interrupt_level(), such as a context switch, calls it afterwards.
+ */
+extern volatile int interrupt_pending;
+extern void interrupt_take_pending();
+
+static inline interrupt_level_t set_interrupt_level(interrupt_level_t newlevel) {
+    interrupt_level_t oldlevel = interrupt_level;
+    __asm__ __volatile__("" ::: "memory");
+    interrupt_level = newlevel;
+    __asm__ __volatile__("" ::: "memory");
+    if (newlevel == ENABLED && interrupt_pending)
+        interrupt_take_pending();
+    return oldlevel;
+}
 
 
 /*
  * minithread_clock_init(h,period)
  *     installs a clock interrupt service routine h.  h will be called every
- *     [period] nanoseconds.  interrupts are disabled after
+ *     [period] nanoseconds of processor time used by the host thread, so a
+ *     blocked host thread takes no ticks.  interrupts are disabled after
  *     minithread_clock_init finishes.  After you enable interrupts then your
  *     handler will be called automatically on every clock tick.
  */
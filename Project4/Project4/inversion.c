@@ -0,0 +1,87 @@
+/* inversion.c
+
+   Priority inversion with a mutex: a thread that computed long enough to
+   sink to the lowest MLFQ level locks a mutex and keeps computing while
+   holding it. An interactive thread then wants the mutex, while batch
+   threads keep the processor busy. With priority inheritance the owner
+   runs at the interactive thread's level until it unlocks, so the
+   interactive thread waits about as long as the critical section takes,
+   not for the batch threads to let the lowest level run.
+
+   USAGE: ./inversion
+*/
+
+#include "minithread.h"
+#include "synch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_BATCH 4
+#define WARMUP_TICKS 7
+#define CRITICAL_TICKS 3
+#define ROUNDS 5
+
+mutex_t* lock;
+semaphore_t* locked;
+volatile int stop = 0;
+
+// computes until the calling thread has been charged ticks more clock ticks
+void compute(unsigned long long ticks) {
+  minithread_stats_t stats;
+  minithread_get_stats(NULL, &stats);
+  unsigned long long until = stats.ticksRun + ticks;
+  do {
+    minithread_get_stats(NULL, &stats);
+  } while (stats.ticksRun < until);
+}
+
+int batch(int* arg) {
+  while (!stop) ;
+  return 0;
+}
+
+int owner(int* arg) {
+  minithread_stats_t stats;
+
+  compute(WARMUP_TICKS);
+  for (int i = 0; i < ROUNDS; i++) {
+    mutex_lock(lock);
+    semaphore_V(locked);
+    minithread_get_stats(NULL, &stats);
+    printf("owner locked at level %d\n", stats.level);
+    compute(CRITICAL_TICKS);
+    mutex_unlock(lock);
+    minithread_yield();
+  }
+  return 0;
+}
+
+int interactive(int* arg) {
+  for (int i = 0; i < ROUNDS; i++) {
+    semaphore_P(locked); // the owner holds the lock now
+    unsigned long long start = currentTimeMillis();
+    mutex_lock(lock);
+    printf("interactive thread waited %llu ms for the lock\n", currentTimeMillis() - start);
+    mutex_unlock(lock);
+  }
+  stop = 1;
+  printf("Done.\n");
+  exit(0);
+}
+
+int main_thread(int* arg) {
+  lock = mutex_create();
+  locked = semaphore_create();
+  semaphore_initialize(locked, 0);
+
+  minithread_fork(owner, NULL);
+  minithread_fork(interactive, NULL);
+  for (int i = 0; i < NUM_BATCH; i++) minithread_fork(batch, NULL);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}
@@ -0,0 +1,91 @@
+/* join.c
+
+   Joining and detaching threads. A thread forks joinable workers that
+   return a value each, and joins them in the reverse order, so that most
+   finish before they are joined and the last ones are still running. A
+   worker that is detached before it finishes, one detached after it
+   finished, and one that detaches itself are never joined. Joining a
+   detached thread, the caller, or a thread that is already being joined
+   must fail. Finished threads are reused, so the control blocks of the
+   workers come back for the threads forked later.
+
+   USAGE: ./join
+*/
+
+#include "minithread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_WORKERS 10
+
+int errors = 0;
+
+int worker(int* arg) {
+  int n = *arg;
+  for (int i = 0; i < n; i++) minithread_yield(); // worker n finishes after about n yields
+  return n * n;
+}
+
+int self_detacher(int* arg) {
+  if (minithread_detach(NULL) != 0) errors++;
+  return 0;
+}
+
+int joiner(int* arg) {
+  minithread_t* t = (minithread_t*)arg;
+  int result;
+  if (minithread_join(t, &result) != 0 || result != 25) errors++;
+  return 0;
+}
+
+int main_thread(int* arg) {
+  static int n[NUM_WORKERS];
+  minithread_t* workers[NUM_WORKERS];
+  for (int i = 0; i < NUM_WORKERS; i++) {
+    n[i] = i;
+    workers[i] = minithread_fork_joinable(worker, &n[i]);
+  }
+
+  for (int i = NUM_WORKERS - 1; i >= 0; i--) {
+    int result = -1;
+    if (minithread_join(workers[i], &result) != 0 || result != i * i) {
+      printf("ERROR: joining worker %d returned %d.\n", i, result);
+      errors++;
+    }
+  }
+  if (minithread_join(minithread_self(), NULL) != -1) errors++;
+
+  // detached before and after finishing, and by itself
+  minithread_t* t = minithread_fork_joinable(worker, &n[5]);
+  if (minithread_detach(t) != 0 || minithread_detach(t) != -1 || minithread_join(t, NULL) != -1) errors++;
+  t = minithread_fork_joinable(worker, &n[0]);
+  minithread_yield();
+  minithread_yield();
+  if (minithread_detach(t) != 0) errors++;
+  minithread_fork_joinable(self_detacher, NULL);
+
+  // a second joiner must be turned away while the first one waits
+  t = minithread_fork_joinable(worker, &n[5]);
+  minithread_t* first = minithread_fork_joinable(joiner, (int*)t);
+  minithread_yield();
+  if (minithread_join(t, NULL) != -1) errors++;
+  minithread_join(first, NULL);
+
+  // the control blocks of finished threads are reused
+  int reused = 0;
+  for (int i = 0; i < NUM_WORKERS; i++) {
+    minithread_t* u = minithread_fork_joinable(worker, &n[0]);
+    for (int j = 0; j < NUM_WORKERS; j++) if (u == workers[j]) reused++;
+    minithread_join(u, NULL);
+  }
+
+  printf("%d errors, %d of %d threads reused a finished worker.\n", errors, reused, NUM_WORKERS);
+  printf((errors == 0 && reused > 0) ? "Join and detach work.\n" : "FAILED.\n");
+  exit(0); // the system never stops on its own
+}
+
+int main(int argc, char** argv) {
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}
@@ -12,6 +12,7 @@
 #include "minithread.h"
 #include "machineprimitives.h"
 #include <sys/mman.h>
+#include <unistd.h>
 
 /*
  * Used to initialize a thread's stack for the first context switch
@@ -49,13 +50,78 @@ struct initial_stack_state
 #define STACKSIZE               (256 * 1024)
 #define STACKALIGN              0xf
 
+static size_t stack_size = STACKSIZE;   /* bytes of each new stack */
+static int stack_guard = 0;             /* whether stacks are mapped with a guard page */
+
+static size_t
+page_size()
+{
+    static size_t size = 0;
+    if (size == 0)
+      size = (size_t) sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+/*
+ * The bytes actually reserved for a stack of size bytes: mapped stacks
+ * are whole pages.
+ */
+static size_t
+reserved_size(size_t size)
+{
+    size_t page = page_size();
+    return stack_guard ? (size + page - 1) & ~(page - 1) : size;
+}
+
+int
+minithread_set_stack_options(size_t size, int guard)
+{
+    size_t page = page_size();
+
+    if (size < page)
+      return -1;
+
+    stack_guard = guard;
+    stack_size = reserved_size(size);
+    return 0;
+}
+
 /*
  * Allocate a new stack.
  */
 void
 minithread_allocate_stack(stack_pointer_t *stackbase, stack_pointer_t *stacktop)
 {
-    *stackbase = (stack_pointer_t) malloc(STACKSIZE);
+    minithread_allocate_stack_of_size(stack_size, stackbase, stacktop);
+}
+
+void
+minithread_allocate_stack_of_size(size_t size, stack_pointer_t *stackbase, stack_pointer_t *stacktop)
+{
+    if (size < page_size()) {
+      *stackbase = NULL;
+      return;
+    }
+    size = reserved_size(size);
+    if (stack_guard) {
+      /* Reserve the stack and a guard page below it. Pages only take
+         memory once touched, and touching the guard page faults. */
+      size_t page = page_size();
+      char *region = mmap(NULL, page + size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (region == MAP_FAILED) {
+        *stackbase = NULL;
+        return;
+      }
+      if (mprotect(region, page, PROT_NONE) != 0) {
+        munmap(region, page + size);
+        *stackbase = NULL;
+        return;
+      }
+      *stackbase = (stack_pointer_t) (region + page);
+    }
+    else
+      *stackbase = (stack_pointer_t) malloc(size);
     if (!*stackbase)  {
         return;
     }
@@ -63,7 +129,7 @@ minithread_allocate_stack(stack_pointer_t *stackbase, stack_pointer_t *stacktop)
     if (STACK_GROWS_DOWN)
       /* Stacks grow down, but malloc grows up. Compensate and word align
          (turn off low 2 bits by anding with ~3). */
-      *stacktop = (stack_pointer_t) ((long)((char*)*stackbase + STACKSIZE - 1) & ~STACKALIGN);
+      *stacktop = (stack_pointer_t) ((long)((char*)*stackbase + size - 1) & ~STACKALIGN);
     else {
       /* Word align (turn off low 2 bits by anding with ~3) */
       *stacktop = (stack_pointer_t)(((long)*stackbase + 3)&~STACKALIGN);
@@ -78,7 +144,63 @@ minithread_allocate_stack(stack_pointer_t *stackbase, stack_pointer_t *stacktop)
 void
 minithread_free_stack(stack_pointer_t stackbase)
 {
-    free(stackbase);
+    minithread_free_stack_of_size(stackbase, stack_size);
+}
+
+void
+minithread_free_stack_of_size(stack_pointer_t stackbase, size_t size)
+{
+    if (stack_guard) {
+      if (stackbase != NULL)
+        munmap((char *) stackbase - page_size(), page_size() + reserved_size(size));
+    }
+    else
+      free(stackbase);
+}
+
+/*
+ * Count the resident pages of a stack.
+ */
+size_t
+minithread_stack_used(stack_pointer_t stackbase)
+{
+    return minithread_stack_used_of_size(stackbase, stack_size);
+}
+
+size_t
+minithread_stack_used_of_size(stack_pointer_t stackbase, size_t size)
+{
+    size_t page = page_size();
+    size_t reserved = reserved_size(size);
+    uintptr_t first = (uintptr_t) stackbase & ~(page - 1);
+    uintptr_t end = ((uintptr_t) stackbase + reserved + page - 1) & ~(page - 1);
+    size_t pages = (end - first) / page;
+    unsigned char resident[pages];
+    size_t used = 0;
+    size_t i;
+
+    if (mincore((void *) first, end - first, resident) != 0)
+      return 0;
+    for (i = 0; i < pages; i++)
+      if (resident[i] & 1)
+        used += page;
+    return (used > reserved) ? reserved : used;
+}
+
+size_t
+minithread_stack_size()
+{
+    return stack_size;
+}
+
+int
+minithread_stack_overflowed(stack_pointer_t stackbase, void *address)
+{
+    /* A frame larger than the guard page may skip over it, count a few
+       pages below as well. */
+    return stack_guard && stackbase != NULL
+      && (char *) address < (char *) stackbase
+      && (char *) address >= (char *) stackbase - 16 * page_size();
 }
 
 /*
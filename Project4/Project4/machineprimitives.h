@@ -46,6 +46,53 @@ extern void minithread_allocate_stack(stack_pointer_t *stackbase,
  */
 extern void minithread_free_stack(stack_pointer_t stackbase);
 
+/*
+ * minithread_set_stack_options(size_t size, int guard)
+ *
+ * Make the stacks allocated from now on size bytes. If guard is nonzero,
+ * each stack is mapped on its own with an inaccessible guard page below it,
+ * so that overflowing the stack faults instead of overwriting other memory,
+ * and is returned to the system when freed. Either way a stack only takes
+ * memory as its pages are first touched. Must not be called while stacks
+ * of the previous options are still allocated. Returns 0 on success, -1 if
+ * size is smaller than a page.
+ *
+ * size_t minithread_stack_size()
+ *
+ * The size of the stacks.
+ *
+ * size_t minithread_stack_used(stack_pointer_t stackbase)
+ *
+ * The bytes of the stack at stackbase in memory, i.e. its high-water mark
+ * in whole pages since it was allocated. It may include a page shared with
+ * other data unless stacks have guard pages.
+ *
+ * int minithread_stack_overflowed(stack_pointer_t stackbase, void *address)
+ *
+ * Whether a fault at address is an overflow of the stack at stackbase,
+ * which can only be told with guard pages.
+ */
+extern int minithread_set_stack_options(size_t size, int guard);
+extern size_t minithread_stack_size();
+extern size_t minithread_stack_used(stack_pointer_t stackbase);
+extern int minithread_stack_overflowed(stack_pointer_t stackbase, void *address);
+
+/*
+ * minithread_allocate_stack_of_size(size_t size, stack_pointer_t *stackbase,
+ *                                   stack_pointer_t *stacktop)
+ * minithread_free_stack_of_size(stack_pointer_t stackbase, size_t size)
+ * size_t minithread_stack_used_of_size(stack_pointer_t stackbase, size_t size)
+ *
+ * Like minithread_allocate_stack(), minithread_free_stack() and
+ * minithread_stack_used() for a stack of size bytes instead of the size of
+ * the stacks. A stack is freed and measured with the size it was allocated
+ * with. *stackbase is NULL if size is smaller than a page.
+ */
+extern void minithread_allocate_stack_of_size(size_t size, stack_pointer_t *stackbase,
+                                              stack_pointer_t *stacktop);
+extern void minithread_free_stack_of_size(stack_pointer_t stackbase, size_t size);
+extern size_t minithread_stack_used_of_size(stack_pointer_t stackbase, size_t size);
+
 /*
  *  Initialize the stackframe pointed to by *stacktop so that
  *  the thread running off of *stacktop will invoke:
@@ -121,6 +168,13 @@ extern int compare_and_swap(int* x, int oldval, int newval);
  */
 uint64_t currentTimeMillis();
 
+/*
+ * Returns the time in microseconds since an arbitrary fixed point in the
+ *    past. The clock is monotonic and cheap to read, which makes it suitable
+ *    for timestamping frequent events such as context switches.
+ */
+uint64_t currentTimeMicros();
+
 
 #endif /*__MINITHREAD_PUBLIC_H_*/
 
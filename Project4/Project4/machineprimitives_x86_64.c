@@ -7,7 +7,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>     // included for currentTimeMillis
-#include <sys/timeb.h>
 
 #include "defs.h"
 #include "interrupts.h"
@@ -15,13 +14,15 @@
 #include "minithread.h"
 
 uint64_t currentTimeMillis() {
-  struct timeb timebuffer;
-  uint64_t lt = 0;
-  ftime(&timebuffer);
-  lt = timebuffer.time;
-  lt = lt*1000;
-  lt = lt+timebuffer.millitm;
-  return lt;
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+uint64_t currentTimeMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
 }
 
 
@@ -11,6 +11,8 @@
 #include "defs.h"
 #include "interrupts.h"
 #include "miniheader.h"
+#include "common.h"
+#include "portos_stats.h"
 
 // ---- Constants ---- //
 #define BOUNDED_PORT_START		32768	/* The beginning port number for bounded port */
@@ -21,10 +23,12 @@
 // ---- Global Variables ---- //
 int g_boundPortCounter = -1; //for incrementally assigning bounded ports
 bool g_boundedPortAvail[BOUNDED_PORT_END - BOUNDED_PORT_START + 1]; //track availability of bounded ports once g_boundPortCounter goes above max value
-semaphore_t* g_semaBoundLock = NULL; // used as mutex to protect access to g_boundPortCounter & g_boundedPortAvail
+mutex_t* g_boundLock = NULL; // protects access to g_boundPortCounter & g_boundedPortAvail
 
 miniport_t* g_unboundedPortPtrs[UNBOUNDED_PORT_END - UNBOUNDED_PORT_START + 1]; //tracks the pointers to all of our unbounded ports
-semaphore_t* g_semaUnboundLock = NULL; // used as mutex to protect modification to g_unboundedPortPtrs
+mutex_t* g_unboundLock = NULL; // protects modification to g_unboundedPortPtrs
+
+miniport_stats_t g_portTotals; //counters of all miniports together, only updated with interrupts disabled
 
 struct miniport
 {
@@ -41,18 +45,43 @@ struct miniport
 			int remote_unbound_port;
 		} bound_port;
 	};
+
+	miniport_stats_t stats; //counters, only updated with interrupts disabled
 };
 
+//adds n to a counter of the miniport and to the global total. Interrupts must be disabled.
+#define PORT_STATS_ADD(miniport, counter, n)	\
+	do {										\
+		(miniport)->stats.counter += (n);		\
+		g_portTotals.counter += (n);			\
+	} while (0)
+
+//counts a datagram of len payload bytes sent from local_unbound_port
+static void
+count_sent_datagram(miniport_t* local_unbound_port, int len)
+{
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	PORT_STATS_ADD(local_unbound_port, packets_sent, 1);
+	PORT_STATS_ADD(local_unbound_port, bytes_sent, len);
+	set_interrupt_level(old_level);
+}
+
 void
 minimsg_initialize()
 {
 	g_boundPortCounter = BOUNDED_PORT_START; //bounded ports range from 32768 - 65535
 	memset(g_boundedPortAvail, 1, sizeof(g_boundedPortAvail)); //initialize array element to true, every port is avail when we initialize
 	memset(g_unboundedPortPtrs, 0, sizeof(g_unboundedPortPtrs)); //set array of unbounded port pointers to null
-	g_semaBoundLock = semaphore_create(); AbortOnCondition(g_semaBoundLock == NULL, "g_semaBoundLock failed in minimsg_initialize()");
-	g_semaUnboundLock = semaphore_create(); AbortOnCondition(g_semaUnboundLock == NULL, "g_semaUnboundLock failed in minimsg_initialize()");
-	semaphore_initialize(g_semaBoundLock, 1); //init sema to 1 (available).
-	semaphore_initialize(g_semaUnboundLock, 1); //init sema to 1 (available).
+	g_boundLock = mutex_create(); AbortOnCondition(g_boundLock == NULL, "g_boundLock failed in minimsg_initialize()");
+	g_unboundLock = mutex_create(); AbortOnCondition(g_unboundLock == NULL, "g_unboundLock failed in minimsg_initialize()");
+
+	//export the totals
+	portos_stats_register("minimsg", "packets_sent", PORTOS_STAT_COUNTER, portos_stats_read_uint, &g_portTotals.packets_sent);
+	portos_stats_register("minimsg", "bytes_sent", PORTOS_STAT_COUNTER, portos_stats_read_ull, &g_portTotals.bytes_sent);
+	portos_stats_register("minimsg", "packets_received", PORTOS_STAT_COUNTER, portos_stats_read_uint, &g_portTotals.packets_received);
+	portos_stats_register("minimsg", "bytes_received", PORTOS_STAT_COUNTER, portos_stats_read_ull, &g_portTotals.bytes_received);
+	portos_stats_register("minimsg", "packets_dropped", PORTOS_STAT_COUNTER, portos_stats_read_uint, &g_portTotals.packets_dropped);
+	portos_stats_register("minimsg", "queue_depth", PORTOS_STAT_GAUGE, portos_stats_read_uint, &g_portTotals.queue_depth);
 }
 
 miniport_t*
@@ -63,24 +92,25 @@ miniport_create_unbound(int port_number)
 	//ensure that port_number is valid
 	if (port_number < UNBOUNDED_PORT_START || port_number > UNBOUNDED_PORT_END) return NULL;
 
-	semaphore_P(g_semaUnboundLock); //critical section to modify global g_unboundedPortPtrs
+	mutex_lock(g_unboundLock); //critical section to modify global g_unboundedPortPtrs
 	if (g_unboundedPortPtrs[port_number] == NULL) { //if the unbounded port has not been created, if it has been created, skip this and return reference
 	//if not, we must create the unbounded port
 		miniport_t* u_miniport = malloc(sizeof(miniport_t));
 		if (u_miniport == NULL) //malloc errored
 		{
-			semaphore_V(g_semaUnboundLock);
+			mutex_unlock(g_unboundLock);
 			return NULL;
 		}
 		u_miniport->port_number = port_number;
 		u_miniport->port_type = 'u';
+		memset(&u_miniport->stats, 0, sizeof(miniport_stats_t));
 
 		//create necessary semaphore and queue for unbounded miniport
 		u_miniport->unbound_port.datagrams_ready = semaphore_create();
 		if (u_miniport->unbound_port.datagrams_ready == NULL) //error creating our sema
 		{
 			free(u_miniport); //free newly allocated space for miniport
-			semaphore_V(g_semaUnboundLock);
+			mutex_unlock(g_unboundLock);
 			return NULL;
 		}
 
@@ -89,7 +119,7 @@ miniport_create_unbound(int port_number)
 		{
 			semaphore_destroy(u_miniport->unbound_port.datagrams_ready); //free newly allocated space for sema
 			free(u_miniport); //free newly allocated space for miniport
-			semaphore_V(g_semaUnboundLock);
+			mutex_unlock(g_unboundLock);
 			return NULL;
 		}
 
@@ -97,7 +127,7 @@ miniport_create_unbound(int port_number)
 		g_unboundedPortPtrs[port_number] = u_miniport; //update our array of pointers for our unbounded ports
 	}
 
-	semaphore_V(g_semaUnboundLock); //end of critical session
+	mutex_unlock(g_unboundLock); //end of critical session
     return g_unboundedPortPtrs[port_number];
 }
 
@@ -113,10 +143,11 @@ miniport_create_bound(const network_address_t addr, int remote_unbound_port_numb
 	if (b_miniport == NULL) return NULL; //malloc errored
 
 	b_miniport->port_type = 'b'; //set miniport type to bounded
+	memset(&b_miniport->stats, 0, sizeof(miniport_stats_t));
 	b_miniport->bound_port.remote_unbound_port = remote_unbound_port_number;
 	network_address_copy(addr, b_miniport->bound_port.remote_addr);
 
-	semaphore_P(g_semaBoundLock); //critical section to access global variables g_boundPortCounter & g_boundedPortAvail
+	mutex_lock(g_boundLock); //critical section to access global variables g_boundPortCounter & g_boundedPortAvail
 	if (g_boundPortCounter > BOUNDED_PORT_END) //if we've reached the end of our port space, we need to search for an available port number
 	{
 		int k = 0;
@@ -139,7 +170,7 @@ miniport_create_bound(const network_address_t addr, int remote_unbound_port_numb
 		g_boundPortCounter++; //increment counter
 	}
 
-	semaphore_V(g_semaBoundLock); //end of critical section
+	mutex_unlock(g_boundLock); //end of critical section
 
 	return b_miniport;
 }
@@ -159,9 +190,9 @@ miniport_destroy(miniport_t* miniport)
 			&& miniport->port_number >= UNBOUNDED_PORT_START && miniport->port_number <= UNBOUNDED_PORT_END); //self check
 
 		//update our global array of unbounded ports first
-		semaphore_P(g_semaUnboundLock); // critical session
+		mutex_lock(g_unboundLock); // critical session
 		g_unboundedPortPtrs[miniport->port_number] = NULL;
-		semaphore_V(g_semaUnboundLock); //end of critical session
+		mutex_unlock(g_unboundLock); //end of critical session
 
 		//free our queue
 		int queueFreeSuccess = queue_free_nodes_and_queue(miniport->unbound_port.incoming_data, free_network_arg);
@@ -173,9 +204,9 @@ miniport_destroy(miniport_t* miniport)
 	else //if bounded port
 	{
 		assert(miniport->port_number >= BOUNDED_PORT_START && miniport->port_number <= BOUNDED_PORT_END);
-		semaphore_P(g_semaBoundLock); //begin critical section
+		mutex_lock(g_boundLock); //begin critical section
 		g_boundedPortAvail[miniport->port_number - BOUNDED_PORT_START] = true; //set the avail of our bounded port to true
-		semaphore_V(g_semaBoundLock); //end critical section
+		mutex_unlock(g_boundLock); //end critical section
 	}
 
 	free(miniport);
@@ -203,7 +234,37 @@ minimsg_send(miniport_t* local_unbound_port, const miniport_t* local_bound_port,
 	int sentBytes = network_send_pkt(local_bound_port->bound_port.remote_addr, sizeof(header), (char*)&header, len, msg);
 
 	if (sentBytes == -1) return -1; //we failed to send our message
-	else return sentBytes - sizeof(header); //else return size of our message not inclusive of header
+	count_sent_datagram(local_unbound_port, len);
+	return sentBytes - sizeof(header); //return size of our message not inclusive of header
+}
+
+int
+minimsg_broadcast(miniport_t* local_unbound_port, int remote_unbound_port_number, const char* msg, int len)
+{
+	assert(g_boundPortCounter >= 0); //sanity check to ensure minimsg_initialize() has been called first
+
+	//validate input
+	if (local_unbound_port == NULL || local_unbound_port->port_type != 'u' || msg == NULL || len < 0 || len > MINIMSG_MAX_MSG_SIZE
+		|| remote_unbound_port_number < UNBOUNDED_PORT_START || remote_unbound_port_number > UNBOUNDED_PORT_END) return -1;
+
+	//generate the header once, it is shared by every neighbour
+	mini_header_t header;
+	header.protocol = PROTOCOL_MINIDATAGRAM; //set protocol type
+	network_address_t my_address;
+	network_get_my_address(my_address);
+	pack_address(header.source_address, my_address);
+	pack_unsigned_short(header.source_port, (unsigned short)local_unbound_port->port_number);
+	network_address_t bcast_address;
+	network_address_blankify(bcast_address); //there is no single destination host
+	pack_address(header.destination_address, bcast_address);
+	pack_unsigned_short(header.destination_port, (unsigned short)remote_unbound_port_number);
+
+	//fan the message out to all neighbours
+	int sentBytes = network_bcast_pkt(sizeof(header), (char*)&header, len, msg);
+
+	if (sentBytes == -1) return -1; //we failed to send our message
+	count_sent_datagram(local_unbound_port, len);
+	return sentBytes - sizeof(header); //return size of our message not inclusive of header
 }
 
 int
@@ -238,7 +299,7 @@ minimsg_receive(miniport_t* local_unbound_port, miniport_t** new_local_bound_por
 	assert(sourcePort >= UNBOUNDED_PORT_START && sourcePort <= UNBOUNDED_PORT_END); //make sure source port num is valid
 	network_address_t remoteAddr;
 	unpack_address(receivedHeaderPtr->source_address, remoteAddr);	// get source's network address
-	free(dequeuedPacket); // release the memory allocated to the packet
+	network_free_pkt(dequeuedPacket); // release the memory allocated to the packet
 
 	*new_local_bound_port = miniport_create_bound(remoteAddr, sourcePort);	// create a bound port
 	if (*new_local_bound_port == NULL) return -1;
@@ -246,6 +307,49 @@ minimsg_receive(miniport_t* local_unbound_port, miniport_t** new_local_bound_por
     return *len; //return data payload bytes received not inclusive of header
 }
 
+int
+miniport_get_stats(miniport_t* miniport, miniport_stats_t* stats)
+{
+	if (miniport == NULL || stats == NULL) return -1;
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //the network handler updates the counters
+	memcpy(stats, &miniport->stats, sizeof(miniport_stats_t));
+	stats->queue_depth = (miniport->port_type == 'u') ? queue_length(miniport->unbound_port.incoming_data) : 0;
+	set_interrupt_level(old_level);
+
+	return 0;
+}
+
+void
+minimsg_get_global_stats(miniport_stats_t* stats)
+{
+	AbortOnCondition(stats == NULL, "Null argument stats in minimsg_get_global_stats()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	memcpy(stats, &g_portTotals, sizeof(miniport_stats_t));
+	stats->queue_depth = 0;
+	int k;
+	for (k = UNBOUNDED_PORT_START; k <= UNBOUNDED_PORT_END; k++) { //sum up the queues of all unbound ports
+		if (g_unboundedPortPtrs[k] != NULL) stats->queue_depth += queue_length(g_unboundedPortPtrs[k]->unbound_port.incoming_data);
+	}
+	set_interrupt_level(old_level);
+}
+
+void
+minimsg_dump_stats(miniport_t* miniport)
+{
+	miniport_stats_t stats;
+	if (miniport == NULL) minimsg_get_global_stats(&stats);
+	else miniport_get_stats(miniport, &stats);
+
+	printf("!$STAT: #npktsent:     %u\n", stats.packets_sent);
+	printf("!$STAT: #npktrecv:     %u\n", stats.packets_received);
+	printf("!$STAT: #npktdrop:     %u\n", stats.packets_dropped);
+	printf("!$STAT: #nbytesent:    %llu\n", stats.bytes_sent);
+	printf("!$STAT: #nbyterecv:    %llu\n", stats.bytes_received);
+	printf("!$STAT: #queuedepth:   %u\n", stats.queue_depth);
+}
+
 /* Network handler handles being interrupted when a packet arrives. It will create the unbounded listening port
 *  if it has not been created already. It will then enqueue the packet and V the count semaphore and wake up
 *  a waiting thread if any. Our common network handler which calls this has already disabled interrupts for us.
@@ -260,7 +364,8 @@ minimsg_network_handler(network_interrupt_arg_t* arg)
 	//if dest port is invalid or the unbounded port has not been initialized, throw away the packet
 	if (destPort < UNBOUNDED_PORT_START || destPort > UNBOUNDED_PORT_END || g_unboundedPortPtrs[destPort] == NULL)
 	{
-		free(arg);
+		g_portTotals.packets_dropped++;
+		network_free_pkt(arg);
 		return;
 	}
 
@@ -269,6 +374,8 @@ minimsg_network_handler(network_interrupt_arg_t* arg)
 		&& g_unboundedPortPtrs[destPort]->unbound_port.incoming_data != NULL); 
 	int appendSuccess = queue_append(g_unboundedPortPtrs[destPort]->unbound_port.incoming_data, (void*)arg);
 	AbortOnCondition(appendSuccess == -1, "Queue_append failed in minimsg_network_handler()");
+	PORT_STATS_ADD(g_unboundedPortPtrs[destPort], packets_received, 1);
+	PORT_STATS_ADD(g_unboundedPortPtrs[destPort], bytes_received, arg->size - sizeof(mini_header_t));
 
 	semaphore_V(g_unboundedPortPtrs[destPort]->unbound_port.datagrams_ready);
 }
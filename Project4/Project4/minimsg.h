@@ -16,6 +16,20 @@
 
 typedef struct miniport miniport_t;
 
+/* Counters of a miniport, or of all miniports together. Bytes are payload bytes,
+* headers are not counted. Datagrams are counted on the unbound port they are sent
+* from (the source port of their header) and on the unbound port they arrive at.
+*/
+typedef struct miniport_stats
+{
+	unsigned long long bytes_sent;
+	unsigned long long bytes_received;
+	unsigned int packets_sent;
+	unsigned int packets_received;
+	unsigned int packets_dropped; //datagrams that arrived for a port nobody listens on (only in the global totals)
+	unsigned int queue_depth; //datagrams not read by minimsg_receive yet
+} miniport_stats_t;
+
 /* performs any required initialization of the minimsg layer.  */
 void minimsg_initialize();
 
@@ -54,6 +68,16 @@ void miniport_destroy(miniport_t* miniport);
 */
 int minimsg_send(miniport_t* local_unbound_port, const miniport_t* local_bound_port, const char* msg, int len);
 
+/* Broadcasts a message to the unbound port remote_unbound_port_number on every host
+* adjacent to this one in the network's broadcast topology. As with minimsg_send,
+* local_unbound_port is the sender's listening port, so receivers can reply through
+* the bound port that minimsg_receive creates for them. The packet is built once and
+* fanned out to all neighbours in a single batch. Broadcast must have been enabled with
+* network_enable_broadcast() before the system started. The return value is the number of
+* data payload bytes sent not inclusive of the header, or -1 on error.
+*/
+int minimsg_broadcast(miniport_t* local_unbound_port, int remote_unbound_port_number, const char* msg, int len);
+
 /* Receives a message through a locally unbound port. Threads that call this function are
 * blocked until a message arrives. Upon arrival of each message, the function must create
 * a new bound port that targets the sender's address and listening port, so that use of
@@ -64,4 +88,19 @@ int minimsg_send(miniport_t* local_unbound_port, const miniport_t* local_bound_p
 */
 int minimsg_receive(miniport_t* local_unbound_port, miniport_t** new_local_bound_port, char* msg, int *len);
 
+/* Copies the counters of a miniport into stats. Returns 0 if successful, -1 if
+* miniport or stats is NULL.
+*/
+int miniport_get_stats(miniport_t* miniport, miniport_stats_t* stats);
+
+/* Copies the totals of all miniports, destroyed ones included, into stats. The
+* queue depth is the sum over the existing unbound ports.
+*/
+void minimsg_get_global_stats(miniport_stats_t* stats);
+
+/* Prints the counters of a miniport to stdout, or the totals of all miniports if
+* miniport is NULL.
+*/
+void minimsg_dump_stats(miniport_t* miniport);
+
 #endif /*__MINIMSG_H__*/
@@ -15,6 +15,9 @@
 #include "miniheader.h"
 #include "alarm.h"
 #include "common.h"
+#include "congestion.h"
+#include "machineprimitives.h"
+#include "portos_stats.h"
 
 // ---- Constants ---- //
 #define CLIENT_PORT_START		32768	/* The beginning port number for client port */
@@ -31,7 +34,10 @@ const int FIN_WAIT_TIME = 15000; // waiting time in ms of a socket after respond
 // ---- Global Variables ---- //
 int g_clientPortCounter = -1; //for incrementally assigning client ports
 minisocket_t* g_socketPortPtrs[PORT_END - PORT_START + 1]; //tracks the pointers to all of our socket ports
-semaphore_t* g_semaSocketArrayLock = NULL; // used as mutex to protect modification to g_socketPortPtrs
+mutex_t* g_socketArrayLock = NULL; // protects modification to g_socketPortPtrs
+const cc_ops_t* g_defaultCongestionOps = &cc_newreno; // congestion controller given to new sockets
+minisocket_stats_t g_socketTotals; // counters of all sockets together, only updated with interrupts disabled
+portos_stat_t* g_rttStat = NULL; // round trip times of all sockets, in microseconds
 
 // ---- Data Types ---- //
 // socket's wait states.
@@ -51,10 +57,14 @@ struct minisocket
 	socket_state state;		// socket's status 
 	wait_state waitStatus;	// does the socket is wait for a special packet, and what type of packet it is waiting for
 	unsigned int waitAckNumber;	// What is the ack number of the waited packet
-	int numAlarmFired;		// # of tries to send a packet (only used by minisocket_send_a_packet() and alarm handler
+	int numAlarmFired;		// # of tries to send a packet (only used by minisocket_send_a_packet(), minisocket_send_window() and alarm handler
+	int dupAcks;			// # of duplicate ACKs received in a row while data is outstanding
+
+	const cc_ops_t* ccOps;	// congestion controller of the socket
+	cc_state_t cc;			// congestion state, only modified by the sending thread
 
 	semaphore_t *waitSema;	// waiting for handshaking or ACK packet
-	semaphore_t *canSend;	// for minisocket_send(): only one send can use a socket at a time
+	mutex_t *canSend;		// for minisocket_send(): only one send can use a socket at a time
 	semaphore_t *packetIsReady; // waiting for received data
 	queue_t *incomingDataPackets;
 
@@ -62,14 +72,56 @@ struct minisocket
 
 	network_interrupt_arg_t* leftOverPacket; // a packet that is partially received
 	int usedPacketBytes; // number of bytes used in the leftOverPacket packet
+
+	minisocket_stats_t stats; // counters, only updated with interrupts disabled
 };
 
+// adds n to a counter of the socket and to the global total. Interrupts must be disabled.
+#define SOCKET_STATS_ADD(socket, counter, n)	\
+	do {										\
+		(socket)->stats.counter += (n);			\
+		g_socketTotals.counter += (n);			\
+	} while (0)
+
 // ---- Internal Functions ---- //
+// sequence number comparisons that survive wrap-around
+static bool seq_before(unsigned int a, unsigned int b) { return (int)(a - b) < 0; }
+static bool seq_after(unsigned int a, unsigned int b) { return (int)(a - b) > 0; }
+
+// records a round trip time sample of rttUs microseconds. Interrupts must be disabled.
+static void stats_add_rtt(minisocket_stats_t* stats, unsigned int rttUs)
+{
+	if (stats->rttSamples == 0 || rttUs < stats->rttMinUs) stats->rttMinUs = rttUs;
+	if (rttUs > stats->rttMaxUs) stats->rttMaxUs = rttUs;
+	stats->rttSamples++;
+	stats->rttTotalUs += rttUs;
+}
+
+static void stats_add_handshake(minisocket_stats_t* stats, unsigned int handshakeUs)
+{
+	stats->handshakes++;
+	stats->handshakeUs += handshakeUs;
+}
+
+// It sends a packet of the socket and counts it.
+// Return: as network_send_pkt()
+int minisocket_send_pkt(minisocket_t* socket, const network_address_t addr, const mini_header_reliable_t* header, const char* data, int len)
+{
+	int sentBytes = network_send_pkt(addr, sizeof(mini_header_reliable_t), (char*)header, len, data);
+	if (sentBytes != -1) {
+		interrupt_level_t old_level = set_interrupt_level(DISABLED);
+		SOCKET_STATS_ADD(socket, packetsSent, 1);
+		SOCKET_STATS_ADD(socket, bytesSent, len);
+		set_interrupt_level(old_level);
+	}
+	return sentBytes;
+}
+
 // This is used to free a socket's resources
 void free_socket(minisocket_t* socket)
 {
 	semaphore_destroy(socket->waitSema);
-	semaphore_destroy(socket->canSend);
+	mutex_destroy(socket->canSend);
 	semaphore_destroy(socket->packetIsReady);
 	semaphore_destroy(socket->closingAlarmSema);
 	queue_free_nodes_and_queue(socket->incomingDataPackets, free_network_arg);
@@ -79,7 +131,6 @@ void free_socket(minisocket_t* socket)
 void wakeup_all(minisocket_t* socket)
 {
 	while (semaphore_has_sleep_thread(socket->waitSema)) semaphore_V(socket->waitSema);
-	while (semaphore_has_sleep_thread(socket->canSend)) semaphore_V(socket->canSend);
 	while (semaphore_has_sleep_thread(socket->packetIsReady)) semaphore_V(socket->packetIsReady);
 	while (semaphore_has_sleep_thread(socket->closingAlarmSema)) semaphore_V(socket->closingAlarmSema);
 }
@@ -90,7 +141,7 @@ int init_socket_common_part(minisocket_t* socket, minisocket_error *error)
 {
 	//create semaphores and queue
 	socket->waitSema = semaphore_create();
-	socket->canSend = semaphore_create();
+	socket->canSend = mutex_create();
 	socket->packetIsReady = semaphore_create();
 	socket->closingAlarmSema = semaphore_create();
 	socket->incomingDataPackets = queue_new();
@@ -101,7 +152,6 @@ int init_socket_common_part(minisocket_t* socket, minisocket_error *error)
 	}
 
 	semaphore_initialize(socket->waitSema, 0); //initialize our data ready sema
-	semaphore_initialize(socket->canSend, 1);
 	semaphore_initialize(socket->packetIsReady, 0);
 	semaphore_initialize(socket->closingAlarmSema, 0);
 
@@ -115,6 +165,12 @@ int init_socket_common_part(minisocket_t* socket, minisocket_error *error)
 	socket->leftOverPacket = NULL;
 	socket->usedPacketBytes = 0;
 
+	socket->dupAcks = 0;
+	socket->ccOps = g_defaultCongestionOps;
+	socket->ccOps->init(&socket->cc, MAXSOCKET_MAX_MSG_SIZE);
+
+	memset(&socket->stats, 0, sizeof(minisocket_stats_t));
+
 	return 0;
 }
 
@@ -142,32 +198,38 @@ int minisocket_send_a_packet(minisocket_t *socket, const mini_header_reliable_t*
 	socket->numAlarmFired = 0;
 	socket->waitAckNumber += len;
 	int numSendTries = 0;
+	alarm_id retryAlarm = NULL; // the alarm of the last try, it outlives the loop iterations waiting for it
 	while (socket->numAlarmFired < TRANSMISSION_TRIES) {
-		alarm_id retryAlarm;
 		int sentBytes = 0;
 		if (numSendTries == socket->numAlarmFired) { // need to another try of sending
-			sentBytes = network_send_pkt(socket->remoteAddr, sizeof(mini_header_reliable_t), (char*)header, len, msg);
+			sentBytes = minisocket_send_pkt(socket, socket->remoteAddr, header, msg, len);
 			if (sentBytes == -1) { //failed to send error
 				*error = SOCKET_SENDERROR;
 				return -1;
 			}
+			if (numSendTries > 0) {
+				interrupt_level_t old_level = set_interrupt_level(DISABLED);
+				SOCKET_STATS_ADD(socket, retransmissions, 1);
+				set_interrupt_level(old_level);
+			}
 
 			retryAlarm = register_alarm(TRANSMISSION_RETRY_DELAYS[numSendTries], minisocket_send_alarm_handler, socket);
 			numSendTries++;
 		}
 		
 		semaphore_P(socket->waitSema); //wait for ACK message
-		// Check what happened
-		if (socket->state == CLOSING || socket->state == CLOSED) { // socket is closed
-			break;
-		} else if (socket->waitStatus == whatToWait && socket->seqNumber == socket->waitAckNumber) { // expected ACK is recevied
+		// Check what happened. The expected ACK is checked first: the remote may have acked and then
+		// closed before this thread got to run again, which still counts as a successful send
+		if ((socket->waitStatus == whatToWait || socket->waitStatus == GOT_FIN) && socket->seqNumber == socket->waitAckNumber) { // expected ACK is recevied
 			if (numSendTries > socket->numAlarmFired) // if alarm has not set off, dereg it
 				deregister_alarm(retryAlarm); 
 
 			*error = SOCKET_NOERROR;
 			assert(sentBytes - sizeof(mini_header_reliable_t) == len);
 			return sentBytes - sizeof(mini_header_reliable_t);
-		} 
+		} else if (socket->state == CLOSING || socket->state == CLOSED) { // socket is closed
+			break;
+		}
 	}
 
 	// if not returned yet, failed in sending 
@@ -175,6 +237,137 @@ int minisocket_send_a_packet(minisocket_t *socket, const mini_header_reliable_t*
 	return -1;
 }
 
+// It sends a message of data packets reliably, keeping up to the socket's congestion window of bytes in flight.
+// The receiver only accepts in-order packets, so lost packets are recovered go-back-N style: after a timeout or
+// CC_DUPACK_THRESHOLD duplicate ACKs, sending restarts from the first unacknowledged byte.
+// The retransmission timer gives up after TRANSMISSION_TRIES timeouts in a row without any progress.
+// Return: # of msg bytes acknowledged by the remote. error is set if not all of them were acknowledged.
+int minisocket_send_window(minisocket_t *socket, const char *msg, int len, minisocket_error *error)
+{
+	const unsigned int firstSeq = socket->seqNumber;
+	const unsigned int endSeq = firstSeq + len;
+	unsigned int ackedSeq = firstSeq;	// all bytes before it are acknowledged
+	unsigned int sendNext = firstSeq;	// seq number of the next byte to send
+	unsigned int highestSent = firstSeq;	// bytes before it have been sent at least once
+	mini_header_reliable_t header;		// header of the data packets, its seq_number changes per packet
+	int numTries = 0;			// # of timeouts in a row without progress
+	bool timerArmed = false;
+	alarm_id retryAlarm = NULL;
+	int firedAtArming = 0;		// socket->numAlarmFired when the timer was armed
+	bool timing = false;		// a packet is being timed for a round trip time sample
+	unsigned int timedSeq = 0;	// the sample is taken when all bytes before timedSeq are acknowledged
+	uint64_t timedAt = 0;		// when the timed packet was sent
+
+	socket->numAlarmFired = 0;
+	socket->dupAcks = 0;
+	*error = SOCKET_NOERROR;
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); // the ACK handler updates the socket concurrently
+	while (true) {
+		// new data acknowledged
+		if (seq_after(socket->seqNumber, ackedSeq)) {
+			socket->ccOps->on_ack(&socket->cc, socket->seqNumber - ackedSeq);
+			ackedSeq = socket->seqNumber;
+			if (seq_before(sendNext, ackedSeq)) sendNext = ackedSeq; // acked past a go-back-N restart point
+			if (timing && !seq_before(ackedSeq, timedSeq)) {
+				timing = false;
+				unsigned int rttUs = (unsigned int)(currentTimeMicros() - timedAt);
+				stats_add_rtt(&socket->stats, rttUs);
+				stats_add_rtt(&g_socketTotals, rttUs);
+				portos_stats_record(g_rttStat, rttUs);
+			}
+			if (socket->cc.inRecovery && !seq_before(ackedSeq, socket->cc.recover)) {
+				socket->cc.inRecovery = false;
+				socket->ccOps->on_recovery_done(&socket->cc);
+			}
+			numTries = 0;
+			if (timerArmed) { // restart the timer for the remaining data
+				deregister_alarm(retryAlarm);
+				timerArmed = false;
+			}
+		}
+
+		if (ackedSeq == endSeq) break; // everything is acknowledged
+
+		if (socket->state != CONNECTED) { // socket is closed
+			*error = SOCKET_SENDERROR;
+			break;
+		}
+
+		int flight = sendNext - ackedSeq;
+		if (timerArmed && socket->numAlarmFired != firedAtArming) { // retransmission timeout
+			timerArmed = false;
+			if (++numTries == TRANSMISSION_TRIES) {
+				*error = SOCKET_NOSERVER;
+				break;
+			}
+			socket->ccOps->on_timeout(&socket->cc, flight);
+			socket->cc.inRecovery = false;
+			socket->cc.recover = sendNext; // duplicate ACKs caused by the packets in flight must not trigger a fast retransmit
+			socket->dupAcks = 0;
+			sendNext = ackedSeq;
+			timing = false; // the timed packet may be retransmitted, its ACK would be ambiguous
+		} else if (socket->dupAcks >= CC_DUPACK_THRESHOLD) { // fast retransmit
+			socket->dupAcks = 0;
+			if (!socket->cc.inRecovery && !seq_before(ackedSeq, socket->cc.recover)) {
+				socket->ccOps->on_fast_retransmit(&socket->cc, flight);
+				socket->cc.inRecovery = true;
+				socket->cc.recover = sendNext;
+				sendNext = ackedSeq;
+				timing = false;
+				if (timerArmed) {
+					deregister_alarm(retryAlarm);
+					timerArmed = false;
+				}
+			}
+		}
+
+		// send as many packets as the congestion window allows, at least one if nothing is in flight
+		memcpy(&header, &socket->header, sizeof(mini_header_reliable_t));
+		while (seq_before(sendNext, endSeq)) {
+			flight = sendNext - ackedSeq;
+			int currLen = (endSeq - sendNext > MAXSOCKET_MAX_MSG_SIZE) ? MAXSOCKET_MAX_MSG_SIZE : endSeq - sendNext;
+			if (flight > 0 && flight + currLen > socket->cc.cwnd) break;
+
+			// the handler accepts ACKs up to waitAckNumber, it must be set before the packet can be acked
+			if (seq_after(sendNext + currLen, socket->waitAckNumber)) socket->waitAckNumber = sendNext + currLen;
+			socket->waitStatus = WAIT_ACK;
+			pack_unsigned_int(header.seq_number, sendNext);
+			pack_unsigned_int(header.ack_number, socket->ackNumber);
+			if (minisocket_send_pkt(socket, socket->remoteAddr, &header, msg + (sendNext - firstSeq), currLen) == -1) {
+				*error = SOCKET_SENDERROR;
+				break;
+			}
+			if (seq_before(sendNext, highestSent)) {
+				SOCKET_STATS_ADD(socket, retransmissions, 1);
+			} else if (!timing) { // time a packet that is sent for the first time
+				timing = true;
+				timedSeq = sendNext + currLen;
+				timedAt = currentTimeMicros();
+			}
+			sendNext += currLen;
+			if (seq_after(sendNext, highestSent)) highestSent = sendNext;
+		}
+		if (*error != SOCKET_NOERROR) break;
+
+		if (!timerArmed) {
+			firedAtArming = socket->numAlarmFired;
+			retryAlarm = register_alarm(TRANSMISSION_RETRY_DELAYS[numTries], minisocket_send_alarm_handler, socket);
+			timerArmed = true;
+		}
+
+		set_interrupt_level(old_level);
+		semaphore_P(socket->waitSema); // wait for an ACK or a timeout
+		set_interrupt_level(DISABLED);
+	}
+
+	if (timerArmed) deregister_alarm(retryAlarm);
+	socket->waitAckNumber = ackedSeq; // forget the packets in flight that will not be acknowledged
+	set_interrupt_level(old_level);
+
+	return ackedSeq - firstSeq;
+}
+
 // ---- API Functions ---- //
 void minisocket_initialize()
 {
@@ -184,9 +377,18 @@ void minisocket_initialize()
 
 	g_clientPortCounter = CLIENT_PORT_START; 
 	memset(g_socketPortPtrs, 0, sizeof(g_socketPortPtrs)); //set array of port pointers to null
-	g_semaSocketArrayLock = semaphore_create(); 
-	AbortOnCondition(g_semaSocketArrayLock == NULL, "g_semaSocketArrayLock failed in minimsg_initialize()");
-	semaphore_initialize(g_semaSocketArrayLock, 1); //init sema to 1 (available).
+	g_socketArrayLock = mutex_create(); //created unlocked
+	AbortOnCondition(g_socketArrayLock == NULL, "g_socketArrayLock failed in minimsg_initialize()");
+
+	// export the totals
+	portos_stats_register("minisocket", "packets_sent", PORTOS_STAT_COUNTER, portos_stats_read_uint, &g_socketTotals.packetsSent);
+	portos_stats_register("minisocket", "bytes_sent", PORTOS_STAT_COUNTER, portos_stats_read_ull, &g_socketTotals.bytesSent);
+	portos_stats_register("minisocket", "packets_received", PORTOS_STAT_COUNTER, portos_stats_read_uint, &g_socketTotals.packetsReceived);
+	portos_stats_register("minisocket", "bytes_received", PORTOS_STAT_COUNTER, portos_stats_read_ull, &g_socketTotals.bytesReceived);
+	portos_stats_register("minisocket", "retransmissions", PORTOS_STAT_COUNTER, portos_stats_read_uint, &g_socketTotals.retransmissions);
+	portos_stats_register("minisocket", "handshakes", PORTOS_STAT_COUNTER, portos_stats_read_uint, &g_socketTotals.handshakes);
+	portos_stats_register("minisocket", "queue_depth", PORTOS_STAT_GAUGE, portos_stats_read_uint, &g_socketTotals.queueDepth);
+	g_rttStat = portos_stats_histogram("minisocket", "rtt_us");
 }
 
 minisocket_t* minisocket_server_create(int port, minisocket_error *error)
@@ -223,15 +425,15 @@ minisocket_t* minisocket_server_create(int port, minisocket_error *error)
 	socket->waitStatus = WAIT_SYN;
 	socket->waitAckNumber = 0;
 
-	semaphore_P(g_semaSocketArrayLock); // critical section to prevent others to modify global g_socketPortPtrs
+	mutex_lock(g_socketArrayLock); // critical section to prevent others to modify global g_socketPortPtrs
 	if (g_socketPortPtrs[port] != NULL) { // check again in case it is taken by another thread since last checking
 		free_socket(socket);
 		*error = SOCKET_PORTINUSE;
-		semaphore_V(g_semaSocketArrayLock);
+		mutex_unlock(g_socketArrayLock);
 		return NULL;
 	}
 	g_socketPortPtrs[port] = socket;	//update our array of pointers for our unbounded ports
-	semaphore_V(g_semaSocketArrayLock);	//end of critical session
+	mutex_unlock(g_socketArrayLock);	//end of critical session
 
 	//establish handshake
 	// assign header's partial field for sending MSG_SYNACK packet
@@ -240,6 +442,7 @@ minisocket_t* minisocket_server_create(int port, minisocket_error *error)
 	pack_unsigned_int(socket->header.ack_number, socket->ackNumber);
 	while (true) {
 		semaphore_P(socket->waitSema); //wait for SYN message
+		uint64_t handshakeStart = currentTimeMicros();
 
 		// At this point, SYN is received and remoteAddr and the header's destination address and port should be assigned
 		socket->waitStatus = WAIT_ACK;
@@ -247,6 +450,11 @@ minisocket_t* minisocket_server_create(int port, minisocket_error *error)
 		int sentBytes = minisocket_send_a_packet(socket, &socket->header, NULL, 0, GOT_ACK, error);
 		if (sentBytes != -1) { // if sent successfully
 			assert(socket->seqNumber == 1 && socket->ackNumber == 1);
+			unsigned int handshakeUs = (unsigned int)(currentTimeMicros() - handshakeStart);
+			interrupt_level_t old_level = set_interrupt_level(DISABLED);
+			stats_add_handshake(&socket->stats, handshakeUs);
+			stats_add_handshake(&g_socketTotals, handshakeUs);
+			set_interrupt_level(old_level);
 			*error = SOCKET_NOERROR;
 			return socket;
 		}
@@ -294,7 +502,7 @@ minisocket_t* minisocket_client_create(const network_address_t addr, int port, m
 	socket->waitAckNumber = 0;
 
 	int localPort = CLIENT_PORT_START;
-	semaphore_P(g_semaSocketArrayLock); //critical section to prevent others to modify global g_socketPortPtrs
+	mutex_lock(g_socketArrayLock); //critical section to prevent others to modify global g_socketPortPtrs
 	if (g_clientPortCounter > CLIENT_PORT_END) //if we've reached the end of our port space, we need to search for an available port number
 	{
 		// find an available client port
@@ -302,7 +510,7 @@ minisocket_t* minisocket_client_create(const network_address_t addr, int port, m
 		
 		if (localPort > CLIENT_PORT_END) { //if no port is available
 			free_socket(socket);
-			semaphore_V(g_semaSocketArrayLock);
+			mutex_unlock(g_socketArrayLock);
 			*error = SOCKET_NOMOREPORTS;
 			return NULL;
 		} 
@@ -311,7 +519,7 @@ minisocket_t* minisocket_client_create(const network_address_t addr, int port, m
 
 	pack_unsigned_short(socket->header.source_port, (unsigned short)localPort);
 	g_socketPortPtrs[localPort] = socket;	//set the port to point to our pointer
-	semaphore_V(g_semaSocketArrayLock);		//end of critical session
+	mutex_unlock(g_socketArrayLock);		//end of critical session
 
 	//establish handshake
 	socket->header.message_type = MSG_SYN;
@@ -320,8 +528,14 @@ minisocket_t* minisocket_client_create(const network_address_t addr, int port, m
 
 	socket->waitStatus = WAIT_SYNACK;
 	socket->waitAckNumber = 1;
+	uint64_t handshakeStart = currentTimeMicros();
 	int sentBytes = minisocket_send_a_packet(socket, &socket->header, NULL, 0, GOT_SYNACK, error);
 	if (sentBytes != -1) { // send MSG_ACK successfully
+		unsigned int handshakeUs = (unsigned int)(currentTimeMicros() - handshakeStart);
+		interrupt_level_t old_level = set_interrupt_level(DISABLED);
+		stats_add_handshake(&socket->stats, handshakeUs);
+		stats_add_handshake(&g_socketTotals, handshakeUs);
+		set_interrupt_level(old_level);
 		*error = SOCKET_NOERROR;
 		return socket;
 	}
@@ -330,9 +544,9 @@ minisocket_t* minisocket_client_create(const network_address_t addr, int port, m
 	if (socket->waitStatus == GOT_FIN) *error = SOCKET_BUSY;
 	else *error = SOCKET_NOSERVER;
 
-	semaphore_P(g_semaSocketArrayLock); //critical section to prevent others to modify global g_socketPortPtrs
+	mutex_lock(g_socketArrayLock); //critical section to prevent others to modify global g_socketPortPtrs
 	g_socketPortPtrs[localPort] = NULL; 
-	semaphore_V(g_semaSocketArrayLock);	//end of critical session
+	mutex_unlock(g_socketArrayLock);	//end of critical session
 	free_socket(socket);
 	return NULL;
 }
@@ -345,32 +559,70 @@ int minisocket_send(minisocket_t *socket, const char *msg, int len, minisocket_e
 		return -1;
 	} 
 
-	semaphore_P(socket->canSend); // allow only one send
+	mutex_lock(socket->canSend); // allow only one send
 
 	// check if the socket is still connected
 	if (socket->state != CONNECTED) {
 		*error = SOCKET_SENDERROR;
+		mutex_unlock(socket->canSend);
 		return -1;
 	}
 
-	*error = SOCKET_NOERROR;
-	int sentBytes = 0;
-	while (len > 0) {
-		int currLen = (len > MAXSOCKET_MAX_MSG_SIZE) ? MAXSOCKET_MAX_MSG_SIZE : len;
-		socket->waitStatus = WAIT_ACK;
-		int currSendBytes = minisocket_send_a_packet(socket, &socket->header, msg + sentBytes, currLen, GOT_ACK, error);
-		if (currSendBytes == -1) { // sending error
-			break;	// stop sending remaining data
-		}
+	int sentBytes = minisocket_send_window(socket, msg, len, error);
 
-		sentBytes += currSendBytes;
-		len -= currSendBytes;
-	} 
-
-	semaphore_V(socket->canSend); //release socket for other send
+	mutex_unlock(socket->canSend); //release socket for other send
 	return sentBytes;
 }
 
+// It copies up to max_len (> 0) bytes of received data into msg: from the packet left over by the last receive if there is one,
+// otherwise from the next received packet, in which case the caller has taken the packetIsReady semaphore.
+// Return: as minisocket_receive()
+static int receive_available(minisocket_t *socket, char *msg, int max_len, minisocket_error *error)
+{
+	assert(max_len > 0 && socket->incomingDataPackets != NULL);
+	int receivedBytes = 0;
+	if (socket->leftOverPacket != NULL) { // there is data left from last receive, read it and return
+		receivedBytes = socket->leftOverPacket->size - socket->usedPacketBytes;
+		assert(receivedBytes > 0);
+		if (receivedBytes > max_len) receivedBytes = max_len;
+		memcpy(msg, socket->leftOverPacket->buffer + socket->usedPacketBytes, receivedBytes);
+		socket->usedPacketBytes += receivedBytes;
+		if (socket->leftOverPacket->size == socket->usedPacketBytes) { // if all bytes in the buffer are received
+			network_free_pkt(socket->leftOverPacket); // release the packet
+			socket->leftOverPacket = NULL;
+			socket->usedPacketBytes = 0;
+		}
+	} else { // read from socket's queue incomingDataPackets, a packet has arrived
+		assert(socket->usedPacketBytes == 0);
+		interrupt_level_t old_level = set_interrupt_level(DISABLED); // critical session (to dequeue the packet queue)
+		// data that arrived before the remote closed is still delivered, fail only once it is used up
+		if (socket->state != CONNECTED && queue_length(socket->incomingDataPackets) == 0) {
+			set_interrupt_level(old_level);
+			*error = SOCKET_RECEIVEERROR;
+			return -1;
+		}
+		int dequeueSuccess = queue_dequeue(socket->incomingDataPackets, (void**)&socket->leftOverPacket);
+		set_interrupt_level(old_level); //end of critical session to restore interrupt level
+		AbortOnCondition(dequeueSuccess != 0, "Queue_dequeue failed in minisocket_receive()");
+
+		int totalUsedBytes = sizeof(mini_header_reliable_t);
+		int dataBytes = socket->leftOverPacket->size - totalUsedBytes;
+		assert(dataBytes > 0); // if no data, the packet should not be enqueued
+		receivedBytes = (dataBytes > max_len) ? max_len : dataBytes;
+		memcpy(msg, socket->leftOverPacket->buffer + totalUsedBytes, receivedBytes);
+		totalUsedBytes += receivedBytes;
+
+		if (socket->leftOverPacket->size > totalUsedBytes) { // if there are some bytes left
+			socket->usedPacketBytes = totalUsedBytes;
+		} else { // the packet is fully received
+			network_free_pkt(socket->leftOverPacket); // release the packet
+			socket->leftOverPacket = NULL;
+		}
+	}
+
+	return receivedBytes;
+}
+
 int minisocket_receive(minisocket_t *socket, char *msg, int max_len, minisocket_error *error)
 {
 	//validate inputs
@@ -381,52 +633,32 @@ int minisocket_receive(minisocket_t *socket, char *msg, int max_len, minisocket_
 
 	assert(socket->packetIsReady != NULL && socket->incomingDataPackets != NULL);
 	*error = SOCKET_NOERROR;
-	int receivedBytes = 0;
-	if (max_len > 0) {
-		if (socket->leftOverPacket != NULL) { // there is data left from last receive, read it and return
-			receivedBytes = socket->leftOverPacket->size - socket->usedPacketBytes;
-			assert(receivedBytes > 0);
-			if (receivedBytes > max_len) receivedBytes = max_len;
-			memcpy(msg, socket->leftOverPacket->buffer + socket->usedPacketBytes, receivedBytes);
-			socket->usedPacketBytes += receivedBytes;
-			if (socket->leftOverPacket->size == socket->usedPacketBytes) { // if all bytes in the buffer are received
-				free(socket->leftOverPacket); // release the packet
-				socket->leftOverPacket = NULL;
-				socket->usedPacketBytes = 0;
-			}
-		} else { // read from socket's queue incomingDataPackets
-			assert(socket->usedPacketBytes == 0);
-			semaphore_P(socket->packetIsReady); //P semaphore to wait for receiving data packet
+	if (max_len == 0) return 0;
 
-			// check if the socket is still connected
-			if (socket->state != CONNECTED) {
-				*error = SOCKET_RECEIVEERROR;
-				return -1;
-			}
+	if (socket->leftOverPacket == NULL) semaphore_P(socket->packetIsReady); //P semaphore to wait for receiving data packet
+	return receive_available(socket, msg, max_len, error);
+}
 
-			//once a packet arrives and we wake up
-			interrupt_level_t old_level = set_interrupt_level(DISABLED); // critical session (to dequeue the packet queue)
-			int dequeueSuccess = queue_dequeue(socket->incomingDataPackets, (void**)&socket->leftOverPacket);
-			set_interrupt_level(old_level); //end of critical session to restore interrupt level
-			AbortOnCondition(dequeueSuccess != 0, "Queue_dequeue failed in minisocket_receive()");
-
-			int totalUsedBytes = sizeof(mini_header_reliable_t);
-			int dataBytes = socket->leftOverPacket->size - totalUsedBytes;
-			assert(dataBytes > 0); // if no data, the packet should not be enqueued
-			receivedBytes = (dataBytes > max_len) ? max_len : dataBytes;
-			memcpy(msg, socket->leftOverPacket->buffer + totalUsedBytes, receivedBytes);
-			totalUsedBytes += receivedBytes;
-
-			if (socket->leftOverPacket->size > totalUsedBytes) { // if there are some bytes left
-				socket->usedPacketBytes = totalUsedBytes;
-			} else { // the packet is fully received
-				free(socket->leftOverPacket); // release the packet
-				socket->leftOverPacket = NULL;
-			}
-		}
+void minisocket_receive_notify(minisocket_t *socket, semaphore_waiter_t *waiter)
+{
+	AbortOnCondition(socket == NULL || waiter == NULL, "Null argument in minisocket_receive_notify()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	if (socket->leftOverPacket != NULL) waiter->ready(waiter->arg); // data is left from the last receive
+	else semaphore_P_async(socket->packetIsReady, waiter); // as minisocket_receive() would P, without blocking
+	set_interrupt_level(old_level);
+}
+
+int minisocket_receive_ready(minisocket_t *socket, char *msg, int max_len, minisocket_error *error)
+{
+	//validate inputs
+	if (socket == NULL || error == NULL || max_len <= 0 || msg == NULL) {
+		*error = SOCKET_INVALIDPARAMS;
+		return -1;
 	}
 
-	return receivedBytes;
+	*error = SOCKET_NOERROR;
+	return receive_available(socket, msg, max_len, error);
 }
 
 void minisocket_close(minisocket_t *socket)
@@ -436,6 +668,11 @@ void minisocket_close(minisocket_t *socket)
 	if (socket->state == CONNECTED) {
 		socket->state = CLOSING;
 
+		// a send in progress gives up once it sees the socket closing, and so do the sends queued behind it;
+		// the FIN is sent once they are gone, so that none of them changes what the FIN waits for
+		while (semaphore_has_sleep_thread(socket->waitSema)) semaphore_V(socket->waitSema);
+		mutex_lock(socket->canSend);
+
 		// send MSG_FIN packet
 		socket->header.message_type = MSG_FIN;
 		socket->waitStatus = WAIT_ACK;
@@ -443,6 +680,7 @@ void minisocket_close(minisocket_t *socket)
 		minisocket_error error;
 		minisocket_send_a_packet(socket, &socket->header, NULL, 0, GOT_ACK, &error);
 		socket->state = CLOSED;
+		mutex_unlock(socket->canSend);
 	} else if (socket->state == CLOSING) { // alarm has not fired yet, wait for alarm to fire
 		semaphore_P(socket->closingAlarmSema);
 		assert(socket->state == CLOSED);
@@ -450,14 +688,94 @@ void minisocket_close(minisocket_t *socket)
 
 	// close the socket even when the above sending has no response
 	int sourcePort = unpack_unsigned_short(socket->header.source_port);
-	semaphore_P(g_semaSocketArrayLock); //critical section to prevent others to modify global g_socketPortPtrs
+	mutex_lock(g_socketArrayLock); //critical section to prevent others to modify global g_socketPortPtrs
 	g_socketPortPtrs[sourcePort] = NULL;
-	semaphore_V(g_semaSocketArrayLock);	//end of critical session
+	mutex_unlock(g_socketArrayLock);	//end of critical session
 	
 	wakeup_all(socket);
+	mutex_lock(socket->canSend); // if the remote closed first, wait for a send woken up above to give up the socket
+	mutex_unlock(socket->canSend);
 	free_socket(socket);
 }
 
+int minisocket_set_congestion_control(minisocket_t* socket, const cc_ops_t* ops)
+{
+	if (socket == NULL || ops == NULL) return -1;
+
+	mutex_lock(socket->canSend); // no send may use the old controller's state
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	socket->ccOps = ops;
+	socket->ccOps->init(&socket->cc, MAXSOCKET_MAX_MSG_SIZE);
+	set_interrupt_level(old_level);
+	mutex_unlock(socket->canSend);
+
+	return 0;
+}
+
+void minisocket_set_default_congestion_control(const cc_ops_t* ops)
+{
+	AbortOnCondition(ops == NULL, "Null argument ops in minisocket_set_default_congestion_control()");
+	g_defaultCongestionOps = ops;
+}
+
+int minisocket_get_congestion_state(minisocket_t* socket, cc_state_t* state)
+{
+	if (socket == NULL || state == NULL) return -1;
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	memcpy(state, &socket->cc, sizeof(cc_state_t));
+	set_interrupt_level(old_level);
+
+	return 0;
+}
+
+int minisocket_get_stats(minisocket_t* socket, minisocket_stats_t* stats)
+{
+	if (socket == NULL || stats == NULL) return -1;
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	memcpy(stats, &socket->stats, sizeof(minisocket_stats_t));
+	stats->queueDepth = queue_length(socket->incomingDataPackets);
+	set_interrupt_level(old_level);
+
+	return 0;
+}
+
+void minisocket_get_global_stats(minisocket_stats_t* stats)
+{
+	AbortOnCondition(stats == NULL, "Null argument stats in minisocket_get_global_stats()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	memcpy(stats, &g_socketTotals, sizeof(minisocket_stats_t));
+	stats->queueDepth = 0;
+	for (int port = PORT_START; port <= PORT_END; port++) {
+		if (g_socketPortPtrs[port] != NULL) stats->queueDepth += queue_length(g_socketPortPtrs[port]->incomingDataPackets);
+	}
+	set_interrupt_level(old_level);
+}
+
+void minisocket_dump_stats(minisocket_t* socket)
+{
+	minisocket_stats_t stats;
+	if (socket == NULL) minisocket_get_global_stats(&stats);
+	else minisocket_get_stats(socket, &stats);
+
+	printf("!$STAT: #npktsent:     %u\n", stats.packetsSent);
+	printf("!$STAT: #npktrecv:     %u\n", stats.packetsReceived);
+	printf("!$STAT: #nbytesent:    %llu\n", stats.bytesSent);
+	printf("!$STAT: #nbyterecv:    %llu\n", stats.bytesReceived);
+	printf("!$STAT: #nretransmit:  %u\n", stats.retransmissions);
+	printf("!$STAT: #ndupdrop:     %u\n", stats.duplicatesDropped);
+	printf("!$STAT: #noutoforder:  %u\n", stats.outOfOrderDropped);
+	printf("!$STAT: #queuedepth:   %u\n", stats.queueDepth);
+	printf("!$STAT: #nrtt:         %u\n", stats.rttSamples);
+	printf("!$STAT: #rttminus:     %u\n", stats.rttMinUs);
+	printf("!$STAT: #rttavgus:     %llu\n", (stats.rttSamples > 0) ? stats.rttTotalUs / stats.rttSamples : 0ULL);
+	printf("!$STAT: #rttmaxus:     %u\n", stats.rttMaxUs);
+	printf("!$STAT: #nhandshake:   %u\n", stats.handshakes);
+	printf("!$STAT: #handshakeus:  %llu\n", (stats.handshakes > 0) ? stats.handshakeUs / stats.handshakes : 0ULL);
+}
+
 void minisocket_network_handler(network_interrupt_arg_t* arg)
 {
 	//Get header and destination port
@@ -465,7 +783,7 @@ void minisocket_network_handler(network_interrupt_arg_t* arg)
 	int destPort = unpack_unsigned_short(receivedHeaderPtr->destination_port);
 	//if msg is not expected or the unbounded port has not been initialized, throw away the packet
 	if (destPort < PORT_START || destPort > PORT_END || g_socketPortPtrs[destPort] == NULL) {
-		free(arg);
+		network_free_pkt(arg);
 		return;
 	}
 
@@ -477,32 +795,36 @@ void minisocket_network_handler(network_interrupt_arg_t* arg)
 	unpack_address(receivedHeaderPtr->source_address, remoteAddr);
 
 	if (socket->state == CLOSED) { // ignore packet if the socket is closed
-		free(arg);
+		network_free_pkt(arg);
 		return;
 	} else if (socket->waitStatus != WAIT_SYN) { // if socket has remote addr+port
-		if (receivedHeaderPtr->message_type == MSG_SYN) { // respond with MSG_FIN message
+		assert(sizeof(int64_t) == sizeof(receivedHeaderPtr->source_address) && sizeof(short) == sizeof(receivedHeaderPtr->source_port));
+		int64_t* recAddr_int = (int64_t*)receivedHeaderPtr->source_address;
+		short* recPort_int = (short*)receivedHeaderPtr->source_port;
+		int64_t* socketAddr_int = (int64_t*)socket->header.destination_address;
+		short* socketPort_int = (short*)socket->header.destination_port;
+		bool fromRemote = (*recAddr_int == *socketAddr_int && *recPort_int == *socketPort_int);
+		if (receivedHeaderPtr->message_type == MSG_SYN && fromRemote) { // a retransmitted SYN of our remote, our SYNACK timer answers it
+			network_free_pkt(arg);
+			return;
+		} else if (receivedHeaderPtr->message_type == MSG_SYN) { // another client, respond with MSG_FIN message
 			mini_header_reliable_t finHeader;
 			memcpy(&finHeader, &socket->header, sizeof(mini_header_reliable_t));
 			memcpy(finHeader.destination_address, receivedHeaderPtr->source_address, sizeof(receivedHeaderPtr->source_address));
 			memcpy(finHeader.destination_port, receivedHeaderPtr->source_port, sizeof(receivedHeaderPtr->source_port));
 			finHeader.message_type = MSG_FIN;
-			network_send_pkt(remoteAddr, sizeof(mini_header_reliable_t), (char*)&finHeader, 0, NULL);
-			free(arg);
+			// the FIN belongs to no socket of ours, it only counts in the totals
+			if (network_send_pkt(remoteAddr, sizeof(mini_header_reliable_t), (char*)&finHeader, 0, NULL) != -1) g_socketTotals.packetsSent++;
+			network_free_pkt(arg);
+			return;
+		} else if (!fromRemote) { // discard mismatched remote addr+port
+			network_free_pkt(arg);
 			return;
-		} else { //check agreement between remote addr+port and socket's
-			assert(sizeof(int64_t) == sizeof(receivedHeaderPtr->source_address) && sizeof(short) == sizeof(receivedHeaderPtr->source_port));
-			int64_t* recAddr_int = (int64_t*)receivedHeaderPtr->source_address;
-			short* recPort_int = (short*)receivedHeaderPtr->source_port;
-			int64_t* socketAddr_int = (int64_t*)socket->header.destination_address;
-			short* socketPort_int = (short*)socket->header.destination_port;
-			if (*recAddr_int != *socketAddr_int || *recPort_int != *socketPort_int) { // discard mismatched remote addr+port
-				free(arg);
-				return;
-			}
 		}
 	}
 
 	// packet matches socket's addr+port or MSG_SYN packet that socket is waiting for
+	SOCKET_STATS_ADD(socket, packetsReceived, 1);
 	bool needFree = true;
 	switch (receivedHeaderPtr->message_type) {
 	case MSG_SYN:
@@ -513,7 +835,7 @@ void minisocket_network_handler(network_interrupt_arg_t* arg)
 			socket->waitStatus = GOT_SYN;
 			semaphore_V(socket->waitSema);
 		}
-		free(arg);
+		network_free_pkt(arg);
 		break;
 
 	case MSG_SYNACK: 
@@ -527,61 +849,77 @@ void minisocket_network_handler(network_interrupt_arg_t* arg)
 			pack_unsigned_int(socket->header.ack_number, socket->ackNumber);
 			socket->waitStatus = GOT_SYNACK;
 			// send ACK packet to respond
-			network_send_pkt(socket->remoteAddr, sizeof(mini_header_reliable_t), (char*)&socket->header, 0, NULL);
+			minisocket_send_pkt(socket, socket->remoteAddr, &socket->header, NULL, 0);
 			semaphore_V(socket->waitSema);
 		} 
 
 		if (socket->state == CONNECTED)
-			network_send_pkt(socket->remoteAddr, sizeof(mini_header_reliable_t), (char*)&socket->header, 0, NULL);
+			minisocket_send_pkt(socket, socket->remoteAddr, &socket->header, NULL, 0);
 
-		free(arg);
+		network_free_pkt(arg);
 		break;
 
 	case MSG_ACK:
-		if (socket->waitStatus == WAIT_ACK && socket->waitAckNumber == receivedAckNum) {
+		// ACKs are cumulative: any ack_num up to waitAckNumber acknowledges new bytes
+		if (socket->waitStatus == WAIT_ACK && seq_after(receivedAckNum, socket->seqNumber) && !seq_after(receivedAckNum, socket->waitAckNumber)) {
 			if (socket->state == UNCONNECTED) {
 				socket->state = CONNECTED;
 				socket->header.message_type = MSG_ACK;
 			}
 			socket->seqNumber = receivedAckNum;
 			pack_unsigned_int(socket->header.seq_number, socket->seqNumber);
-			socket->waitStatus = GOT_ACK;
+			socket->dupAcks = 0;
+			if (socket->seqNumber == socket->waitAckNumber) socket->waitStatus = GOT_ACK; // everything sent is acknowledged
 			semaphore_V(socket->waitSema);
+		} else if (socket->waitStatus == WAIT_ACK && receivedAckNum == socket->seqNumber && dataBytes == 0 
+			&& seq_before(socket->seqNumber, socket->waitAckNumber)) { // duplicate ACK while data is outstanding
+			if (++socket->dupAcks == CC_DUPACK_THRESHOLD) semaphore_V(socket->waitSema);
 		}
 
 		if (dataBytes > 0 && socket->state == CONNECTED) { // data packet & socket is ready to accept data
 			if (socket->ackNumber == receivedSeqNum) {
+				SOCKET_STATS_ADD(socket, bytesReceived, dataBytes);
 				socket->ackNumber += dataBytes;
 				pack_unsigned_int(socket->header.ack_number, socket->ackNumber);
 				queue_append(socket->incomingDataPackets, (void*)arg); // append the data packet
 				semaphore_V(socket->packetIsReady);
 				needFree = false;
+			} else if (seq_before(receivedSeqNum, socket->ackNumber)) { // a retransmission of data received before
+				SOCKET_STATS_ADD(socket, duplicatesDropped, 1);
+			} else { // data after a missing packet, it is retransmitted by the sender later
+				SOCKET_STATS_ADD(socket, outOfOrderDropped, 1);
 			}
 
-			if (socket->ackNumber == receivedSeqNum + dataBytes) // respond with ACK if it is a matched packet 
-				network_send_pkt(remoteAddr, sizeof(mini_header_reliable_t), (char*)&socket->header, 0, NULL);
+			// respond with ACK to every data packet: an ACK of an out-of-order packet is a duplicate ACK to the sender
+			minisocket_send_pkt(socket, remoteAddr, &socket->header, NULL, 0);
 		} 
 		
-		if (needFree) free(arg);
+		if (needFree) network_free_pkt(arg);
 		break;
 
 	case MSG_FIN: 
 		if (socket->state == CONNECTED) { // closing socket if not yet
+			// the MSG_FIN packet acknowledges the data the remote received before closing
+			if (socket->waitStatus == WAIT_ACK && seq_after(receivedAckNum, socket->seqNumber) && !seq_after(receivedAckNum, socket->waitAckNumber)) {
+				socket->seqNumber = receivedAckNum;
+				pack_unsigned_int(socket->header.seq_number, socket->seqNumber);
+			}
 			socket->state = CLOSING;
 			socket->ackNumber++; // ack_num is increased by 1 to respond a MSG_FIN packet with another MSG_FIN packet
 			pack_unsigned_int(socket->header.ack_number, socket->ackNumber);
 			socket->waitStatus = GOT_FIN;
 			register_alarm(FIN_WAIT_TIME, minisocket_close_alarm_handler, socket);
+			if (semaphore_has_sleep_thread(socket->waitSema)) semaphore_V(socket->waitSema); // a sender must not wait for ACKs that will not come
 		}
 
 		if (socket->state == CLOSING)
-			network_send_pkt(remoteAddr, sizeof(mini_header_reliable_t), (char*)&socket->header, 0, NULL);
+			minisocket_send_pkt(socket, remoteAddr, &socket->header, NULL, 0);
 
-		free(arg);
+		network_free_pkt(arg);
 		break;
 
 	default:
-		free(arg);
+		network_free_pkt(arg);
 		break;
 	}
 }
@@ -14,10 +14,35 @@
 #include <stdlib.h>
 #include "network.h"
 #include "minimsg.h"
+#include "congestion.h"
+#include "synch.h"
 
 typedef struct minisocket minisocket_t;
 typedef enum minisocket_error minisocket_error;
 
+/*
+ * Counters of a minisocket, or of all minisockets together. Bytes are payload
+ * bytes, headers are not counted. Round trip times are only sampled from
+ * packets that were not retransmitted. Times are in microseconds.
+ */
+typedef struct minisocket_stats
+{
+	unsigned long long bytesSent;		// data bytes sent, retransmissions included
+	unsigned long long bytesReceived;	// data bytes accepted in order
+	unsigned int packetsSent;			// all packets sent, control packets and retransmissions included
+	unsigned int packetsReceived;		// all packets received by the socket
+	unsigned int retransmissions;		// packets sent again after a timeout or a fast retransmit
+	unsigned int duplicatesDropped;		// data packets dropped because they were received before
+	unsigned int outOfOrderDropped;		// data packets dropped because they arrived ahead of a missing one
+	unsigned int queueDepth;			// received data packets not read by minisocket_receive() yet
+	unsigned int rttSamples;			// # of round trip time samples
+	unsigned int rttMinUs;
+	unsigned int rttMaxUs;
+	unsigned long long rttTotalUs;		// the average is rttTotalUs / rttSamples
+	unsigned int handshakes;			// # of connections established
+	unsigned long long handshakeUs;		// total time spent in establishing them
+} minisocket_stats_t;
+
 
 enum minisocket_error {
   SOCKET_NOERROR=0,
@@ -97,11 +122,74 @@ int minisocket_send(minisocket_t *socket, const char *msg, int len, minisocket_e
  */
 int minisocket_receive(minisocket_t* socket, char *msg, int max_len, minisocket_error *error);
 
+/*
+ * Receiving without blocking, for tasks (see task.h).
+ *
+ * minisocket_receive_notify(minisocket_t* socket, semaphore_waiter_t* waiter)
+ *  Call waiter->ready(waiter->arg) once a receive on socket would not block:
+ *  data has arrived or the connection is closed. It is called right away if
+ *  that is already the case, and otherwise later with interrupts disabled,
+ *  possibly from the network handler (see semaphore_P_async()).
+ *
+ * int minisocket_receive_ready(minisocket_t* socket, char *msg, int max_len, minisocket_error *error)
+ *  Complete the receive, once the waiter's ready has been called: as
+ *  minisocket_receive(), except that max_len must be positive. Each notify
+ *  must be followed by exactly one minisocket_receive_ready().
+ */
+void minisocket_receive_notify(minisocket_t* socket, semaphore_waiter_t* waiter);
+int minisocket_receive_ready(minisocket_t* socket, char *msg, int max_len, minisocket_error *error);
+
 /* Close a connection. If minisocket_close is issued, any send or receive should
  * fail.  As soon as the other side knows about the close, it should fail any
  * send or receive in progress. The minisocket is destroyed by minisocket_close
  * function.  The function should never fail.
+ *
+ * Sends in progress on the socket, and sends waiting for their turn, fail
+ * with SOCKET_SENDERROR; minisocket_close() returns once all of them have
+ * returned. No send may start once minisocket_close() is called.
  */
 void minisocket_close(minisocket_t* socket);
 
+/*
+ * Select the congestion controller (see congestion.h) of a socket. The
+ * congestion state of the socket is reset. It waits for a send in progress on
+ * the socket to finish first.
+ *
+ * Return value: 0 if successful, -1 if socket or ops is NULL.
+ */
+int minisocket_set_congestion_control(minisocket_t* socket, const cc_ops_t* ops);
+
+/*
+ * Select the congestion controller given to sockets created from now on.
+ * cc_newreno is the default.
+ */
+void minisocket_set_default_congestion_control(const cc_ops_t* ops);
+
+/*
+ * Copy the current congestion state of a socket (cwnd, ssthresh, ...) into
+ * state.
+ *
+ * Return value: 0 if successful, -1 if socket or state is NULL.
+ */
+int minisocket_get_congestion_state(minisocket_t* socket, cc_state_t* state);
+
+/*
+ * Copy the counters of a socket into stats.
+ *
+ * Return value: 0 if successful, -1 if socket or stats is NULL.
+ */
+int minisocket_get_stats(minisocket_t* socket, minisocket_stats_t* stats);
+
+/*
+ * Copy the totals of all minisockets, closed ones included, into stats. The
+ * queue depth is the sum over the open sockets.
+ */
+void minisocket_get_global_stats(minisocket_stats_t* stats);
+
+/*
+ * Print the counters of a socket to stdout, or the totals of all sockets if
+ * socket is NULL.
+ */
+void minisocket_dump_stats(minisocket_t* socket);
+
 #endif /* __MINISOCKETS_H_ */
@@ -13,79 +13,173 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 #include <assert.h>
+#include <signal.h>
+#include <unistd.h>
 
 #include "minithread.h"
+#include "minithread_private.h"
+#include "scheduler.h"
 #include "synch.h"
 #include "machineprimitives.h"
 #include "interrupts.h"
 #include "alarm.h"
 #include "queue.h"
-#include "multilevel_queue.h"
 #include "network.h"
 #include "minimsg.h"
 #include "minisocket.h"
+#include "portos_stats.h"
 
 /*
-* A minithread should be defined either in this file or in a private
-* header file.  Minithreads have a stack pointer with to make procedure
-* calls, a stackbase which points to the bottom of the procedure
-* call stack, the ability to be enqueueed and dequeued, and any other state
-* that you feel they must have.
+* A minithread is defined in minithread_private.h.  Minithreads have a stack
+* pointer with to make procedure calls, a stackbase which points to the bottom
+* of the procedure call stack, the ability to be enqueueed and dequeued, and
+* any other state that you feel they must have.
 */
 
 // Forward declaration of functions defined elsewhere
 void common_network_handler(network_interrupt_arg_t* arg);
 
-//Clock interrupt period in millseconds
-const int INTERRUPT_PERIOD_IN_MILLISECONDS = 100; // set to 100ms
-const int NUMBER_OF_LEVELS_OF_ML_THREAD = 4;	// Number of levels for multi-level threads
-const int INITIAL_THREAD_QUANTA[] = { 1, 2, 4, 8 }; // Quanta (# of interrupts) set to each level, array size must match NUMBER_OF_LEVELS_OF_ML_THREAD
-const int INITIAL_QUEUE_QUANTA[] = { 80, 40, 24, 16 }; // Quanta (# of interrupts) set to each level, array size must match NUMBER_OF_LEVELS_OF_ML_THREAD
+#define DEFAULT_QUANTUM_MS 100 //clock interrupt period in milliseconds unless minithread_set_quantum() changes it
+#define MAX_QUANTUM_MS 1000
 
 // ----- Global Variables ------ //
 minithread_t* g_runningThread = NULL; //points to currently running thread
 minithread_t* g_idleThread = NULL; //our idle thread that runs if no threads are left to run
-minithread_t* g_reaperThread = NULL; //thread to clean up threads in the zombie queue
 
-multilevel_queue_t* g_runQueue = NULL; //global ml_queue for threads waiting to run
-queue_t* g_zombieQueue = NULL; //global queue for finished threads waiting to be cleaned up
+const sched_ops_t* g_scheduler = &sched_mlfq; //scheduling policy, it holds the threads waiting to run
+queue_t* g_wokenThreads = NULL; //threads made runnable by minithread_start_all() that the scheduler has not taken in yet
+
+#define RECYCLE_POOL_SIZE 128 //# of finished threads kept for reuse, beyond it the oldest are freed
+queue_t* g_recyclePool = NULL; //finished threads whose control block and stack new threads reuse, oldest first
 
 int g_threadIdCounter = 0; //counter for creating unique threadIds
-int g_current_level = 0; //tracks current level of queue within multilevel queue
-int g_quantaCountdown = -1; //global counter to keep track of how many quanta pass until runQueue switches its queue level for dequeue.
 
 uint64_t g_interruptCount = 0; //global counter to count how many interrupts has passed. This value should not overflow for years.
 
-//Thread statuses
-typedef enum { RUNNING, READY, WAIT, DONE } thread_state; // thread's states.
+uint64_t g_switchCount = 0; //# of times a thread was made the running thread
 
-struct minithread
-{
-	int threadId;				//unique minithread ID
-	stack_pointer_t stackbase;	//pointer to base of thread's stack
-	stack_pointer_t stacktop;	//pointer to top of thread's stack
-	thread_state status;		//current thread status
-	int level;					//current level within multilevel queue scheduler
-	int quanta;					//current quanta left
-};
+portos_stat_t* g_preemptionsStat = NULL; //scheduler statistics, registered by minithread_system_initialize()
+portos_stat_t* g_runDelayStat = NULL; //microseconds a thread waited to run once ready
+
+minithread_trace_event_t* g_traceBuffer = NULL; //ring buffer of context switch events, NULL until tracing is first enabled
+int g_traceCapacity = 0; //# of events g_traceBuffer holds
+uint64_t g_traceCount = 0; //# of events recorded since tracing was enabled, the next event goes to g_traceCount % g_traceCapacity
+bool g_traceEnabled = false; //whether context switches are currently recorded
+
+bool g_inNetworkHandler = false; //true while a network interrupt is being handled, threads it wakes up are marked for the scheduler
+
+bool g_stackGuard = false; //whether stacks have guard pages, see minithread_set_stack()
+
+int g_quantumMs = DEFAULT_QUANTUM_MS; //clock interrupt period in milliseconds of processor time, see minithread_set_quantum()
+
+// a thread-local storage key, see minithread_key_create()
+typedef struct tls_key {
+	bool inUse;					//whether the key has been created and not deleted
+	unsigned int seq;			//bumped when the key is created or deleted, so values set under an earlier generation are stale
+	void (*destructor)(void*);	//called on the values threads still hold when they finish, may be NULL
+} tls_key_t;
+
+tls_key_t g_tlsKeys[MINITHREAD_KEYS_MAX]; //all thread-local storage keys
+
+#define TLS_DESTRUCTOR_ROUNDS 4 //# of times a finishing thread's values are destroyed, destructors may set values again
+
+static const char* TRACE_REASON_NAMES[] = { "yield", "preempt", "block", "exit", "handoff" }; // indexed by minithread_trace_reason_t
 
 
 //   -----   Private helper functions  -----  
-// This function performs minithread_fork() or minithread_create().
-// It takes in the thread state and which queue the thread should be added to as input
-// Note that only valid input for whichQueue is NULL or g_runQueue.
-minithread_t* minithread_create_helper(proc_t proc, arg_t arg, thread_state status, multilevel_queue_t* whichQueue);
+// This function performs minithread_fork(), minithread_create(), minithread_fork_joinable() and
+// minithread_create_with_attrs(). It takes in the thread state, whether the thread should be handed to the scheduler,
+// whether it is joinable and the thread's priority, stack size and name (the defaults if attrs is NULL) as input
+minithread_t* minithread_create_helper(proc_t proc, arg_t arg, thread_state status, bool schedule, bool joinable, const minithread_attr_t* attrs);
 
 // forward declaration (see the definition below for its functions) 
 // This function does same as minithread_stop() except that caller can specify 
 // thread's status to set, which queue to insert current thread, and which thread to yield to.
 void minithread_stop_helper(thread_state status, queue_t* whichQueue, minithread_t* threadToRunNext);
 
-//This function returns true if the thread is either the idle or reaper thread, which should not be in a queue
-bool is_idle_or_reaper(minithread_t* mt)
+// This function frees the control block and stack of thread mt, which must not be running
+void free_thread(minithread_t* mt)
+{
+	minithread_free_stack_of_size(mt->stackbase, mt->stackSize);
+	free(mt);
+}
+
+// This function puts the finished thread mt in the recycle pool for minithread_create_helper() to reuse. mt may be
+// the calling thread, which still runs on its stack until it switches away. Caller must disable interrupts.
+void recycle_thread(minithread_t* mt)
+{
+	if (queue_length(g_recyclePool) >= RECYCLE_POOL_SIZE) { // make room by freeing the oldest thread, it no longer runs
+		minithread_t* oldest = NULL;
+		int dequeueSuccess = queue_dequeue(g_recyclePool, (void**)&oldest);
+		assert(dequeueSuccess == 0 && oldest != mt);
+		free_thread(oldest);
+	}
+	int appendSuccess = queue_append(g_recyclePool, mt);
+	AbortOnCondition(appendSuccess != 0, "Queue append error in recycle_thread()");
+}
+
+// This function sets the status of thread mt, charging the time since its last status change to the old status.
+// now is the current time from currentTimeMicros(). Caller must disable interrupts.
+void set_status(minithread_t* mt, thread_state status, uint64_t now)
 {
-	return (mt == g_idleThread || mt == g_reaperThread);
+	unsigned long long elapsed = now - mt->statusSince;
+	if (mt->status == RUNNING) mt->stats.runningUs += elapsed;
+	else if (mt->status == READY) mt->stats.readyUs += elapsed;
+	else if (mt->status == WAIT) mt->stats.waitUs += elapsed;
+
+	mt->status = status;
+	mt->statusSince = now;
+}
+
+// This function hands the threads woken up by minithread_start_all() to the scheduler. It is called before each
+// scheduling decision, so that the waker only spliced them and each thread is taken in when it may be picked.
+// Caller must disable interrupts.
+void take_woken_threads()
+{
+	if (queue_length(g_wokenThreads) == 0) return;
+
+	uint64_t now = currentTimeMicros();
+	minithread_t* t = NULL;
+	while (queue_dequeue(g_wokenThreads, (void**)&t) == 0) {
+		assert(t->status == WAIT);
+		set_status(t, READY, now);
+		int appendSuccess = g_scheduler->wake(t);
+		AbortOnCondition(appendSuccess != 0, "Queue_append error in take_woken_threads()");
+	}
+}
+
+// This function returns the # of runnable threads, once the scheduler has taken in the woken ones. Caller must disable interrupts.
+int runnable_threads()
+{
+	take_woken_threads();
+	return g_scheduler->length();
+}
+
+// This function makes mt the running thread.
+// now is the current time from currentTimeMicros(). Caller must disable interrupts and switch to mt.
+void set_running_thread(minithread_t* mt, uint64_t now)
+{
+	if (mt->status == READY) portos_stats_record(g_runDelayStat, now - mt->statusSince);
+	g_switchCount++;
+	set_status(mt, RUNNING, now);
+	g_runningThread = mt;
+}
+
+// This function records a context switch from thread from to thread to in the trace ring buffer if tracing is enabled.
+// Caller must disable interrupts.
+void trace_switch(minithread_t* from, minithread_t* to, minithread_trace_reason_t reason, uint64_t now)
+{
+	if (!g_traceEnabled) return;
+
+	minithread_trace_event_t* event = &g_traceBuffer[g_traceCount % g_traceCapacity];
+	event->timeUs = now;
+	event->fromId = from->threadId;
+	event->toId = to->threadId;
+	event->fromLevel = from->level;
+	event->reason = reason;
+	g_traceCount++;
 }
 
 /*****	 alarm handler	 *****/
@@ -96,53 +190,92 @@ void alarm_handler_function(void* arg)
 	minithread_start((minithread_t*)arg);
 }
 
-/* minithread functions */
+/*****	 stack overflow handler	 *****/
+// This function handles a segmentation fault, reporting it if the running thread overflowed its stack into the guard
+// page. The faulting instruction then runs again without the handler, and the fault ends the program as usual.
+void stack_overflow_handler(int sig, siginfo_t* info, void* context)
+{
+	if (g_runningThread != NULL && minithread_stack_overflowed(g_runningThread->stackbase, info->si_addr)) {
+		char message[64];
+		int length = snprintf(message, sizeof(message), "minithread %d overflowed its stack\n", g_runningThread->threadId);
+		if (write(STDERR_FILENO, message, length) < 0) {} //nothing more can be done
+	}
+	signal(SIGSEGV, SIG_DFL);
+}
 
-//final proc that is called after the body proc for a thread is done running
-int cleanup_proc(arg_t arg)
+/*****	 network handler	 *****/
+// This function handles a network interrupt, noting that threads made runnable meanwhile are woken up by the network.
+// arg is the received packet
+void network_handler_function(network_interrupt_arg_t* arg)
 {
-	assert(is_idle_or_reaper(minithread_self()) == false); //idle and reaper thread should never end
+	bool wasInNetworkHandler = g_inNetworkHandler; // loopback packets are handled from within the sending thread, possibly nested
+	g_inNetworkHandler = true;
+	common_network_handler(arg);
+	g_inNetworkHandler = wasInNetworkHandler;
+}
 
-	while (1) {  //final_proc should not return
-		set_interrupt_level(DISABLED); //disable interrupts for yielding, interrupt is enabled by context switch
-		// set the thread to DONE and put to zombie Queue, and yield to thread g_reaperThread to clean up DONE thread(s)
-		minithread_stop_helper(DONE, g_zombieQueue, g_reaperThread);
+/* minithread functions */
+
+//calls the destructors of the thread-local values the finishing thread still holds
+void run_tls_destructors(minithread_t* mt)
+{
+	for (int round = 0; round < TLS_DESTRUCTOR_ROUNDS; round++) {
+		bool called = false;
+		for (int key = 0; key < MINITHREAD_KEYS_MAX; key++) {
+			void* value = minithread_getspecific(key);
+			if (value == NULL) continue;
+			mt->tlsValues[key] = NULL;
+			if (g_tlsKeys[key].destructor != NULL) {
+				g_tlsKeys[key].destructor(value);
+				called = true;
+			}
+		}
+		if (!called) return; //no destructor ran, so none could have set a value
 	}
+}
 
-	return -1; //should never reach here (never return)
+//body proc of every thread, runs the thread's proc and keeps its result for minithread_join()
+int thread_body(arg_t arg)
+{
+	minithread_t* mt = (minithread_t*)arg;
+	interrupt_take_pending(); //a new thread starts from the context switch, take the interrupts deferred meanwhile
+	mt->result = mt->proc(mt->arg);
+	return 0;
 }
 
-//function in reaper thread to clean up threads in zomb queue
-int reaper_thread_method(arg_t arg)
+//final proc that is called after the body proc for a thread is done running
+int cleanup_proc(arg_t arg)
 {
-	assert(g_zombieQueue != NULL); //zombie queue must be initialized
+	minithread_t* mt = minithread_self();
+	assert(mt != g_idleThread); //idle thread should never end
 
-	while (1) //runs forever so it never runs it's final proc
-	{
-		interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupts as we access global zombie queue
-		while (queue_length(g_zombieQueue) > 0) {
-			minithread_t* threadToClean = NULL;
-			int dequeueSuccess = queue_dequeue(g_zombieQueue, (void**)&threadToClean);
-			assert(dequeueSuccess == 0 && threadToClean != NULL && threadToClean->stackbase != NULL);
-			minithread_free_stack(threadToClean->stackbase);
-			free(threadToClean);
-		}
+	run_tls_destructors(mt);
 
-		set_interrupt_level(old_level); //restore interrupt level once we are done
-		minithread_yield(); //yield process to another thread
+	set_interrupt_level(DISABLED); //disable interrupts for yielding, interrupt is enabled by context switch
+	if (mt->joiner != NULL) { // the joining thread releases mt once it runs, after mt has switched away
+		minithread_start(mt->joiner);
+	} else if (!mt->joinable) { // nobody waits for the result, reuse the thread right away
+		recycle_thread(mt);
 	}
 
+	minithread_t* nextThread = g_idleThread;
+	if (runnable_threads() > 0) { // If the scheduler has runnable threads, let it pick the next one, otherwise, nextThread is idle thread
+		nextThread = g_scheduler->pick_next();
+		assert(nextThread != NULL);
+	}
+	minithread_stop_helper(DONE, NULL, nextThread); //a finished thread never runs again
+
 	return -1; //should never reach here (never return)
 }
 
 //function in idle thread, checks if runnable queue has anything to run
 int idle_thread_method(arg_t arg)
 {
-	assert(g_runQueue != NULL); //run queue must be initialized
-
 	while (1) //run forever
 	{
-		if (multilevel_queue_length(g_runQueue) > 0) { //if there is a thread in runQueue, yield to it
+		int alarmRunSuccess = alarm_check_and_run(); //set off alarms without waiting for the next tick
+		AbortOnCondition(alarmRunSuccess == -1, "Failed to run alarms in idle_thread_method()");
+		if (g_scheduler->length() > 0 || queue_length(g_wokenThreads) > 0) { //if there is a thread in runQueue, yield to it
 			minithread_yield(); // yield to another thread
 		}
 	}
@@ -153,29 +286,72 @@ int idle_thread_method(arg_t arg)
 
 // ---- minithread ----
 minithread_t*
-minithread_create_helper(proc_t proc, arg_t arg, thread_state status, multilevel_queue_t* whichQueue)
+minithread_create_helper(proc_t proc, arg_t arg, thread_state status, bool schedule, bool joinable, const minithread_attr_t* attrs)
 {
 	if (proc == NULL) return NULL;
+	size_t stackSize = (attrs != NULL && attrs->stackSize != 0) ? attrs->stackSize : minithread_stack_size();
+
+	minithread_t* mt = NULL;
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //the recycle pool is shared with finishing threads
+	if (g_recyclePool == NULL || queue_dequeue(g_recyclePool, (void**)&mt) != 0) mt = NULL;
+	set_interrupt_level(old_level);
+	if (mt != NULL && mt->stackSize != stackSize) { // its stack does not fit, it no longer runs
+		free_thread(mt);
+		mt = NULL;
+	}
 
-	minithread_t* mt = malloc(sizeof(minithread_t));
-	if (mt == NULL) return NULL; //if malloc errored
+	if (mt == NULL) { // no finished thread to reuse, allocate a new one
+		mt = malloc(sizeof(minithread_t));
+		if (mt == NULL) return NULL; //if malloc errored
 
-	//allocate stack for thread
-	minithread_allocate_stack(&(mt->stackbase), &(mt->stacktop));
-	minithread_initialize_stack(&(mt->stacktop), proc, arg, cleanup_proc, NULL);
+		//allocate stack for thread
+		minithread_allocate_stack_of_size(stackSize, &(mt->stackbase), &(mt->stacktop));
+		if (mt->stackbase == NULL) {
+			free(mt);
+			return NULL;
+		}
+		mt->stackInit = mt->stacktop;
+		mt->stackSize = stackSize;
+	}
 
-	mt->status = status;	//set the thread's status according to the function input
-	mt->level = 0;			//set to default level 0
-	mt->quanta = INITIAL_THREAD_QUANTA[mt->level]; // initialize its quanta
+	mt->stacktop = mt->stackInit;
+	minithread_initialize_stack(&(mt->stacktop), thread_body, (arg_t)mt, cleanup_proc, NULL);
+	mt->proc = proc;
+	mt->arg = arg;
+	mt->result = 0;
+	mt->joinable = joinable;
+	mt->joiner = NULL;
 
-	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupt as we enter crit section
+	mt->status = status;	//set the thread's status according to the function input
+	memset(&(mt->stats), 0, sizeof(mt->stats));
+	mt->statusSince = currentTimeMicros();
+	mt->networkWakeup = false;
+	memset(mt->tlsValues, 0, sizeof(mt->tlsValues));
+	memset(mt->tlsSeqs, 0, sizeof(mt->tlsSeqs));
+	mt->name[0] = '\0';
+	if (attrs != NULL && attrs->name != NULL) strncat(mt->name, attrs->name, MINITHREAD_NAME_MAX - 1);
+	mt->priority = (attrs != NULL) ? attrs->priority : MINITHREAD_PRIORITY_DEFAULT;
+	mt->level = 0;
+	mt->quanta = 0;
+	mt->boostEpoch = 0;
+	mt->dispatchTicks = 0;
+	mt->savedLevel = -1;
+	mt->locksHeld = 0;
+	mt->lockWaitedFor = NULL;
+	mt->tickets = SCHED_DEFAULT_TICKETS;
+	mt->pass = 0;
+	mt->deadlineMs = SCHED_DEFAULT_DEADLINE_MS;
+	mt->deadline = 0;
+
+	old_level = set_interrupt_level(DISABLED); //disable interrupt as we enter crit section
 	mt->threadId = g_threadIdCounter++;
-	if (whichQueue != NULL) //if thread needs to be added to queue, add it
+	g_scheduler->thread_init(mt); //set up the scheduler's state of the thread
+	if (schedule) //if thread needs to be added to the run queue, add it
 	{
-		int appendSuccess = multilevel_queue_enqueue(whichQueue, mt->level, mt);
+		int appendSuccess = g_scheduler->enqueue(mt);
 		if (appendSuccess != 0) //error while enqueing our new thread
 		{
-			free(mt); //free newly created minithread
+			free_thread(mt); //free newly created minithread
 			mt = NULL;
 		}
 	}
@@ -186,13 +362,90 @@ minithread_create_helper(proc_t proc, arg_t arg, thread_state status, multilevel
 minithread_t*
 minithread_fork(proc_t proc, arg_t arg)
 {
-	return minithread_create_helper(proc, arg, READY, g_runQueue); //set status to READY, add to run queue
+	return minithread_create_helper(proc, arg, READY, true, false, NULL); //set status to READY, add to run queue
 }
 
 minithread_t*
 minithread_create(proc_t proc, arg_t arg)
 {
-	return minithread_create_helper(proc, arg, WAIT, NULL); //set status to WAIT, not added to any queue, waiting threads handled by application
+	return minithread_create_helper(proc, arg, WAIT, false, false, NULL); //set status to WAIT, not added to any queue, waiting threads handled by application
+}
+
+minithread_t*
+minithread_fork_joinable(proc_t proc, arg_t arg)
+{
+	return minithread_create_helper(proc, arg, READY, true, true, NULL); //like minithread_fork(), kept once it finishes
+}
+
+void
+minithread_attr_init(minithread_attr_t* attrs)
+{
+	AbortOnCondition(attrs == NULL, "Null argument attrs in minithread_attr_init()");
+
+	attrs->priority = MINITHREAD_PRIORITY_DEFAULT;
+	attrs->stackSize = 0;
+	attrs->name = NULL;
+	attrs->affinity = -1;
+	attrs->joinable = 0;
+}
+
+minithread_t*
+minithread_create_with_attrs(proc_t proc, arg_t arg, const minithread_attr_t* attrs)
+{
+	if (attrs == NULL) return minithread_create(proc, arg);
+	if (attrs->priority < 0 || attrs->priority >= MINITHREAD_PRIORITIES || attrs->affinity < -1 || attrs->affinity > 0) return NULL; //there is only processor 0
+
+	return minithread_create_helper(proc, arg, WAIT, false, attrs->joinable != 0, attrs); //like minithread_create(), with the attributes
+}
+
+const char*
+minithread_name(minithread_t* t)
+{
+	if (t == NULL) t = minithread_self();
+
+	return t->name;
+}
+
+int
+minithread_join(minithread_t* t, int* result)
+{
+	minithread_t* self = minithread_self();
+	if (t == NULL || t == self) return -1;
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //t may finish meanwhile
+	if (!t->joinable || t->joiner != NULL) {
+		set_interrupt_level(old_level);
+		return -1;
+	}
+
+	if (t->status != DONE) { // wait for t, it wakes us up when it finishes
+		t->joiner = self;
+		minithread_stop(); //this reenables interrupts
+		set_interrupt_level(DISABLED);
+	}
+
+	assert(t->status == DONE);
+	if (result != NULL) *result = t->result;
+	recycle_thread(t);
+	set_interrupt_level(old_level);
+	return 0;
+}
+
+int
+minithread_detach(minithread_t* t)
+{
+	if (t == NULL) t = minithread_self();
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	if (!t->joinable || t->joiner != NULL) {
+		set_interrupt_level(old_level);
+		return -1;
+	}
+
+	t->joinable = false;
+	if (t->status == DONE) recycle_thread(t); // it finished while joinable, nobody else will release it
+	set_interrupt_level(old_level);
+	return 0;
 }
 
 minithread_t*
@@ -219,14 +472,56 @@ minithread_start(minithread_t *t)
 	//if thread is already running, in runqueue, or finished running return
 	if (t->status == RUNNING || t->status == READY || t->status == DONE) return;
 
-	t->status = READY;
-
 	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupt as we modify global run queue
-	int appendSuccess = multilevel_queue_enqueue(g_runQueue, t->level, t);	// put to the same level queue
+	set_status(t, READY, currentTimeMicros());
+	t->networkWakeup = g_inNetworkHandler;
+	int appendSuccess = g_scheduler->wake(t);	// hand the thread back to the scheduler
+	t->networkWakeup = false;
 	AbortOnCondition(appendSuccess != 0, "Queue_append error in minithread_start()");
 	set_interrupt_level(old_level); //restore interrupt level
 }
 
+void
+minithread_start_all(queue_t* threads)
+{
+	AbortOnCondition(threads == NULL, "Null argument in minithread_start_all()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupt as we modify the woken threads
+	int spliceSuccess = queue_splice(g_wokenThreads, threads); //the scheduler takes them in at its next decision
+	AbortOnCondition(spliceSuccess != 0, "Queue_splice error in minithread_start_all()");
+	set_interrupt_level(old_level); //restore interrupt level
+}
+
+void
+minithread_handoff(minithread_t *t)
+{
+	AbortOnCondition(t == NULL, "Null argument in minithread_handoff()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupts as we modify the scheduler's state
+	if (t->status != WAIT) { //like minithread_start(), nothing to do unless t is waiting
+		set_interrupt_level(old_level); //restore interrupt level
+		return;
+	}
+
+	minithread_t* currThread = minithread_self(); //get calling thread
+
+	// a network handler runs on the stack of the thread it interrupted, which must get the processor back when it is done
+	if (g_inNetworkHandler || currThread == g_idleThread || !g_scheduler->handoff(currThread, t)) {
+		minithread_start(t);
+		set_interrupt_level(old_level); //restore interrupt level
+		return;
+	}
+
+	// the scheduler queued the calling thread, context switch to t
+	uint64_t now = currentTimeMicros();
+	set_status(currThread, READY, now);
+	currThread->stats.handoffs++;
+	trace_switch(currThread, t, TRACE_HANDOFF, now);
+	set_running_thread(t, now);
+	minithread_switch(&(currThread->stacktop), &(g_runningThread->stacktop)); //this will reenable interrupts automatically
+	interrupt_take_pending(); //the switch enables interrupts without taking the ones deferred meanwhile
+}
+
 // This function implements minithread_stop() with more flexibily.
 // Inputs: 
 //		status - The status that the current thread's status will be set to.
@@ -237,7 +532,7 @@ minithread_start(minithread_t *t)
 //	1.	We assume that minithread_stop() does not consume any quanta.
 //  2.  There is no protection for atomic operation inside this function. Caller should ensure
 //		this function is executed in as an atomic operation by disabling interrupts
-//  3.  It does not touch g_current_level or level's quanta. It is calling function's responsibility
+//  3.  It does not call into the scheduler. It is calling function's responsibility
 void
 minithread_stop_helper(thread_state status, queue_t* whichQueue, minithread_t* threadToRunNext)
 {
@@ -246,96 +541,63 @@ minithread_stop_helper(thread_state status, queue_t* whichQueue, minithread_t* t
 	minithread_t* yieldingThread = minithread_self(); //get calling thread
 	assert(yieldingThread != NULL && yieldingThread->status == RUNNING && yieldingThread != threadToRunNext);
 
-	yieldingThread->status = status; // set the yielding thread status
+	uint64_t now = currentTimeMicros();
+	set_status(yieldingThread, status, now); // set the yielding thread status
+	if (status == WAIT) yieldingThread->stats.blocks++;
 	if (whichQueue != NULL) // put the yielding thread to the queue
 	{
 		int appendSuccess = queue_append(whichQueue, yieldingThread);
 		AbortOnCondition(appendSuccess != 0, "Queue append error in minithread_stop_helper()");
 	}
 
-	g_runningThread = threadToRunNext;
-	g_runningThread->status = RUNNING;
+	trace_switch(yieldingThread, threadToRunNext, (status == DONE) ? TRACE_EXIT : TRACE_BLOCK, now);
+	set_running_thread(threadToRunNext, now);
 	minithread_switch(&(yieldingThread->stacktop), &(g_runningThread->stacktop)); //this will reenable interrupts automatically
+	interrupt_take_pending(); //the switch enables interrupts without taking the ones deferred meanwhile
 }
 
 void
 minithread_stop()
 {
-	assert(is_idle_or_reaper(minithread_self()) == false); //idle and reaper threads should never have the WAIT status
+	assert(minithread_self() != g_idleThread); //idle thread should never have the WAIT status
 
 	set_interrupt_level(DISABLED); //disable interrupts for yielding, interrupt is enabled by context switch
+	g_scheduler->block(minithread_self());
 	minithread_t* nextThread = g_idleThread;
-	if (multilevel_queue_length(g_runQueue) > 0) { // If runQueue is not empty, get the next thread to see which one should run next, otherwise, nextThread is idle thread
-		int nextLevel = multilevel_queue_dequeue(g_runQueue, g_current_level, (void**)&nextThread); // get and dequeue the next thread from runQueue
-		assert(nextLevel != -1); //should not have returned an error code
-
-		// update g_current_level to the level of the next-to-run thread if needed
-		if (nextLevel != g_current_level) { // move g_current_level to nextLevel if there is no thread to run at the current level
-			g_current_level = nextLevel; // move to nextLevel that has the next thread to run
-			g_quantaCountdown = INITIAL_QUEUE_QUANTA[g_current_level]; // init the level's quanta
-		}
+	if (runnable_threads() > 0) { // If the scheduler has runnable threads, let it pick the next one, otherwise, nextThread is idle thread
+		nextThread = g_scheduler->pick_next();
+		assert(nextThread != NULL);
 	}
 
 	minithread_stop_helper(WAIT, NULL, nextThread); //yield processor, set status to WAIT, and don't add thread to any queue. Context switch will automatically reenable interrupts
 }
 
-/*Forces the caller to relinquish the processor and be put to the end of
-the ready queue.  Allows another thread to run. */
+// This function implements minithread_yield(). preempted tells whether the clock interrupt is taking
+// the processor away (true) or the calling thread gives it up voluntarily (false), for accounting.
 void
-minithread_yield()
+minithread_yield_helper(bool preempted)
 {
 	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupts to ensure atomic operation
 
 	minithread_t* currThread = minithread_self(); //get calling thread
 	assert(currThread != NULL && currThread->status == RUNNING);
+	if (!preempted) currThread->stats.voluntaryYields++;
+	take_woken_threads();
 
 	minithread_t* nextThread = NULL; // NULL indicates keep running the current thread without context switch
-	if (is_idle_or_reaper(currThread)) { // currThread is either the idle or reaper thread, we assume it does not count into the level's quanta
-		if (multilevel_queue_length(g_runQueue) == 0) { // no thread in runQueue
-			if (currThread == g_reaperThread) { // if the curr thread is the reaper thread, switch to g_idleThread
-				nextThread = g_idleThread;
-			}
-		}
-		else { // get next thread from runQueue
-			int nextLevel = multilevel_queue_dequeue(g_runQueue, g_current_level, (void**)&nextThread); // get next thread to run
-			assert(nextLevel >= 0 && nextThread != NULL);
+	if (currThread == g_idleThread) { // the idle thread is never handed to the scheduler
+		if (g_scheduler->length() > 0) { // get next thread from the scheduler
+			nextThread = g_scheduler->pick_next();
+			assert(nextThread != NULL);
 		}
 	}
-	else {
-		// if curr thread is not the idle or reaper thread, reduce its quanta by 1 and adjust its level if needed
-		currThread->quanta--;	// It has used up 1 quanta
-		if (currThread->quanta == 0 && currThread->level < NUMBER_OF_LEVELS_OF_ML_THREAD - 1) { // no level increase if already in highest level
-			currThread->level++;
-			currThread->quanta = INITIAL_THREAD_QUANTA[currThread->level];	// initialize quanta to the level's intial quanta
-		}
-
-		// Update the quanta count for the current level, and adjust the running level if needed
-		g_quantaCountdown--;
-		if (g_quantaCountdown == 0) {
-			g_current_level++;
-			if (g_current_level == NUMBER_OF_LEVELS_OF_ML_THREAD) g_current_level = 0;
-			g_quantaCountdown = INITIAL_QUEUE_QUANTA[g_current_level];
-		}
-
-		if (multilevel_queue_length(g_runQueue) > 0) { // If runQueue is not empty, get the next thread to see which one should run next
-			int nextLevel = multilevel_queue_peek(g_runQueue, g_current_level, (void**)&nextThread); // get the next thread from runQueue without dequeuing it
-			assert(nextLevel >= 0 && nextThread != NULL && nextThread->level == nextLevel);
-
-			// find whose level is closer to g_current_level, the closer should run next
-			int lv = g_current_level;
-			while (lv != currThread->level && lv != nextLevel) { // wrappingly increase level from g_current_level to see which one is hit first
-				lv++;
-				if (lv == NUMBER_OF_LEVELS_OF_ML_THREAD) lv = 0; // wrap around
-			}
-
-			if (lv == nextLevel) { // switch to next thread
-				nextLevel = multilevel_queue_dequeue(g_runQueue, g_current_level, (void**)&nextThread); // dequeue the next thread from ruQueue
-				assert(nextLevel >= 0 && nextThread != NULL && nextThread->level == nextLevel);
-			}
-			else { // currThread should continue to run, no need to context switch
-				nextThread = NULL;
-			}
-		}
+	else if (!preempted || g_scheduler->tick(currThread)) { // a voluntary yield, or the scheduler wants to preempt the thread
+		// put the current thread back and let the scheduler choose, it may choose the current thread again
+		int appendSuccess = g_scheduler->enqueue(currThread);
+		AbortOnCondition(appendSuccess == -1, "Failed to enqueue in minithread_yield()");
+		nextThread = g_scheduler->pick_next();
+		assert(nextThread != NULL);
+		if (nextThread == currThread) nextThread = NULL; // keep running the current thread
 	}
 
 	if (nextThread == NULL) { // no need to switch, keep running the current thread
@@ -343,17 +605,29 @@ minithread_yield()
 		return;
 	}
 	else { // context switch to nextThread
-		currThread->status = READY;
-		int appendSuccess = multilevel_queue_enqueue(g_runQueue, currThread->level, currThread); // insert CurrThread to runQueue
-		AbortOnCondition(appendSuccess == -1, "Failed to enqueue in minithread_yield()");
+		uint64_t now = currentTimeMicros();
+		set_status(currThread, READY, now);
+		if (preempted) {
+			currThread->stats.preemptions++;
+			portos_stats_add(g_preemptionsStat, 1);
+		}
 
 		assert(nextThread->status == READY);
-		nextThread->status = RUNNING;
-		g_runningThread = nextThread;
+		trace_switch(currThread, nextThread, preempted ? TRACE_PREEMPT : TRACE_YIELD, now);
+		set_running_thread(nextThread, now);
 		minithread_switch(&(currThread->stacktop), &(g_runningThread->stacktop)); //this will reenable interrupts automatically
+		interrupt_take_pending(); //the switch enables interrupts without taking the ones deferred meanwhile
 	}
 }
 
+/*Forces the caller to relinquish the processor and be put to the end of
+the ready queue.  Allows another thread to run. */
+void
+minithread_yield()
+{
+	minithread_yield_helper(false);
+}
+
 /*
 * This is the clock interrupt handling routine.
 * You have to call minithread_clock_init with this
@@ -365,10 +639,27 @@ clock_handler(void* arg)
 	set_interrupt_level(DISABLED); //disable interrupts while we're in interrupt handler
 
 	g_interruptCount++; //increment interrupt count
+	g_runningThread->stats.ticksRun++; //charge the tick to the interrupted thread
 	int alarmRunSuccess = alarm_check_and_run(); // set off alarms if any
 	AbortOnCondition(alarmRunSuccess == -1, "Failed to run alarms in clock_handler()");
 
-	minithread_yield(); //yield processor, context switch will automatically reenable interrupts
+	minithread_yield_helper(true); //yield processor, context switch will automatically reenable interrupts
+}
+
+// These functions read the scheduler statistics that live in variables of their own
+static long long read_ticks(void* arg) { return (long long)g_interruptCount; }
+static long long read_switches(void* arg) { return (long long)g_switchCount; }
+static long long read_runnable(void* arg) { return g_scheduler->length() + queue_length(g_wokenThreads); }
+
+// This function registers the statistics of the scheduler
+static void register_stats()
+{
+	portos_stats_register("scheduler", "switches", PORTOS_STAT_COUNTER, read_switches, NULL);
+	g_preemptionsStat = portos_stats_counter("scheduler", "preemptions");
+	g_runDelayStat = portos_stats_histogram("scheduler", "run_delay_us");
+	portos_stats_register("scheduler", "ticks", PORTOS_STAT_COUNTER, read_ticks, NULL);
+	portos_stats_register("scheduler", "threads_created", PORTOS_STAT_COUNTER, portos_stats_read_int, &g_threadIdCounter);
+	portos_stats_register("scheduler", "runnable", PORTOS_STAT_GAUGE, read_runnable, NULL);
 }
 
 /*
@@ -394,26 +685,36 @@ minithread_system_initialize(proc_t mainproc, arg_t mainarg)
 	are initialized.*/
 
 	//initialize global variables
-	g_runQueue = multilevel_queue_new(NUMBER_OF_LEVELS_OF_ML_THREAD);
-	g_zombieQueue = queue_new();
+	int schedInitSuccess = g_scheduler->init();
+	g_recyclePool = queue_new();
+	g_wokenThreads = queue_new();
 
 	g_threadIdCounter = 0;
 	g_interruptCount = 0;
-	g_current_level = 0;
-	g_quantaCountdown = INITIAL_QUEUE_QUANTA[g_current_level];
+	g_switchCount = 0;
+	register_stats();
+	alarm_initialize();
+	synch_initialize();
 
 	//the following threads will not be in any queue
-	g_reaperThread = minithread_create_helper(reaper_thread_method, NULL, READY, NULL);
-	g_idleThread = minithread_create_helper(idle_thread_method, NULL, READY, NULL);
-	g_runningThread = minithread_create_helper(mainproc, mainarg, READY, NULL);
+	g_idleThread = minithread_create_helper(idle_thread_method, NULL, READY, false, false, NULL);
+	g_runningThread = minithread_create_helper(mainproc, mainarg, READY, false, false, NULL);
 
 	// checking if any error occurs for above operations, and abort if error occurs
-	AbortOnCondition(g_runQueue == NULL || g_zombieQueue == NULL || g_reaperThread == NULL || g_idleThread == NULL || g_runningThread == NULL, "Failed in minithread_system_initialize()");
-
-	g_runningThread->status = RUNNING;
-
-	minithread_clock_init(INTERRUPT_PERIOD_IN_MILLISECONDS*MILLISECOND, clock_handler); //install interrupt service, enabled by the context switch
-	int netInitSuccess = network_initialize(common_network_handler);
+	AbortOnCondition(schedInitSuccess == -1 || g_recyclePool == NULL || g_wokenThreads == NULL || g_idleThread == NULL || g_runningThread == NULL, "Failed in minithread_system_initialize()");
+
+	set_running_thread(g_runningThread, currentTimeMicros());
+
+	minithread_clock_init(g_quantumMs*MILLISECOND, clock_handler); //install interrupt service, enabled by the context switch
+	if (g_stackGuard) { // an overflow faults on the guard page, the handler runs on the signal stack of the interrupts
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_sigaction = stack_overflow_handler;
+		sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+		sigemptyset(&sa.sa_mask);
+		AbortOnCondition(sigaction(SIGSEGV, &sa, NULL) != 0, "Failed to install the stack overflow handler in minithread_system_initialize()");
+	}
+	int netInitSuccess = network_initialize(network_handler_function);
 	minimsg_initialize(); //initialize our minimsg layer
 	minisocket_initialize(); //initialize our minisocket layer
 
@@ -432,3 +733,310 @@ minithread_sleep_with_timeout(int delay)
 	AbortOnCondition(newAlarm == NULL, "Failed to register an alarm in minithread_sleep_with_timeout()");
 	minithread_stop(); //give up processor, this wil enable interrupt
 }
+
+int
+minithread_set_scheduler(const sched_ops_t* scheduler)
+{
+	if (scheduler == NULL || g_runningThread != NULL) return -1; //the scheduler cannot change once threads are running
+
+	g_scheduler = scheduler;
+	return 0;
+}
+
+int
+minithread_set_stack(size_t size, int guard)
+{
+	if (g_runningThread != NULL) return -1; //stacks of both kinds cannot coexist
+
+	if (minithread_set_stack_options(size, guard) != 0) return -1;
+	g_stackGuard = (guard != 0);
+	return 0;
+}
+
+int
+minithread_set_quantum(int ms)
+{
+	if (ms <= 0 || ms > MAX_QUANTUM_MS || g_runningThread != NULL) return -1; //the clock is started with the system
+
+	g_quantumMs = ms;
+	return 0;
+}
+
+int
+minithread_set_priority(minithread_t* t, int priority)
+{
+	if (priority < 0 || priority >= MINITHREAD_PRIORITIES) return -1;
+	if (t == NULL) t = minithread_self();
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //a runnable thread moves between the scheduler's queues
+	t->priority = priority;
+	g_scheduler->reprioritize(t);
+	set_interrupt_level(old_level);
+	return 0;
+}
+
+int
+minithread_get_priority(minithread_t* t)
+{
+	if (t == NULL) t = minithread_self();
+
+	return t->priority;
+}
+
+int
+minithread_set_tickets(minithread_t* t, int tickets)
+{
+	if (tickets <= 0) return -1;
+	if (t == NULL) t = minithread_self();
+
+	t->tickets = tickets;
+	return 0;
+}
+
+int
+minithread_set_deadline(minithread_t* t, int deadlineMs)
+{
+	if (deadlineMs <= 0) return -1;
+	if (t == NULL) t = minithread_self();
+
+	t->deadlineMs = deadlineMs;
+	return 0;
+}
+
+int
+minithread_key_create(minithread_key_t* key, void (*destructor)(void*))
+{
+	if (key == NULL) return -1;
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //the key table is shared by all threads
+	for (int k = 0; k < MINITHREAD_KEYS_MAX; k++) {
+		if (g_tlsKeys[k].inUse) continue;
+		g_tlsKeys[k].inUse = true;
+		g_tlsKeys[k].seq++;
+		g_tlsKeys[k].destructor = destructor;
+		set_interrupt_level(old_level);
+		*key = k;
+		return 0;
+	}
+	set_interrupt_level(old_level);
+	return -1; //all keys are in use
+}
+
+void
+minithread_key_delete(minithread_key_t key)
+{
+	if (key < 0 || key >= MINITHREAD_KEYS_MAX) return;
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	if (g_tlsKeys[key].inUse) {
+		g_tlsKeys[key].inUse = false;
+		g_tlsKeys[key].seq++; //every value set for the key is stale now
+		g_tlsKeys[key].destructor = NULL;
+	}
+	set_interrupt_level(old_level);
+}
+
+void*
+minithread_getspecific(minithread_key_t key)
+{
+	if (key < 0 || key >= MINITHREAD_KEYS_MAX || g_runningThread == NULL) return NULL;
+
+	// only the running thread touches its own values, a deleted key has moved on to a new generation
+	minithread_t* mt = g_runningThread;
+	return (mt->tlsSeqs[key] == g_tlsKeys[key].seq) ? mt->tlsValues[key] : NULL;
+}
+
+int
+minithread_setspecific(minithread_key_t key, void* value)
+{
+	if (key < 0 || key >= MINITHREAD_KEYS_MAX || g_runningThread == NULL || !g_tlsKeys[key].inUse) return -1;
+
+	minithread_t* mt = g_runningThread;
+	mt->tlsValues[key] = value;
+	mt->tlsSeqs[key] = g_tlsKeys[key].seq;
+	return 0;
+}
+
+void
+minithread_inherit_priority(minithread_t* owner, minithread_t* waiter)
+{
+	assert(owner != NULL && waiter != NULL && owner != waiter);
+	g_scheduler->inherit(owner, waiter);
+}
+
+void
+minithread_lock_acquired(minithread_t* t)
+{
+	t->locksHeld++;
+}
+
+void
+minithread_lock_released(minithread_t* t)
+{
+	assert(t->locksHeld > 0);
+	t->locksHeld--;
+	g_scheduler->restore(t);
+}
+
+void
+minithread_set_lock_waited_for(minithread_t* t, void* lock)
+{
+	t->lockWaitedFor = lock;
+}
+
+void*
+minithread_lock_waited_for(minithread_t* t)
+{
+	return t->lockWaitedFor;
+}
+
+int
+minithread_get_stats(minithread_t* t, minithread_stats_t* stats)
+{
+	if (stats == NULL) return -1;
+	if (t == NULL) t = minithread_self();
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupts so the thread's accounting is consistent
+	*stats = t->stats;
+	stats->threadId = t->threadId;
+	stats->level = t->level;
+	stats->priority = t->priority;
+
+	unsigned long long elapsed = currentTimeMicros() - t->statusSince; // add the time spent in the current status so far
+	if (t->status == RUNNING) stats->runningUs += elapsed;
+	else if (t->status == READY) stats->readyUs += elapsed;
+	else if (t->status == WAIT) stats->waitUs += elapsed;
+	set_interrupt_level(old_level);
+	stats->stackSize = t->stackSize;
+	stats->stackUsed = minithread_stack_used_of_size(t->stackbase, t->stackSize);
+	return 0;
+}
+
+void
+minithread_dump_stats(minithread_t* t)
+{
+	minithread_stats_t stats;
+	minithread_get_stats(t, &stats);
+
+	printf("!$STAT: #thread:       %d\n", stats.threadId);
+	printf("!$STAT: #level:        %d\n", stats.level);
+	printf("!$STAT: #priority:     %d\n", stats.priority);
+	printf("!$STAT: #nticks:       %llu\n", stats.ticksRun);
+	printf("!$STAT: #nyield:       %u\n", stats.voluntaryYields);
+	printf("!$STAT: #npreempt:     %u\n", stats.preemptions);
+	printf("!$STAT: #nblock:       %u\n", stats.blocks);
+	printf("!$STAT: #nhandoff:     %u\n", stats.handoffs);
+	printf("!$STAT: #npromote:     %u\n", stats.promotions);
+	printf("!$STAT: #ndemote:      %u\n", stats.demotions);
+	printf("!$STAT: #runningus:    %llu\n", stats.runningUs);
+	printf("!$STAT: #readyus:      %llu\n", stats.readyUs);
+	printf("!$STAT: #waitus:       %llu\n", stats.waitUs);
+	printf("!$STAT: #stackkb:      %zu of %zu\n", stats.stackUsed / 1024, stats.stackSize / 1024);
+}
+
+/*
+* context switch tracing
+*/
+int
+minithread_trace_enable(int capacity)
+{
+	if (capacity <= 0) return -1;
+
+	minithread_trace_event_t* buffer = malloc(capacity * sizeof(minithread_trace_event_t));
+	if (buffer == NULL) return -1;
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupts as we replace the global trace buffer
+	minithread_trace_event_t* oldBuffer = g_traceBuffer;
+	g_traceBuffer = buffer;
+	g_traceCapacity = capacity;
+	g_traceCount = 0;
+	g_traceEnabled = true;
+	set_interrupt_level(old_level);
+
+	free(oldBuffer);
+	return 0;
+}
+
+void
+minithread_trace_disable()
+{
+	g_traceEnabled = false;
+}
+
+int
+minithread_trace_read(minithread_trace_event_t* events, int max)
+{
+	if (events == NULL || max <= 0) return 0;
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupts so that no event is recorded while we copy
+	int numEvents = (g_traceCount < g_traceCapacity) ? (int)g_traceCount : g_traceCapacity;
+	uint64_t first = g_traceCount - numEvents; // index of the oldest event still in the ring buffer
+	if (numEvents > max) { // keep the newest max events
+		first += numEvents - max;
+		numEvents = max;
+	}
+	for (int i = 0; i < numEvents; i++) {
+		events[i] = g_traceBuffer[(first + i) % g_traceCapacity];
+	}
+	set_interrupt_level(old_level);
+	return numEvents;
+}
+
+// This function copies the recorded events into a newly allocated array, which the caller must free.
+// Returns NULL if nothing is recorded.
+minithread_trace_event_t* trace_snapshot(int* numEvents)
+{
+	*numEvents = 0;
+	if (g_traceCapacity == 0) return NULL;
+
+	minithread_trace_event_t* events = malloc(g_traceCapacity * sizeof(minithread_trace_event_t));
+	if (events == NULL) return NULL;
+
+	*numEvents = minithread_trace_read(events, g_traceCapacity);
+	if (*numEvents == 0) {
+		free(events);
+		return NULL;
+	}
+	return events;
+}
+
+void
+minithread_trace_dump()
+{
+	int numEvents;
+	minithread_trace_event_t* events = trace_snapshot(&numEvents);
+
+	printf("!$TRACE: %d context switches (%llu recorded)\n", numEvents, (unsigned long long)g_traceCount);
+	for (int i = 0; i < numEvents; i++) {
+		printf("!$TRACE: %12llu us  %4d -> %-4d  %-8s level %d\n", events[i].timeUs - events[0].timeUs,
+			events[i].fromId, events[i].toId, TRACE_REASON_NAMES[events[i].reason], events[i].fromLevel);
+	}
+	free(events);
+}
+
+int
+minithread_trace_dump_chrome(const char* filename)
+{
+	if (filename == NULL) return -1;
+
+	FILE* f = fopen(filename, "w");
+	if (f == NULL) return -1;
+
+	int numEvents;
+	minithread_trace_event_t* events = trace_snapshot(&numEvents);
+	uint64_t end = currentTimeMicros(); // the thread that got the processor at the last switch is still running
+
+	// each switch starts a slice of the thread that got the processor, which lasts until the next switch
+	fprintf(f, "{\"traceEvents\":[");
+	for (int i = 0; i < numEvents; i++) {
+		uint64_t sliceEnd = (i + 1 < numEvents) ? events[i + 1].timeUs : end;
+		const char* endedBy = (i + 1 < numEvents) ? TRACE_REASON_NAMES[events[i + 1].reason] : "running";
+		fprintf(f, "%s\n{\"name\":\"run\",\"cat\":\"sched\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%llu,\"dur\":%llu,\"args\":{\"ended_by\":\"%s\"}}",
+			(i > 0) ? "," : "", events[i].toId, events[i].timeUs - events[0].timeUs,
+			(unsigned long long)(sliceEnd - events[i].timeUs), endedBy);
+	}
+	fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	free(events);
+
+	return (fclose(f) == 0) ? 0 : -1;
+}
@@ -12,6 +12,7 @@
 #define __MINITHREAD_H__
 
 #include "machineprimitives.h"
+#include "queue.h"
 
 
 /*
@@ -40,6 +41,74 @@ minithread_t* minithread_fork(proc_t proc, arg_t arg);
 */
 minithread_t* minithread_create(proc_t proc, arg_t arg);
 
+/*
+* minithread_t* minithread_fork_joinable(proc_t proc, arg_t arg)
+*  Like minithread_fork, only the new thread is joinable: when it finishes,
+*  it is kept along with the value proc returned until minithread_join() or
+*  minithread_detach() is called on it. Threads made by minithread_fork and
+*  minithread_create are detached: as soon as they finish, their control
+*  block and stack are reused for new threads, so they must not be used
+*  after that.
+*/
+minithread_t* minithread_fork_joinable(proc_t proc, arg_t arg);
+
+/*
+* int minithread_join(minithread_t* t, int* result)
+*  Wait for the joinable thread t to finish, store the value its proc
+*  returned in *result (unless result is NULL), and release t. Only one
+*  thread may join t. Returns 0 on success, -1 if t is NULL, the caller,
+*  detached, or being joined by another thread.
+*/
+int minithread_join(minithread_t* t, int* result);
+
+/*
+* int minithread_detach(minithread_t* t)
+*  Make the joinable thread t (the caller if t is NULL) detached, releasing
+*  it right away if it has finished. Returns 0 on success, -1 if t is
+*  detached already or being joined.
+*/
+int minithread_detach(minithread_t* t);
+
+/*
+* Thread attributes, for minithread_create_with_attrs().
+*
+*  priority   -- see minithread_set_priority(); MINITHREAD_PRIORITY_DEFAULT
+*  stackSize  -- bytes of the thread's stack, at least a page; 0 for the
+*                size selected by minithread_set_stack()
+*  name       -- up to MINITHREAD_NAME_MAX - 1 characters, longer names are
+*                cut; NULL for none
+*  affinity   -- processor the thread runs on, -1 for any. PortOS has a
+*                single virtual processor, 0, so this only checks that code
+*                pinning threads names processors that exist.
+*  joinable   -- whether the thread is joinable, as if forked by
+*                minithread_fork_joinable(); it is detached otherwise
+*
+* minithread_attr_init(minithread_attr_t* attrs)
+*  Set attrs to the attributes of a thread made by minithread_create().
+*
+* minithread_t* minithread_create_with_attrs(proc_t proc, arg_t arg, const minithread_attr_t* attrs)
+*  Like minithread_create, only the new thread has the attributes attrs
+*  (the defaults if NULL). Returns NULL if an attribute is not valid or if
+*  out of memory. The thread runs once minithread_start() is called on it.
+*/
+#define MINITHREAD_NAME_MAX 16
+typedef struct minithread_attr
+{
+	int priority;
+	size_t stackSize;
+	const char* name;
+	int affinity;
+	int joinable;
+} minithread_attr_t;
+void minithread_attr_init(minithread_attr_t* attrs);
+minithread_t* minithread_create_with_attrs(proc_t proc, arg_t arg, const minithread_attr_t* attrs);
+
+/*
+* const char* minithread_name(minithread_t* t)
+*  The name thread t (the caller if t is NULL) was created with, "" if none.
+*/
+const char* minithread_name(minithread_t* t);
+
 
 
 /*
@@ -69,6 +138,26 @@ void minithread_stop();
 */
 void minithread_start(minithread_t *t);
 
+/*
+* minithread_start_all(queue_t* threads)
+*  Make every thread of the queue runnable, in order, emptying the queue.
+*  The threads must be waiting, and be woken up in no other way. This takes
+*  constant time: the scheduler takes them in at its next decision, and
+*  counts them as waiting until then.
+*/
+void minithread_start_all(queue_t* threads);
+
+/*
+* minithread_handoff(minithread_t *t)
+*  Make the waiting thread t runnable and, if the scheduler deems t at least
+*  as important as the caller, switch to t right away. The caller stays
+*  runnable and is queued to run again soon; t uses up the rest of the
+*  caller's time slice, so that two threads passing the processor back and
+*  forth share one slice. In a network handler, or if t should wait its
+*  turn, this is minithread_start(t).
+*/
+void minithread_handoff(minithread_t *t);
+
 /*
 * minithread_yield()
 *  Forces the caller to relinquish the processor and be put to the end of
@@ -85,6 +174,111 @@ void minithread_yield();
 */
 void minithread_system_initialize(proc_t mainproc, arg_t mainarg);
 
+/*
+* The scheduling policy, see scheduler.h.
+*/
+typedef struct sched_ops sched_ops_t;
+
+/*
+* int minithread_set_scheduler(const sched_ops_t* scheduler)
+*  Select the scheduler used once the system is started. It must be called
+*  before minithread_system_initialize(); the default is sched_mlfq.
+*  Returns 0 on success, -1 on a NULL scheduler or if the system is running.
+*/
+int minithread_set_scheduler(const sched_ops_t* scheduler);
+
+/*
+* int minithread_set_stack(size_t size, int guard)
+*  Select the stacks of the threads, before minithread_system_initialize().
+*  Each thread gets size bytes of stack (256 KB by default), which only take
+*  memory as the thread first touches them, so that many shallow threads
+*  can use small parts of large stacks; see the stackUsed statistic to tune
+*  it. If guard is nonzero, an inaccessible page below each stack turns an
+*  overflow into a fault reported as such, and finished stacks go back to
+*  the system; each thread then needs two memory mappings, of which a
+*  process gets about 65000. Returns 0 on success, -1 if size is smaller
+*  than a page or if the system is running.
+*/
+int minithread_set_stack(size_t size, int guard);
+
+/*
+* int minithread_set_quantum(int ms)
+*  Select the period of the clock interrupt, before
+*  minithread_system_initialize(): the running thread is preempted after
+*  every ms milliseconds of processor time it uses (100 by default).
+*  Alarms and sleeps count time on the monotonic clock instead and are not
+*  affected. Returns 0 on success, -1 if ms is not between 1 and 1000 or if
+*  the system is running.
+*/
+int minithread_set_quantum(int ms);
+
+/*
+* Priorities, from 0 (the highest) to MINITHREAD_PRIORITIES - 1. Under the
+* MLFQ scheduler, a thread's priority is the highest level it reaches: it
+* starts there, and boosts and promotions bring it back there, while using
+* up its quanta still moves it down. Threads have MINITHREAD_PRIORITY_DEFAULT,
+* the top level, unless created with another priority. The other schedulers
+* ignore priorities.
+*
+* int minithread_set_priority(minithread_t* t, int priority)
+*  Set the priority of thread t (the caller if t is NULL); t moves to the
+*  level of its new priority right away. Returns 0 on success, -1 if
+*  priority is out of range.
+*
+* int minithread_get_priority(minithread_t* t)
+*  The priority of thread t (the caller if t is NULL).
+*/
+#define MINITHREAD_PRIORITIES 4
+#define MINITHREAD_PRIORITY_DEFAULT 0
+int minithread_set_priority(minithread_t* t, int priority);
+int minithread_get_priority(minithread_t* t);
+
+/*
+* int minithread_set_tickets(minithread_t* t, int tickets)
+*  Give thread t (the caller if t is NULL) tickets shares of the processor
+*  under the lottery and stride schedulers. Returns 0 on success, -1 if
+*  tickets is not positive.
+*/
+int minithread_set_tickets(minithread_t* t, int tickets);
+
+/*
+* int minithread_set_deadline(minithread_t* t, int deadlineMs)
+*  Set the relative deadline of thread t (the caller if t is NULL) under the
+*  EDF scheduler; it applies from the next time t becomes runnable.
+*  Returns 0 on success, -1 if deadlineMs is not positive.
+*/
+int minithread_set_deadline(minithread_t* t, int deadlineMs);
+
+
+/*
+* Thread-local storage.
+*  A key names one pointer-sized slot in every thread: each thread sees its
+*  own value for the key, NULL until it sets one. Reading and writing the
+*  caller's value does not disable interrupts. At most MINITHREAD_KEYS_MAX
+*  keys exist at a time.
+*
+* int minithread_key_create(minithread_key_t* key, void (*destructor)(void*))
+*  Create a key and store it in *key. When a thread finishes while holding
+*  a non-NULL value for the key, the value is cleared and destructor (unless
+*  NULL) is called with it, in the finishing thread. Returns 0 on success,
+*  -1 if all keys are in use.
+*
+* minithread_key_delete(minithread_key_t key)
+*  Delete a key. The values threads hold for it are dropped without calling
+*  the destructor; the key may be handed out again by minithread_key_create().
+*
+* void* minithread_getspecific(minithread_key_t key)
+*  Return the caller's value for key, NULL if none or if key is not valid.
+*
+* int minithread_setspecific(minithread_key_t key, void* value)
+*  Set the caller's value for key. Returns 0 on success, -1 if key is not valid.
+*/
+#define MINITHREAD_KEYS_MAX 16
+typedef int minithread_key_t;
+int minithread_key_create(minithread_key_t* key, void (*destructor)(void*));
+void minithread_key_delete(minithread_key_t key);
+void* minithread_getspecific(minithread_key_t key);
+int minithread_setspecific(minithread_key_t key, void* value);
 
 /*
 * minithread_sleep_with_timeout(int delay)
@@ -93,4 +287,127 @@ void minithread_system_initialize(proc_t mainproc, arg_t mainarg);
 void minithread_sleep_with_timeout(int delay);
 
 
+/*
+* Per-thread CPU accounting, see minithread_get_stats().
+*  Times are in microseconds and include the time spent in the current state
+*  up to the moment the statistics are taken.
+*/
+typedef struct minithread_stats
+{
+	int threadId;					// the thread's identifier
+	int level;						// the thread's current level in the scheduler
+	int priority;					// the thread's priority, see minithread_set_priority()
+	unsigned long long ticksRun;		// # of clock ticks that interrupted the thread while it was running
+	unsigned int voluntaryYields;	// # of calls to minithread_yield() made by the thread
+	unsigned int preemptions;		// # of times the clock took the processor away from the thread
+	unsigned int blocks;			// # of times the thread stopped to wait (minithread_stop, semaphores, sleeps)
+	unsigned int handoffs;			// # of times the thread gave the processor to a thread it woke up (minithread_handoff)
+	unsigned int promotions;		// # of times the thread moved to a higher priority (lower numbered) level
+	unsigned int demotions;			// # of times the thread moved to a lower priority (higher numbered) level
+	unsigned long long runningUs;		// time spent RUNNING
+	unsigned long long readyUs;		// time spent READY, i.e. runnable but waiting for the processor
+	unsigned long long waitUs;		// time spent WAIT, i.e. blocked
+	size_t stackSize;				// bytes of the thread's stack
+	size_t stackUsed;				// bytes of the stack touched so far, in whole pages, by the thread or earlier ones on the same stack
+} minithread_stats_t;
+
+/*
+* Priority inheritance, for the locks in synch.c. All three must be called
+* with interrupts disabled.
+*
+* minithread_inherit_priority(minithread_t* owner, minithread_t* waiter)
+*  waiter is about to wait for a lock held by owner: owner runs with at
+*  least the priority of waiter until it releases all its locks.
+*
+* minithread_lock_acquired(minithread_t* t)
+*  t now holds one more lock.
+*
+* minithread_lock_released(minithread_t* t)
+*  t released a lock and drops any inherited priority. The caller then
+*  passes on again the priority of the waiters of the locks t still holds.
+*
+* minithread_set_lock_waited_for(minithread_t* t, void* lock)
+* void* minithread_lock_waited_for(minithread_t* t)
+*  The lock t waits for, NULL if none, so that inheritance can follow a
+*  chain of owners that wait for one another's locks.
+*/
+void minithread_inherit_priority(minithread_t* owner, minithread_t* waiter);
+void minithread_lock_acquired(minithread_t* t);
+void minithread_lock_released(minithread_t* t);
+void minithread_set_lock_waited_for(minithread_t* t, void* lock);
+void* minithread_lock_waited_for(minithread_t* t);
+
+/*
+* int minithread_get_stats(minithread_t* t, minithread_stats_t* stats)
+*  Copy the accounting of thread t (the caller if t is NULL) into stats.
+*  Returns 0 on success and -1 on a NULL stats argument.
+*/
+int minithread_get_stats(minithread_t* t, minithread_stats_t* stats);
+
+/*
+* minithread_dump_stats(minithread_t* t)
+*  Print the accounting of thread t (the caller if t is NULL) to stdout.
+*/
+void minithread_dump_stats(minithread_t* t);
+
+/*
+* Context switch tracing.
+*
+*  When enabled, every context switch is recorded in a fixed size ring buffer;
+*  once the buffer is full the oldest events are overwritten. Recording an
+*  event costs a clock read and a few stores, so the trace can be left on
+*  while a workload runs.
+*/
+typedef enum {
+	TRACE_YIELD,	// the thread called minithread_yield()
+	TRACE_PREEMPT,	// the clock interrupt took the processor away
+	TRACE_BLOCK,	// the thread stopped to wait
+	TRACE_EXIT,		// the thread finished
+	TRACE_HANDOFF	// the thread gave the processor to a thread it woke up
+} minithread_trace_reason_t;
+
+typedef struct minithread_trace_event
+{
+	unsigned long long timeUs;		// when the switch happened, see currentTimeMicros()
+	int fromId;							// thread that gave up the processor
+	int toId;							// thread that got the processor
+	int fromLevel;						// level of the outgoing thread after the switch
+	minithread_trace_reason_t reason;	// why the outgoing thread gave up the processor
+} minithread_trace_event_t;
+
+/*
+* int minithread_trace_enable(int capacity)
+*  Start recording context switches into a ring buffer of capacity events,
+*  dropping any previous trace. Returns 0 on success, -1 on failure.
+*/
+int minithread_trace_enable(int capacity);
+
+/*
+* minithread_trace_disable()
+*  Stop recording. The recorded events are kept until the next enable.
+*/
+void minithread_trace_disable();
+
+/*
+* int minithread_trace_read(minithread_trace_event_t* events, int max)
+*  Copy up to max of the recorded events, oldest first, into events.
+*  Returns the number of events copied.
+*/
+int minithread_trace_read(minithread_trace_event_t* events, int max);
+
+/*
+* minithread_trace_dump()
+*  Print the recorded events, oldest first, to stdout.
+*/
+void minithread_trace_dump();
+
+/*
+* int minithread_trace_dump_chrome(const char* filename)
+*  Write the recorded events to filename in the Chrome trace event format, one
+*  slice per time a thread held the processor, so that the trace can be
+*  loaded in chrome://tracing or Perfetto. Returns 0 on success, -1 on failure.
+*/
+int minithread_trace_dump_chrome(const char* filename);
+
+
 #endif /*__MINITHREAD_H__*/
\ No newline at end of file
@@ -0,0 +1,56 @@
+/*
+* minithread_private.h:
+*  The thread control block. It is shared by minithread.c and the
+*  scheduling policies in scheduler.c; applications only see the opaque
+*  minithread_t of minithread.h.
+*/
+
+#ifndef __MINITHREAD_PRIVATE_H__
+#define __MINITHREAD_PRIVATE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "minithread.h"
+
+extern int g_quantumMs; //clock interrupt period in milliseconds, see minithread_set_quantum()
+
+//Thread statuses
+typedef enum { RUNNING, READY, WAIT, DONE } thread_state; // thread's states.
+
+struct minithread
+{
+	int threadId;				//unique minithread ID
+	stack_pointer_t stackbase;	//pointer to base of thread's stack
+	stack_pointer_t stacktop;	//pointer to top of thread's stack
+	stack_pointer_t stackInit;	//stacktop of the empty stack, a recycled thread starts from it again
+	size_t stackSize;			//bytes of the stack
+	char name[MINITHREAD_NAME_MAX];	//see minithread_create_with_attrs(), "" if none
+	proc_t proc;				//the thread's body, called with arg by thread_body()
+	arg_t arg;
+	int result;					//value proc returned, kept for minithread_join()
+	bool joinable;				//whether the thread is kept once it finishes, see minithread_fork_joinable()
+	minithread_t* joiner;		//thread waiting in minithread_join() for this one, NULL if none
+	thread_state status;		//current thread status
+	minithread_stats_t stats;	//cpu accounting, the threadId, level and priority fields are filled in by minithread_get_stats()
+	uint64_t statusSince;		//time in microseconds the thread entered its current status
+	bool networkWakeup;			//set by minithread_start() when a network handler made the thread runnable
+	void* tlsValues[MINITHREAD_KEYS_MAX];		//thread-local values, see minithread_key_create()
+	unsigned int tlsSeqs[MINITHREAD_KEYS_MAX];	//generation of the key each value was set under, values of an older one read as NULL
+
+	// scheduling state, owned by the scheduler in use (see scheduler.h)
+	int priority;				//see minithread_set_priority(), the highest level the thread reaches under MLFQ
+	int level;					//current level within multilevel queue scheduler
+	int quanta;					//current quanta left
+	unsigned int boostEpoch;	//last MLFQ priority boost the thread took part in
+	unsigned long long dispatchTicks;	//stats.ticksRun when the thread last got the processor
+	int savedLevel;				//level to go back to once inherited priority is dropped, -1 if the thread has not inherited any
+	int locksHeld;				//# of mutexes the thread holds, see minithread_lock_acquired()
+	void* lockWaitedFor;		//mutex the thread waits for, see minithread_set_lock_waited_for()
+	int tickets;				//share of the processor for the lottery and stride schedulers
+	uint64_t pass;				//stride scheduler's virtual time, the thread with the lowest pass runs next
+	int deadlineMs;				//relative deadline for the EDF scheduler
+	uint64_t deadline;			//absolute deadline in milliseconds (see currentTimeMicros()) of the current job, 0 if none
+};
+
+#endif /*__MINITHREAD_PRIVATE_H__*/
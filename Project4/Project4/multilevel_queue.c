@@ -72,6 +72,19 @@ int multilevel_queue_enqueue(multilevel_queue_t* queue, int level, void* item)
 
 }
 
+/*
+ * Prepends a void* to the multilevel queue at the specified level, so that it is
+ * the next item dequeued from that level.
+ * Return 0 (success) or -1 (failure).
+ */
+int multilevel_queue_prepend(multilevel_queue_t* queue, int level, void* item)
+{
+	//validate inputs
+	if (queue == NULL || level < 0 || level >= queue->num_levels) return -1;
+
+	return queue_prepend(queue->queues[level], item);
+}
+
 /*
  * Dequeue and return the first void* from the multilevel queue starting at the specified level. 
  * Levels wrap around so as long as there is something in the multilevel queue an item should be returned.
@@ -117,6 +130,18 @@ int multilevel_queue_peek(multilevel_queue_t* queue, int level, void** data)
 	return -1; // if not returned yet, cannot dequeue at any level 
 }
 
+/*
+ * Delete the first instance of the specified item from the specified level.
+ * Returns 0 if an element was deleted, or -1 otherwise.
+ */
+int multilevel_queue_delete(multilevel_queue_t* queue, int level, void* item)
+{
+	//validate inputs
+	if (queue == NULL || level < 0 || level >= queue->num_levels) return -1;
+
+	return queue_delete(queue->queues[level], item);
+}
+
 /* 
  * Free the queue and return 0 (success) or -1 (failure).
  * Do not free the queue nodes; this is the responsibility of the programmer.
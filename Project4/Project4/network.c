@@ -3,6 +3,8 @@
  *      This module paints the unix socket interface a pretty color.
  */
 
+#define _GNU_SOURCE /* for sendmmsg() */
+
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -19,22 +21,30 @@
 #include "network.h"
 #include "interrupts_private.h"
 #include "minithread.h"
+#include "synch.h"
+#include "alarm.h"
+#include "queue.h"
 #include "random.h"
+#include "objcache.h"
+#include "portos_stats.h"
 
-#define BCAST_ENABLED 0
-#define BCAST_USE_TOPOLOGY_FILE 0
 #define BCAST_ADDRESS "192.168.1.255"
-#define BCAST_LOOPBACK 0
-#define BCAST_TOPOLOGY_FILE "topology.txt"
 
 #define BCAST_MAX_LINE_LEN 128
 #define BCAST_MAX_ENTRIES 64
 #define BCAST_MAX_NAME_LEN 64
+#define BCAST_MAX_DESTS (BCAST_MAX_ENTRIES * 2 + 1) /* every link duplicated, and ourselves */
 
 #define MINIMSG_PORT 8086
 
+/* deliver packets addressed to ourselves in memory instead of through UDP */
+#define NETWORK_LOOPBACK_FASTPATH 1
+
 #define NETWORK_INTERRUPT_TYPE 2
 
+#define SIM_MAX_LINKS 64
+#define SIM_REORDER_EXTRA_MS 100 /* how much longer a reordered packet is held */
+
 /*******************************************************************************
 *  Private types and functions                                                 *
 *******************************************************************************/
@@ -55,6 +65,11 @@ typedef struct {
 
 bcast_t topology;
 
+/* broadcast settings, see network_enable_broadcast */
+static bool bcast_enabled = false;
+static const char* bcast_topology_file = NULL; /* NULL to use BCAST_ADDRESS */
+static bool bcast_loopback = false;
+
 short my_udp_port = MINIMSG_PORT;
 short other_udp_port = MINIMSG_PORT;
 
@@ -62,6 +77,34 @@ double loss_rate = 0.0;
 double duplication_rate = 0.0;
 bool synthetic_network = false;
 
+/* state of the simulated link towards one destination */
+typedef struct {
+  network_address_t dest;
+  double tokens;              /* token bucket level in bytes, negative when backlogged */
+  uint64_t last_refill_us;    /* when the bucket was last topped up */
+  uint64_t last_delivery_us;  /* delivery time of the newest in-order packet */
+} sim_link_t;
+
+/* a packet sitting in a simulated link's delay queue */
+typedef struct {
+  network_address_t dest;
+  bool in_order;              /* counted in sim_in_order */
+  int size;
+  char pkt[MAX_NETWORK_PKT_SIZE];
+} sim_pkt_t;
+
+static network_sim_params_t sim_params;
+static sim_link_t sim_links[SIM_MAX_LINKS];
+static int sim_n_links = 0;
+
+/* packets whose delay is over, handed by the alarm handler to sim_delivery */
+static queue_t* sim_due_queue = NULL;
+static semaphore_t* sim_due_count = NULL;
+/* in-order packets on their way, in the delay queues or being delivered;
+ * a due packet may only skip the delay queue when there are none, or it
+ * would overtake them */
+static int sim_in_order = 0;
+
 
 struct address_info {
   int sock;
@@ -72,11 +115,37 @@ struct address_info {
 struct address_info if_info;
 static network_address_t broadcast_addr = { 0 };
 
+/* our own address, resolved once by network_initialize */
+static network_address_t my_cached_addr = { 0 };
+static bool my_addr_cached = false;
+
+/* the handler given to network_initialize, called by network_receive */
+static network_handler_t user_network_handler = NULL;
+
+/* statistics, registered by network_initialize */
+static portos_stat_t* packets_sent_stat = NULL;
+static portos_stat_t* bytes_sent_stat = NULL;
+static portos_stat_t* packets_received_stat = NULL;
+static portos_stat_t* bytes_received_stat = NULL;
+
+/* packets sent to ourselves, waiting to be handed to the network handler */
+static queue_t* loopback_queue = NULL;
+static bool loopback_draining = false;
+
+/* packets freed by each thread, reused for loopback packets */
+#define PACKET_CACHE_SIZE 8
+static objcache_t* packet_cache = NULL;
+
 /* forward definition */
 void start_network_poll(interrupt_handler_t, int*);
 void network_address_to_sockaddr(const network_address_t addr, struct sockaddr_in* sin);
 void sockaddr_to_network_address(const struct sockaddr_in* sin, network_address_t addr);
 
+void
+network_free_pkt(network_interrupt_arg_t *packet) {
+  objcache_free(packet_cache, packet);
+}
+
 /* zero the address, so as to make it invalid */
 void network_address_blankify(network_address_t addr) {
    addr[0]=addr[1]=0;
@@ -144,24 +213,348 @@ send_pkt(const network_address_t dest_address,
   return cc;
 }
 
+/*
+ * Send the same packet to every address in dests with a single sendmmsg()
+ * call. The header and data are gathered straight from the caller's buffers
+ * through one shared iovec, so nothing is copied per destination.
+ * Returns the number of destinations the packet was sent to, or -1.
+ */
+static int
+send_pkt_fanout(const network_address_t* dests, int n_dests,
+                int hdr_len, const char* hdr,
+                int data_len, const char* data) {
+  struct sockaddr_in sins[BCAST_MAX_DESTS];
+  struct mmsghdr msgs[BCAST_MAX_DESTS];
+  struct iovec iov[2];
+  int pktlen = hdr_len + data_len;
+  int i, sent;
+
+  /* sanity checks */
+  if (hdr_len < 0 || data_len < 0 || pktlen > MAX_NETWORK_PKT_SIZE
+      || n_dests < 0 || n_dests > BCAST_MAX_DESTS)
+    return -1;
+
+  /* the packet is built once and shared by every message */
+  iov[0].iov_base = (void*) hdr;
+  iov[0].iov_len = hdr_len;
+  iov[1].iov_base = (void*) data;
+  iov[1].iov_len = data_len;
+
+  memset(msgs, 0, n_dests * sizeof(struct mmsghdr));
+  for (i=0; i<n_dests; i++) {
+    network_address_to_sockaddr(dests[i], &sins[i]);
+    msgs[i].msg_hdr.msg_name = &sins[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    msgs[i].msg_hdr.msg_iov = iov;
+    msgs[i].msg_hdr.msg_iovlen = 2;
+  }
+
+  /* sendmmsg may stop early, keep going until every message is out */
+  for (sent=0; sent<n_dests; ) {
+    int cc = sendmmsg(if_info.sock, msgs + sent, n_dests - sent, 0);
+    if (cc <= 0)
+      return -1;
+    for (i=sent; i<sent+cc; i++)
+      if (msgs[i].msg_len != pktlen)
+        return -1;
+    sent += cc;
+  }
+
+  return sent;
+}
+
+/*
+ * Hand a packet addressed to ourselves straight to the network handler,
+ * skipping the UDP socket, the polling thread and the interrupt signal.
+ * Packets go through loopback_queue so that a handler which itself sends
+ * to us (e.g. a minisocket ACK) does not re-enter the handler; the
+ * outermost caller drains the queue with interrupts disabled, just as if
+ * the packets had arrived as network interrupts.
+ */
+static int
+loopback_pkt(int hdr_len, const char* hdr, int data_len, const char* data) {
+  network_interrupt_arg_t* packet;
+  interrupt_level_t old_level;
+  int pktlen = hdr_len + data_len;
+
+  /* sanity checks */
+  if (hdr_len < 0 || data_len < 0 || pktlen > MAX_NETWORK_PKT_SIZE)
+    return 0;
+
+  /* the handler is responsible for freeing this, as for polled packets */
+  packet = (network_interrupt_arg_t *) objcache_alloc(packet_cache);
+  if (packet == NULL)
+    return -1;
+
+  memcpy(packet->buffer, hdr, hdr_len);
+  memcpy(packet->buffer + hdr_len, data, data_len);
+  packet->size = pktlen;
+  network_address_copy(my_cached_addr, packet->sender);
+
+  old_level = set_interrupt_level(DISABLED);
+  if (queue_append(loopback_queue, packet) != 0) {
+    set_interrupt_level(old_level);
+    network_free_pkt(packet);
+    return -1;
+  }
+
+  if (!loopback_draining) {
+    loopback_draining = true;
+    while (queue_dequeue(loopback_queue, (void**) &packet) == 0)
+      mini_network_handler(packet);
+    loopback_draining = false;
+  }
+  set_interrupt_level(old_level);
+
+  return pktlen;
+}
+
+/* send the packet through the loopback fast path or the UDP socket */
+static int
+deliver_pkt(const network_address_t dest_address,
+            int hdr_len, const char* hdr,
+            int data_len, const char* data) {
+  if (NETWORK_LOOPBACK_FASTPATH && my_addr_cached
+      && network_address_same(dest_address, my_cached_addr))
+    return loopback_pkt(hdr_len, hdr, data_len, data);
+
+  return send_pkt(dest_address, hdr_len, hdr, data_len, data);
+}
+
+/* find the simulated link towards dest, creating it if needed; NULL if the
+ * table is full */
+static sim_link_t*
+sim_find_link(const network_address_t dest) {
+  sim_link_t* link;
+  int i;
+
+  for (i=0; i<sim_n_links; i++)
+    if (network_address_same(sim_links[i].dest, dest))
+      return &sim_links[i];
+
+  if (sim_n_links == SIM_MAX_LINKS)
+    return NULL;
+
+  link = &sim_links[sim_n_links++];
+  network_address_copy(dest, link->dest);
+  link->tokens = sim_params.burst;
+  link->last_refill_us = currentTimeMicros();
+  link->last_delivery_us = 0;
+  return link;
+}
+
+/* an in-order packet has left its link or was dropped */
+static void
+sim_in_order_done() {
+  interrupt_level_t old_level = set_interrupt_level(DISABLED);
+  sim_in_order--;
+  set_interrupt_level(old_level);
+}
+
+/*
+ * alarm handler releasing a packet from a link's delay queue. It runs in the
+ * clock interrupt, so the packet is sent by sim_delivery instead: sendto()
+ * and the network handler do not belong in there.
+ */
+static void
+sim_deliver_handler(void* arg) {
+  if (queue_append(sim_due_queue, arg) != 0) {
+    if (((sim_pkt_t*) arg)->in_order)
+      sim_in_order_done();
+    free(arg);
+    return;
+  }
+  semaphore_V(sim_due_count);
+}
+
+/* thread sending the packets released from the delay queues, in order */
+static int
+sim_delivery(int* arg) {
+  sim_pkt_t* p;
+  interrupt_level_t old_level;
+
+  while (1) {
+    semaphore_P(sim_due_count);
+    old_level = set_interrupt_level(DISABLED);
+    queue_dequeue(sim_due_queue, (void**) &p);
+    set_interrupt_level(old_level);
+
+    deliver_pkt(p->dest, p->size, p->pkt, 0, NULL);
+    if (p->in_order)
+      sim_in_order_done();
+    free(p);
+  }
+  return 0;
+}
+
+/* start sim_delivery, once the system runs; returns 0, or -1 on failure */
+static int
+sim_start_delivery() {
+  minithread_attr_t attrs;
+  minithread_t* t;
+
+  if (sim_due_queue != NULL)
+    return 0;
+
+  sim_due_queue = queue_new();
+  sim_due_count = semaphore_create();
+  if (sim_due_queue == NULL || sim_due_count == NULL)
+    return -1;
+  semaphore_initialize(sim_due_count, 0);
+
+  minithread_attr_init(&attrs);
+  attrs.name = "sim-delivery";
+  t = minithread_create_with_attrs(sim_delivery, NULL, &attrs);
+  if (t == NULL)
+    return -1;
+  minithread_start(t);
+  return 0;
+}
+
+/*
+ * Work out when the packet leaves the simulated link and either deliver it
+ * now or park it in the delay queue. Link times are in microseconds of
+ * currentTimeMicros(), the clock the alarms use, so packets leave in the
+ * order of their delivery times. Returns 0, or -1 on failure.
+ */
+static int
+sim_schedule_pkt(const network_address_t dest_address,
+                 int hdr_len, const char* hdr,
+                 int data_len, const char* data) {
+  sim_link_t* link;
+  sim_pkt_t* p;
+  uint64_t now, deliver_at;
+  int pktlen = hdr_len + data_len;
+  uint64_t delay;
+  bool reorder;
+  int result;
+  interrupt_level_t old_level;
+
+  /* the alarm is registered in the critical section below, so that packets
+   * due at the same time are queued in the order they were sent */
+  p = (sim_pkt_t*) malloc(sizeof(sim_pkt_t));
+  if (p == NULL)
+    return -1;
+  network_address_copy(dest_address, p->dest);
+  memcpy(p->pkt, hdr, hdr_len);
+  memcpy(p->pkt + hdr_len, data, data_len);
+  p->size = pktlen;
+
+  old_level = set_interrupt_level(DISABLED);
+  link = sim_find_link(dest_address);
+  if (link == NULL) { /* no room for a link towards a new host */
+    set_interrupt_level(old_level);
+    free(p);
+    return -1;
+  }
+  now = currentTimeMicros();
+
+  /* token bucket: refill for the time that passed, then pay for the packet */
+  delay = 0;
+  if (sim_params.bandwidth > 0) {
+    link->tokens += (double) (now - link->last_refill_us) * sim_params.bandwidth / 1000000;
+    if (link->tokens > sim_params.burst)
+      link->tokens = sim_params.burst;
+    link->last_refill_us = now;
+
+    if (link->tokens < pktlen) { /* wait until the bucket holds enough tokens */
+      delay = (uint64_t) ((pktlen - link->tokens) * 1000000 / sim_params.bandwidth);
+      if (delay > (uint64_t) sim_params.max_queue_ms * 1000) { /* queue is full, tail drop */
+        set_interrupt_level(old_level);
+        free(p);
+        return 0;
+      }
+    }
+    link->tokens -= pktlen;
+  }
+
+  /* propagation delay plus jitter */
+  delay += (uint64_t) sim_params.delay_ms * 1000;
+  if (sim_params.jitter_ms > 0)
+    delay += (uint64_t) (genrand() * sim_params.jitter_ms * 1000);
+
+  /* in-order packets never leave before the ones ahead of them, a reordered
+   * packet is held back and does not hold up the packets behind it */
+  reorder = sim_params.reorder_rate > 0 && genrand() < sim_params.reorder_rate;
+  deliver_at = now + delay;
+  if (reorder)
+    deliver_at += (uint64_t) (sim_params.delay_ms + sim_params.jitter_ms + SIM_REORDER_EXTRA_MS) * 1000;
+  else {
+    if (deliver_at < link->last_delivery_us)
+      deliver_at = link->last_delivery_us;
+    link->last_delivery_us = deliver_at;
+  }
+
+  /* a due packet skips the delay queue unless in-order packets are still on
+   * their way; it counts as on its way itself until it is delivered */
+  p->in_order = !reorder;
+  if (deliver_at <= now && sim_in_order == 0) {
+    sim_in_order++;
+    set_interrupt_level(old_level);
+    result = deliver_pkt(p->dest, p->size, p->pkt, 0, NULL);
+    free(p);
+    sim_in_order_done();
+    return result == -1 ? -1 : 0;
+  }
+
+  if (register_alarm_at(deliver_at, sim_deliver_handler, p) == NULL) {
+    set_interrupt_level(old_level);
+    free(p);
+    return -1;
+  }
+  if (p->in_order)
+    sim_in_order++;
+  set_interrupt_level(old_level);
+  return 0;
+}
+
+/* counts a received packet and hands it to the handler of the system */
+static void
+network_receive(void* arg) {
+  network_interrupt_arg_t* packet = (network_interrupt_arg_t*) arg;
+
+  portos_stats_add(packets_received_stat, 1);
+  portos_stats_add(bytes_received_stat, packet->size);
+  user_network_handler(packet);
+}
+
 int 
 network_send_pkt(const network_address_t dest_address, int hdr_len, 
                  const char* hdr, int data_len, const char* data) {
 
+  /* sanity checks */
+  if (hdr_len < 0 || data_len < 0 || hdr_len + data_len > MAX_NETWORK_PKT_SIZE)
+    return -1;
+
+  /* counted when handed to the network, lost or not */
+  portos_stats_add(packets_sent_stat, 1);
+  portos_stats_add(bytes_sent_stat, hdr_len + data_len);
+
   if (synthetic_network) {
     if(genrand() < loss_rate)
       return (hdr_len+data_len);
 
     if(genrand() < duplication_rate)
-      send_pkt(dest_address, hdr_len, hdr, data_len, data);
+      sim_schedule_pkt(dest_address, hdr_len, hdr, data_len, data);
+
+    if (sim_schedule_pkt(dest_address, hdr_len, hdr, data_len, data) == -1)
+      return -1;
+    return (hdr_len+data_len);
   }
 
-  return send_pkt(dest_address, hdr_len, hdr, data_len, data);
+  return deliver_pkt(dest_address, hdr_len, hdr, data_len, data);
 }
 
 void
 network_get_my_address(network_address_t my_address) {
   char hostname[64];
+
+  /* the address cannot change once the network is up, skip the lookup */
+  if (my_addr_cached) {
+    network_address_copy(my_cached_addr, my_address);
+    return;
+  }
+
   assert(gethostname(hostname, 64) == 0);
   network_translate_hostname(hostname, my_address);
   my_address[1] = htons(my_udp_port);
@@ -239,15 +632,59 @@ network_udp_ports(short myportnum, short otherportnum) {
   other_udp_port = otherportnum;
 }
 
+int
+network_enable_broadcast(const char* topology_file, int loopback) {
+  if (my_addr_cached)
+    return -1; /* the network is up already */
+
+  bcast_enabled = true;
+  bcast_topology_file = topology_file;
+  bcast_loopback = loopback;
+  return 0;
+}
+
 void
-network_synthetic_params(double loss, double duplication) {
+network_simulated_link(const network_sim_params_t* params) {
+  interrupt_level_t old_level = set_interrupt_level(DISABLED);
+
+  if (params == NULL) {
+    synthetic_network = false;
+    loss_rate = duplication_rate = 0.0;
+    set_interrupt_level(old_level);
+    return;
+  }
+
+  sim_params = *params;
+  if (sim_params.burst < MAX_NETWORK_PKT_SIZE)
+    sim_params.burst = MAX_NETWORK_PKT_SIZE; /* the bucket must fit one packet */
+  if (sim_params.max_queue_ms <= 0)
+    sim_params.max_queue_ms = 1000;
+  if (sim_params.seed != 0)
+    sgenrand(sim_params.seed);
+
+  sim_n_links = 0; /* start every link afresh */
+  loss_rate = sim_params.loss_rate;
+  duplication_rate = sim_params.duplication_rate;
   synthetic_network = true;
-  loss_rate = loss;
-  duplication_rate = duplication;
+  set_interrupt_level(old_level);
+
+  /* before the system runs, network_initialize starts it */
+  if (my_addr_cached)
+    AbortOnCondition(sim_start_delivery() == -1, "Failed to start the simulated link in network_simulated_link()");
 }
 
 void
-bcast_initialize(char* configfile, bcast_t* bcast) {
+network_synthetic_params(double loss, double duplication) {
+  network_sim_params_t params;
+
+  memset(&params, 0, sizeof(params));
+  params.loss_rate = loss;
+  params.duplication_rate = duplication;
+  network_simulated_link(&params);
+}
+
+void
+bcast_initialize(const char* configfile, bcast_t* bcast) {
   FILE* config = fopen(configfile, "r");
   char line[BCAST_MAX_LINE_LEN];
   int i = 0;
@@ -255,12 +692,14 @@ bcast_initialize(char* configfile, bcast_t* bcast) {
   network_address_t my_addr;
   unsigned int my_ip_addr;
 
+  AbortOnCondition(config == NULL, "Error: cannot open the broadcast topology file.");
   network_get_my_address(my_addr);
   my_ip_addr = my_addr[0];
 
   while ((rv = fgets(line, BCAST_MAX_LINE_LEN, config)) != NULL) {
     if (line[0] == '\r' || line[0] == '\n')
       break;
+    AbortOnCondition(i == BCAST_MAX_ENTRIES, "Error: too many hosts in the broadcast topology.");
         line[strlen(line)-1] = '\0';
     strcpy(bcast->entries[i].name, line);
     bcast->entries[i].n_links = 0;
@@ -357,17 +796,20 @@ bcast_remove_link(bcast_t* bcast, char* src, char* dest) {
 }
 
 int
-network_bcast_pkt(int hdr_len, char* hdr, int data_len, char* data) {
+network_bcast_pkt(int hdr_len, const char* hdr, int data_len, const char* data) {
+  network_address_t dests[BCAST_MAX_DESTS];
+  int n_dests = 0;
   int i;
   int me;
 
-  AbortOnCondition(!BCAST_ENABLED,
-                   "Error: network broadcast not enabled.");
+  if (!bcast_enabled)
+    return -1;
   
-  if (BCAST_USE_TOPOLOGY_FILE){
+  if (bcast_topology_file != NULL){
 
     me = topology.me;
     
+    /* collect the neighbours first, so the packet goes out in one batch */
     for (i=0; i<topology.entries[me].n_links; i++) {
       int dest = topology.entries[me].links[i];
       
@@ -376,19 +818,17 @@ network_bcast_pkt(int hdr_len, char* hdr, int data_len, char* data) {
           continue;
         
         if(genrand() < duplication_rate)
-          send_pkt(topology.entries[dest].addr, hdr_len, hdr, data_len, data);
+          network_address_copy(topology.entries[dest].addr, dests[n_dests++]);
       }
       
-      if (send_pkt(topology.entries[dest].addr, 
-                   hdr_len, hdr, data_len, data) != hdr_len + data_len)
-        return -1;
+      network_address_copy(topology.entries[dest].addr, dests[n_dests++]);
     }
 
-    if (BCAST_LOOPBACK) {
-      if (send_pkt(topology.entries[me].addr, 
-                   hdr_len, hdr, data_len, data) != hdr_len + data_len)
-        return -1;
-    }
+    if (bcast_loopback)
+      network_address_copy(topology.entries[me].addr, dests[n_dests++]);
+
+    if (send_pkt_fanout(dests, n_dests, hdr_len, hdr, data_len, data) != n_dests)
+      return -1;
   
   } else { /* real broadcast */
 
@@ -486,7 +926,12 @@ void start_network_poll(interrupt_handler_t network_handler, int* s) {
 int
 network_initialize(network_handler_t network_handler) {
   int arg = 1;
-  mini_network_handler=(interrupt_handler_t) network_handler;
+  user_network_handler = network_handler;
+  mini_network_handler = network_receive;
+  packets_sent_stat = portos_stats_counter("network", "packets_sent");
+  bytes_sent_stat = portos_stats_counter("network", "bytes_sent");
+  packets_received_stat = portos_stats_counter("network", "packets_received");
+  bytes_received_stat = portos_stats_counter("network", "bytes_received");
 
   memset(&if_info, 0, sizeof(if_info));
   
@@ -511,8 +956,30 @@ network_initialize(network_handler_t network_handler) {
   assert(setsockopt(if_info.sock, SOL_SOCKET, SO_REUSEADDR, 
                     (char *) &arg, sizeof(int)) == 0);
 
-  if (BCAST_ENABLED)
-    bcast_initialize(BCAST_TOPOLOGY_FILE, &topology);
+  if (bcast_enabled) {
+    if (bcast_topology_file != NULL)
+      bcast_initialize(bcast_topology_file, &topology);
+    else {
+      /* real broadcast needs the broadcast address and permission to use it */
+      network_translate_hostname(BCAST_ADDRESS, broadcast_addr);
+      assert(setsockopt(if_info.sock, SOL_SOCKET, SO_BROADCAST,
+                        (char *) &arg, sizeof(int)) == 0);
+    }
+  }
+
+  loopback_queue = queue_new();
+  if (loopback_queue == NULL)
+    return -1;
+
+  packet_cache = objcache_create(sizeof(network_interrupt_arg_t), PACKET_CACHE_SIZE);
+  if (packet_cache == NULL)
+    return -1;
+
+  network_get_my_address(my_cached_addr);
+  my_addr_cached = true;
+
+  if (synthetic_network && sim_start_delivery() == -1)
+    return -1;
 
   /*
    * Interrupts are handled through the caller's handler.
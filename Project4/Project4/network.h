@@ -27,9 +27,16 @@ typedef struct {
 } network_interrupt_arg_t;
 
 /* the type of an interrupt handler.  These functions are responsible for freeing
- * the argument that is passed in */
+ * the argument that is passed in, with network_free_pkt() */
 typedef void (*network_handler_t)(network_interrupt_arg_t *arg);
 
+/*
+ * network_free_pkt releases a packet that was passed to the network handler.
+ * Each thread keeps a few of the packets it frees, to reuse for the packets
+ * it sends to its own address.
+ */
+void network_free_pkt(network_interrupt_arg_t *packet);
+
 /*
  * network_initialize should be called before clock interrupts start
  * happening (or with clock interrupts disabled).  The initialization
@@ -51,6 +58,72 @@ int network_initialize(network_handler_t network_handler);
  */
 void network_udp_ports(short myportnum, short otherportnum);
 
+/*
+ * Broadcast is off unless this is called before network_initialize (that
+ * is, before minithread_system_initialize). With a topology_file,
+ * network_bcast_pkt sends to the neighbours listed in it: one host name
+ * per line, a blank line, then one line per host with a character per
+ * host, '.' meaning no link from the line's host to that one. Without a
+ * file (NULL) it sends to the subnet broadcast address. If loopback is
+ * set, a topology broadcast also goes to ourselves. Returns 0, or -1 if
+ * the network is already up.
+ */
+int network_enable_broadcast(const char* topology_file, int loopback);
+
+
+/*******************************************************************************
+*  Simulated network conditions                                                *
+*******************************************************************************/
+
+/*
+ * Parameters of the simulated link placed under network_send_pkt. Every
+ * destination gets its own link with its own delay queue and token bucket;
+ * there are links towards 64 hosts at most, and network_send_pkt fails for
+ * the others.
+ *
+ *  loss_rate, duplication_rate, reorder_rate:
+ *      probability in [0,1] that a packet is dropped, sent twice, or held
+ *      back long enough for the packets behind it to overtake it.
+ *  delay_ms, jitter_ms:
+ *      one-way latency; each packet is delayed by delay_ms plus a uniform
+ *      random amount in [0, jitter_ms]. Delayed packets are released by the
+ *      alarm subsystem, so the delay is rounded to whole clock ticks, and
+ *      sent by a thread of the network layer.
+ *  bandwidth:
+ *      link capacity in bytes per second (0 = unlimited). Packets that find
+ *      the token bucket empty wait for it to refill; packets that would wait
+ *      longer than max_queue_ms are dropped.
+ *  burst:
+ *      depth of the token bucket in bytes.
+ *  seed:
+ *      seed for the random number generator (non-zero), so a run with the
+ *      same sequence of sends makes the same loss/duplication/reordering and
+ *      jitter decisions and can be replayed exactly.
+ */
+typedef struct {
+    double loss_rate;
+    double duplication_rate;
+    double reorder_rate;
+    int delay_ms;
+    int jitter_ms;
+    int bandwidth;
+    int burst;
+    int max_queue_ms;
+    unsigned long seed;
+} network_sim_params_t;
+
+/*
+ * Turn on the simulated link with the given parameters. Should be called
+ * after network_initialize. Pass NULL to turn the simulation off again.
+ */
+void network_simulated_link(const network_sim_params_t* params);
+
+/*
+ * Shorthand for a simulated link that only drops and duplicates packets,
+ * with no delay, reordering or bandwidth cap.
+ */
+void network_synthetic_params(double loss, double duplication);
+
 
 /*******************************************************************************
 *  Functions for sending packets                                               *
@@ -66,6 +139,21 @@ network_send_pkt(const network_address_t dest_address,
 		 int  data_len, const char * data);
 
 
+/*
+ * network_bcast_pkt sends one packet to every neighbour in the broadcast
+ * topology (or to the broadcast address when no topology file is used).
+ * The packet is built once and handed to the kernel in a single batch.
+ * Returns the number of bytes in the packet, or -1 on failure or if
+ * broadcast was not enabled with network_enable_broadcast.
+ */
+int
+network_bcast_pkt(int hdr_len, const char* hdr, int data_len, const char* data);
+
+/* add or remove a directed link src -> dest in the broadcast topology */
+void network_add_bcast_link(char* src, char* dest);
+void network_remove_bcast_link(char* src, char* dest);
+
+
 /*******************************************************************************
 *  Functions for working with network addresses                                *
 *******************************************************************************/
@@ -0,0 +1,125 @@
+/*
+ * Implementation of the per-thread object caches.
+ */
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "defs.h"
+#include "objcache.h"
+#include "minithread.h"
+#include "interrupts.h"
+
+struct objcache {
+	size_t objectSize;		//size of the objects, at least a pointer
+	int maxCached;			//# of freed objects a thread keeps at most
+	minithread_key_t key;	//each thread's objcache_list_t
+	void* shared;			//objects freed with interrupts disabled, linked through their first bytes
+	int sharedLength;
+};
+
+// the freed objects a thread keeps, linked through their first bytes
+typedef struct objcache_list {
+	void* head;
+	int length;
+} objcache_list_t;
+
+// destructor of the key, frees the list of a finishing thread
+static void free_list(void* value)
+{
+	objcache_list_t* list = (objcache_list_t*)value;
+	while (list->head != NULL) {
+		void* object = list->head;
+		list->head = *(void**)object;
+		free(object);
+	}
+	free(list);
+}
+
+// This function returns the caller's list, creating it if need be; NULL if there is none. Only the running thread
+// touches its list, and only with interrupts enabled: network handlers, which run on the stack of the thread they
+// interrupted, use the shared list instead, so the list needs no masking of interrupts.
+static objcache_list_t* own_list(objcache_t* cache)
+{
+	objcache_list_t* list = minithread_getspecific(cache->key);
+	if (list != NULL) return list;
+
+	list = malloc(sizeof(objcache_list_t));
+	if (list == NULL) return NULL;
+	list->head = NULL;
+	list->length = 0;
+	if (minithread_setspecific(cache->key, list) != 0) { //no thread is running yet
+		free(list);
+		return NULL;
+	}
+	return list;
+}
+
+objcache_t* objcache_create(size_t objectSize, int maxCached)
+{
+	if (maxCached < 0) return NULL;
+
+	objcache_t* cache = malloc(sizeof(objcache_t));
+	if (cache == NULL) return NULL;
+
+	cache->objectSize = (objectSize < sizeof(void*)) ? sizeof(void*) : objectSize;
+	cache->maxCached = maxCached;
+	cache->shared = NULL;
+	cache->sharedLength = 0;
+	if (minithread_key_create(&cache->key, free_list) != 0) {
+		free(cache);
+		return NULL;
+	}
+	return cache;
+}
+
+void* objcache_alloc(objcache_t* cache)
+{
+	assert(cache != NULL);
+
+	void* object = NULL;
+	objcache_list_t* list = (interrupt_level == ENABLED) ? own_list(cache) : NULL;
+	if (list != NULL && list->head != NULL) {
+		object = list->head;
+		list->head = *(void**)object;
+		list->length--;
+		return object;
+	}
+
+	// the caller's list is empty, or it is a network handler: take an object freed with interrupts disabled
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	if (cache->shared != NULL) {
+		object = cache->shared;
+		cache->shared = *(void**)object;
+		cache->sharedLength--;
+	}
+	set_interrupt_level(old_level);
+
+	if (object == NULL) object = malloc(cache->objectSize);
+	return object;
+}
+
+void objcache_free(objcache_t* cache, void* object)
+{
+	assert(cache != NULL);
+	if (object == NULL) return;
+
+	objcache_list_t* list = (interrupt_level == ENABLED) ? own_list(cache) : NULL;
+	if (list != NULL && list->length < cache->maxCached) {
+		*(void**)object = list->head;
+		list->head = object;
+		list->length++;
+		return;
+	}
+
+	// the caller's list is full, or it is a network handler: keep the object for the next one
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	if (cache->sharedLength < cache->maxCached) {
+		*(void**)object = cache->shared;
+		cache->shared = object;
+		cache->sharedLength++;
+		object = NULL;
+	}
+	set_interrupt_level(old_level);
+
+	free(object);
+}
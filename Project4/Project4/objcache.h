@@ -0,0 +1,45 @@
+/*
+ * objcache.h:
+ *  Per-thread caches of fixed size objects.
+ *
+ *  A cache keeps the objects freed by a thread on a short list of that
+ *  thread (held through a minithread thread-local storage key), and hands
+ *  them out again to the thread's next allocations. Allocating or freeing is
+ *  a pop or a push on the caller's own list, without disabling interrupts.
+ *  Callers with interrupts disabled, network handlers among them, use a
+ *  list shared by all threads instead; so does a thread whose own list is
+ *  empty or full, before malloc() or free() is called. When a thread
+ *  finishes, its lists are freed.
+ *
+ *  Objects are ordinary blocks from malloc(), so an object allocated with
+ *  malloc() may be freed into a cache of its size, and the other way round.
+ */
+#ifndef __OBJCACHE_H__
+#define __OBJCACHE_H__
+
+#include <stddef.h>
+
+typedef struct objcache objcache_t;
+
+/*
+ * objcache_t* objcache_create(size_t objectSize, int maxCached)
+ *  Create a cache of objects of objectSize bytes, where each thread, and
+ *  the shared list, keep up to maxCached freed objects. Uses one
+ *  thread-local storage key, and lives until the program exits. Returns
+ *  NULL on failure.
+ */
+objcache_t* objcache_create(size_t objectSize, int maxCached);
+
+/*
+ * void* objcache_alloc(objcache_t* cache)
+ *  Allocate an object, NULL if out of memory. Its contents are undefined.
+ */
+void* objcache_alloc(objcache_t* cache);
+
+/*
+ * objcache_free(objcache_t* cache, void* object)
+ *  Free an object of the cache's size; NULL is ignored.
+ */
+void objcache_free(objcache_t* cache, void* object);
+
+#endif /*__OBJCACHE_H__*/
@@ -0,0 +1,115 @@
+/* pingpong.c
+
+   Measures the round trip time between two threads that pass a token back
+   and forth through two semaphores, while batch threads keep the processor
+   busy. Without handoff, the thread a V wakes up is queued behind the batch
+   threads; with handoff, V switches to it right away (see
+   semaphore_set_handoff()).
+
+   USAGE: ./pingpong [mlfq|round-robin|lottery|stride|edf] [queue|handoff]
+
+   To compare:
+
+     for s in mlfq round-robin; do ./pingpong $s queue; ./pingpong $s handoff; done
+*/
+
+#include "minithread.h"
+#include "scheduler.h"
+#include "synch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_BATCH 3
+#define RUN_MS 3000
+
+const sched_ops_t* schedulers[] = { &sched_mlfq, &sched_round_robin, &sched_lottery, &sched_stride, &sched_edf };
+
+semaphore_t* ping;
+semaphore_t* pong;
+semaphore_t* done;
+volatile int stop = 0;
+int handoff = 0;
+minithread_t* ponger_thread;
+
+unsigned long long batch_iterations = 0;
+
+int batch(int* arg) {
+  while (!stop) batch_iterations++;
+  semaphore_V(done);
+  return 0;
+}
+
+int ponger(int* arg) {
+  ponger_thread = minithread_self();
+  while (1) {
+    semaphore_P(pong);
+    semaphore_V(ping);
+  }
+  return 0;
+}
+
+int main_thread(int* arg) {
+  ping = semaphore_create();
+  pong = semaphore_create();
+  done = semaphore_create();
+  semaphore_initialize(ping, 0);
+  semaphore_initialize(pong, 0);
+  semaphore_initialize(done, 0);
+  semaphore_set_handoff(ping, handoff);
+  semaphore_set_handoff(pong, handoff);
+
+  minithread_fork(ponger, NULL);
+  for (int i = 0; i < NUM_BATCH; i++) minithread_fork(batch, NULL);
+
+  unsigned int round_trips = 0;
+  unsigned long long max_us = 0;
+  unsigned long long start = currentTimeMicros();
+  while (currentTimeMicros() - start < RUN_MS * 1000ULL) {
+    unsigned long long sent = currentTimeMicros();
+    semaphore_V(pong);
+    semaphore_P(ping);
+    unsigned long long rtt = currentTimeMicros() - sent;
+    if (rtt > max_us) max_us = rtt;
+    round_trips++;
+  }
+  unsigned long long elapsed = currentTimeMicros() - start;
+
+  stop = 1;
+  for (int i = 0; i < NUM_BATCH; i++) semaphore_P(done);
+
+  minithread_stats_t stats, ponger_stats;
+  minithread_get_stats(NULL, &stats);
+  minithread_get_stats(ponger_thread, &ponger_stats);
+  printf("%-12s %-8s %u round trips, avg %llu us, max %llu us; %u handoffs; batch %llu Kiter/s\n",
+	 (char*)arg, handoff ? "handoff" : "queue", round_trips,
+	 (round_trips > 0) ? elapsed / round_trips : 0ULL, max_us, stats.handoffs + ponger_stats.handoffs,
+	 batch_iterations / (elapsed / 1000));
+
+  exit(0); // the ponger never stops, end the process
+}
+
+int main(int argc, char** argv) {
+  const sched_ops_t* scheduler = &sched_mlfq;
+  if (argc > 1) {
+    scheduler = NULL;
+    for (int i = 0; i < sizeof(schedulers) / sizeof(schedulers[0]); i++) {
+      if (strcmp(argv[1], schedulers[i]->name) == 0) scheduler = schedulers[i];
+    }
+    if (scheduler == NULL) {
+      printf("Unknown scheduler %s.\n", argv[1]);
+      return -1;
+    }
+  }
+
+  if (argc > 2 && strcmp(argv[2], "handoff") == 0) handoff = 1;
+  else if (argc > 2 && strcmp(argv[2], "queue") != 0) {
+    printf("Unknown mode %s.\n", argv[2]);
+    return -1;
+  }
+
+  minithread_set_scheduler(scheduler);
+  minithread_system_initialize(main_thread, (int*)scheduler->name);
+  return -1;
+}
@@ -0,0 +1,77 @@
+/* pool.c
+
+   Thread pools. Calls are submitted to a pool of a few workers with a
+   small queue, so that submitting blocks until workers catch up: first
+   one at a time, then as a batch, each returning the square of its
+   argument through a future. Calls submitted without a future count
+   themselves. Destroying the pool must wait for every queued call.
+
+   USAGE: ./pool
+*/
+
+#include "minithread.h"
+#include "threadpool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_WORKERS 3
+#define CAPACITY 4
+#define NUM_CALLS 50
+
+int counted = 0;
+
+int square(int* arg) {
+  int n = *arg;
+  if (n % 2 == 0) minithread_yield(); // let calls finish out of order
+  return n * n;
+}
+
+int count(int* arg) {
+  minithread_yield();
+  counted++;
+  return 0;
+}
+
+int main_thread(int* arg) {
+  static int numbers[NUM_CALLS];
+  static arg_t args[NUM_CALLS];
+  minithread_future_t* futures[NUM_CALLS];
+  int errors = 0;
+
+  minithread_pool_t* pool = minithread_pool_create(NUM_WORKERS, CAPACITY);
+  if (pool == NULL) {
+    printf("ERROR: could not create the pool.\n");
+    exit(-1);
+  }
+  for (int i = 0; i < NUM_CALLS; i++) {
+    numbers[i] = i;
+    args[i] = &numbers[i];
+  }
+
+  for (int i = 0; i < NUM_CALLS; i++) {
+    if (minithread_pool_submit(pool, square, args[i], &futures[i]) != 0) errors++;
+  }
+  for (int i = NUM_CALLS - 1; i >= 0; i--) { // most are done by now
+    if (minithread_future_wait(futures[i]) != i * i) errors++;
+  }
+
+  if (minithread_pool_submit_batch(pool, square, args, NUM_CALLS, futures) != 0) errors++;
+  for (int i = 0; i < NUM_CALLS; i++) {
+    if (minithread_future_wait(futures[i]) != i * i) errors++;
+  }
+  printf("%d calls returned through futures, %d errors.\n", 2 * NUM_CALLS, errors);
+
+  minithread_pool_submit_batch(pool, count, args, NUM_CALLS, NULL);
+  minithread_pool_destroy(pool);
+  printf("%d of %d calls without futures ran before the pool was destroyed.\n", counted, NUM_CALLS);
+
+  if (minithread_pool_create(0, CAPACITY) != NULL || minithread_pool_submit(NULL, square, NULL, NULL) != -1) errors++;
+  printf((counted == NUM_CALLS && errors == 0) ? "Thread pools work.\n" : "FAILED.\n");
+  exit(0); // the system never stops on its own
+}
+
+int main(int argc, char** argv) {
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}
@@ -0,0 +1,272 @@
+/*
+ * Implementation of the statistics registry.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "portos_stats.h"
+#include "minithread.h"
+#include "interrupts.h"
+
+#define HISTOGRAM_BUCKETS 65	//bucket 0 counts the zeros, bucket b > 0 the values from 2^(b-1) to 2^b - 1
+#define STAT_LINE_MAX 160			//longest line of a statistic
+
+struct portos_stat {
+	char subsystem[PORTOS_STATS_NAME_MAX];
+	char name[PORTOS_STATS_NAME_MAX];
+	portos_stat_kind_t kind;
+	portos_stat_read_t read;	//reads a counter or gauge, NULL if it holds its value
+	void* arg;
+	long long value;			//value of a counter or gauge
+	unsigned long long count;	//# of values recorded in a histogram
+	unsigned long long sum;
+	unsigned long long min;
+	unsigned long long max;
+	unsigned long long buckets[HISTOGRAM_BUCKETS];
+};
+
+portos_stat_t g_stats[PORTOS_STATS_MAX]; //the registry, in the order the statistics were registered
+int g_numStats = 0; //# of entries of g_stats in use
+
+minithread_t* g_statsReporter = NULL; //thread started by portos_stats_start_reporter(), NULL until then
+int g_statsReportMs = 0; //its period
+
+// This function returns the bucket of a histogram value
+static int bucket_of(unsigned long long value)
+{
+	return (value == 0) ? 0 : 64 - __builtin_clzll(value);
+}
+
+// This function returns the largest value of a bucket
+static unsigned long long bucket_limit(int bucket)
+{
+	return (bucket == 64) ? ~0ULL : (1ULL << bucket) - 1;
+}
+
+// This function returns the statistic subsystem.name, NULL if none. Caller must disable interrupts.
+static portos_stat_t* find(const char* subsystem, const char* name)
+{
+	for (int i = 0; i < g_numStats; i++) {
+		if (strncmp(g_stats[i].subsystem, subsystem, PORTOS_STATS_NAME_MAX - 1) == 0 && strncmp(g_stats[i].name, name, PORTOS_STATS_NAME_MAX - 1) == 0) return &g_stats[i];
+	}
+	return NULL;
+}
+
+// This function returns the given percentile of a histogram, interpolated within its bucket as if the values there were
+// spread evenly between the bucket's limits, narrowed to the smallest and largest values recorded. Caller must disable
+// interrupts.
+static unsigned long long percentile(const portos_stat_t* stat, int percent)
+{
+	if (stat->count == 0) return 0;
+
+	unsigned long long rank = (stat->count * percent + 99) / 100; //rank of the value, from 1
+	if (rank == 0) rank = 1;
+	unsigned long long seen = 0;
+	for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+		if (seen + stat->buckets[b] < rank) {
+			seen += stat->buckets[b];
+			continue;
+		}
+		unsigned long long low = (b == 0) ? 0 : bucket_limit(b - 1) + 1;
+		unsigned long long high = bucket_limit(b);
+		if (low < stat->min) low = stat->min;
+		if (high > stat->max) high = stat->max;
+		return low + (unsigned long long)((double)(high - low) * (rank - seen) / stat->buckets[b]);
+	}
+	return stat->max;
+}
+
+// This function writes the line of a statistic into line, which holds STAT_LINE_MAX characters. The statistic is read with
+// interrupts disabled, so that the line is consistent, and formatted after.
+static void format_stat(portos_stat_t* stat, char* line)
+{
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	if (stat->kind != PORTOS_STAT_HISTOGRAM) {
+		long long value = (stat->read != NULL) ? stat->read(stat->arg) : stat->value;
+		set_interrupt_level(old_level);
+		snprintf(line, STAT_LINE_MAX, "!$STAT: #%s.%s: %lld\n", stat->subsystem, stat->name, value);
+		return;
+	}
+
+	unsigned long long count = stat->count;
+	unsigned long long avg = (count > 0) ? stat->sum / count : 0;
+	unsigned long long min = stat->min;
+	unsigned long long p50 = percentile(stat, 50);
+	unsigned long long p99 = percentile(stat, 99);
+	unsigned long long max = stat->max;
+	set_interrupt_level(old_level);
+	snprintf(line, STAT_LINE_MAX, "!$STAT: #%s.%s: n=%llu avg=%llu min=%llu p50=%llu p99=%llu max=%llu\n",
+		stat->subsystem, stat->name, count, avg, min, p50, p99, max);
+}
+
+long long portos_stats_read_int(void* arg)
+{
+	return *(int*)arg;
+}
+
+long long portos_stats_read_uint(void* arg)
+{
+	return *(unsigned int*)arg;
+}
+
+long long portos_stats_read_ull(void* arg)
+{
+	return (long long)*(unsigned long long*)arg;
+}
+
+portos_stat_t* portos_stats_register(const char* subsystem, const char* name, portos_stat_kind_t kind, portos_stat_read_t read, void* arg)
+{
+	if (subsystem == NULL || name == NULL) return NULL;
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //the registry is shared by all threads
+	portos_stat_t* stat = find(subsystem, name);
+	if (stat != NULL) {
+		set_interrupt_level(old_level);
+		return (stat->kind == kind) ? stat : NULL;
+	}
+	if (g_numStats == PORTOS_STATS_MAX) {
+		set_interrupt_level(old_level);
+		return NULL;
+	}
+
+	stat = &g_stats[g_numStats++];
+	memset(stat, 0, sizeof(portos_stat_t));
+	strncpy(stat->subsystem, subsystem, PORTOS_STATS_NAME_MAX - 1);
+	strncpy(stat->name, name, PORTOS_STATS_NAME_MAX - 1);
+	stat->kind = kind;
+	if (kind != PORTOS_STAT_HISTOGRAM) {
+		stat->read = read;
+		stat->arg = arg;
+	}
+	set_interrupt_level(old_level);
+	return stat;
+}
+
+portos_stat_t* portos_stats_counter(const char* subsystem, const char* name)
+{
+	return portos_stats_register(subsystem, name, PORTOS_STAT_COUNTER, NULL, NULL);
+}
+
+portos_stat_t* portos_stats_gauge(const char* subsystem, const char* name)
+{
+	return portos_stats_register(subsystem, name, PORTOS_STAT_GAUGE, NULL, NULL);
+}
+
+portos_stat_t* portos_stats_histogram(const char* subsystem, const char* name)
+{
+	return portos_stats_register(subsystem, name, PORTOS_STAT_HISTOGRAM, NULL, NULL);
+}
+
+portos_stat_t* portos_stats_find(const char* subsystem, const char* name)
+{
+	if (subsystem == NULL || name == NULL) return NULL;
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	portos_stat_t* stat = find(subsystem, name);
+	set_interrupt_level(old_level);
+	return stat;
+}
+
+void portos_stats_add(portos_stat_t* stat, long long n)
+{
+	if (stat == NULL) return;
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //an interrupt handler may update it as well
+	stat->value += n;
+	set_interrupt_level(old_level);
+}
+
+void portos_stats_set(portos_stat_t* stat, long long value)
+{
+	if (stat == NULL) return;
+
+	stat->value = value;
+}
+
+void portos_stats_record(portos_stat_t* stat, unsigned long long value)
+{
+	if (stat == NULL) return;
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	if (stat->count == 0 || value < stat->min) stat->min = value;
+	if (value > stat->max) stat->max = value;
+	stat->count++;
+	stat->sum += value;
+	stat->buckets[bucket_of(value)]++;
+	set_interrupt_level(old_level);
+}
+
+long long portos_stats_value(portos_stat_t* stat)
+{
+	AbortOnCondition(stat == NULL, "Null argument stat in portos_stats_value()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	long long value = (stat->kind == PORTOS_STAT_HISTOGRAM) ? (long long)stat->count : (stat->read != NULL) ? stat->read(stat->arg) : stat->value;
+	set_interrupt_level(old_level);
+	return value;
+}
+
+unsigned long long portos_stats_percentile(portos_stat_t* stat, int percent)
+{
+	AbortOnCondition(stat == NULL || stat->kind != PORTOS_STAT_HISTOGRAM || percent < 0 || percent > 100, "Invalid arguments passed to portos_stats_percentile()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	unsigned long long value = percentile(stat, percent);
+	set_interrupt_level(old_level);
+	return value;
+}
+
+void portos_stats_dump()
+{
+	char line[STAT_LINE_MAX];
+	for (int i = 0; i < g_numStats; i++) { //statistics are only ever added, at the end
+		format_stat(&g_stats[i], line);
+		fputs(line, stdout);
+	}
+}
+
+int portos_stats_format(char* buffer, int size)
+{
+	AbortOnCondition(buffer == NULL && size > 0, "Null argument buffer in portos_stats_format()");
+
+	char line[STAT_LINE_MAX];
+	int length = 0;
+	for (int i = 0; i < g_numStats; i++) {
+		format_stat(&g_stats[i], line);
+		int lineLength = strlen(line);
+		if (length + lineLength < size) memcpy(buffer + length, line, lineLength);
+		else if (length < size) memcpy(buffer + length, line, size - 1 - length); //cut where the buffer ends
+		length += lineLength;
+	}
+	if (size > 0) buffer[(length < size) ? length : size - 1] = '\0';
+	return length;
+}
+
+// This function is the body of the reporter thread
+static int stats_reporter(int* arg)
+{
+	while (1) {
+		minithread_sleep_with_timeout(g_statsReportMs);
+		portos_stats_dump();
+	}
+	return 0;
+}
+
+int portos_stats_start_reporter(int periodMs)
+{
+	if (periodMs <= 0) return -1;
+
+	g_statsReportMs = periodMs; //a running reporter picks it up after its current sleep
+	if (g_statsReporter != NULL) return 0;
+
+	minithread_attr_t attrs;
+	minithread_attr_init(&attrs);
+	attrs.name = "stats-reporter";
+	attrs.priority = MINITHREAD_PRIORITIES - 1; //the levels take turns, so it still runs under load
+	g_statsReporter = minithread_create_with_attrs(stats_reporter, NULL, &attrs);
+	if (g_statsReporter == NULL) return -1;
+	minithread_start(g_statsReporter);
+	return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * portos_stats.h:
+ *  A registry of the statistics of PortOS.
+ *
+ *  Each subsystem registers its statistics under its own name: the
+ *  scheduler, alarms, semaphores, network, minimsg and minisocket do so
+ *  when the system starts, and applications may add their own. There are
+ *  three kinds:
+ *
+ *   counters    -- a count that only grows, e.g. packets sent
+ *   gauges      -- a value that goes up and down, e.g. runnable threads
+ *   histograms  -- the distribution of recorded values, e.g. alarm
+ *                  lateness, in power of two buckets
+ *
+ *  A counter or gauge either holds its value, updated through
+ *  portos_stats_add() and portos_stats_set(), or reads it when asked
+ *  through a function of the subsystem, so that existing counters are
+ *  exported at no cost. All of them can be printed at once, formatted
+ *  into a buffer to be sent elsewhere, or printed periodically by a
+ *  reporter thread.
+ */
+#ifndef __PORTOS_STATS_H__
+#define __PORTOS_STATS_H__
+
+#include <stddef.h>
+
+#define PORTOS_STATS_MAX 128		/* # of statistics the registry holds */
+#define PORTOS_STATS_NAME_MAX 32	/* longest subsystem or statistic name, longer ones are cut */
+
+typedef enum { PORTOS_STAT_COUNTER, PORTOS_STAT_GAUGE, PORTOS_STAT_HISTOGRAM } portos_stat_kind_t;
+
+typedef struct portos_stat portos_stat_t;
+
+/*
+ * Reads the value of a counter or gauge, called with interrupts disabled.
+ * It must not block.
+ */
+typedef long long (*portos_stat_read_t)(void* arg);
+
+/*
+ * Readers of a variable of the subsystem, arg being its address.
+ */
+long long portos_stats_read_int(void* arg);
+long long portos_stats_read_uint(void* arg);
+long long portos_stats_read_ull(void* arg);
+
+/*
+ * portos_stat_t* portos_stats_register(const char* subsystem, const char* name,
+ *                                      portos_stat_kind_t kind, portos_stat_read_t read, void* arg)
+ *  Register the statistic subsystem.name, or return it if it exists with
+ *  the same kind. Unless read is NULL, a counter or gauge is read by
+ *  calling read(arg) instead of holding a value. Returns NULL if the
+ *  statistic exists with another kind or if the registry is full; updating
+ *  a NULL statistic does nothing.
+ *
+ * portos_stat_t* portos_stats_counter(const char* subsystem, const char* name)
+ * portos_stat_t* portos_stats_gauge(const char* subsystem, const char* name)
+ * portos_stat_t* portos_stats_histogram(const char* subsystem, const char* name)
+ *  Shorthands for statistics that hold their values.
+ *
+ * portos_stat_t* portos_stats_find(const char* subsystem, const char* name)
+ *  The statistic subsystem.name, NULL if none.
+ */
+portos_stat_t* portos_stats_register(const char* subsystem, const char* name, portos_stat_kind_t kind, portos_stat_read_t read, void* arg);
+portos_stat_t* portos_stats_counter(const char* subsystem, const char* name);
+portos_stat_t* portos_stats_gauge(const char* subsystem, const char* name);
+portos_stat_t* portos_stats_histogram(const char* subsystem, const char* name);
+portos_stat_t* portos_stats_find(const char* subsystem, const char* name);
+
+/*
+ * Updates, which may be made from threads and interrupt handlers alike.
+ *
+ * portos_stats_add(portos_stat_t* stat, long long n)
+ *  Add n to a counter or gauge.
+ *
+ * portos_stats_set(portos_stat_t* stat, long long value)
+ *  Set a gauge.
+ *
+ * portos_stats_record(portos_stat_t* stat, unsigned long long value)
+ *  Record a value in a histogram.
+ */
+void portos_stats_add(portos_stat_t* stat, long long n);
+void portos_stats_set(portos_stat_t* stat, long long value);
+void portos_stats_record(portos_stat_t* stat, unsigned long long value);
+
+/*
+ * long long portos_stats_value(portos_stat_t* stat)
+ *  The value of a counter or gauge, the # of values recorded in a
+ *  histogram.
+ *
+ * unsigned long long portos_stats_percentile(portos_stat_t* stat, int percent)
+ *  An estimate of the given percentile of the values recorded in a
+ *  histogram, 0 if none were recorded. Only the bucket of the percentile is
+ *  known, so the estimate assumes the values in it are spread evenly; it is
+ *  within a factor of two, and between the smallest and largest values.
+ */
+long long portos_stats_value(portos_stat_t* stat);
+unsigned long long portos_stats_percentile(portos_stat_t* stat, int percent);
+
+/*
+ * portos_stats_dump()
+ *  Print every statistic to stdout, a line each, in the order they were
+ *  registered:
+ *   !$STAT: #scheduler.switches: 1234
+ *   !$STAT: #alarm.lateness_us: n=20 avg=310 min=12 p50=298 p99=870 max=900
+ *
+ * int portos_stats_format(char* buffer, int size)
+ *  Write the lines portos_stats_dump() prints into buffer, cut to size - 1
+ *  characters and terminated. Returns the length of all the lines, as
+ *  snprintf() does.
+ */
+void portos_stats_dump();
+int portos_stats_format(char* buffer, int size);
+
+/*
+ * int portos_stats_start_reporter(int periodMs)
+ *  Start a thread of the lowest priority that calls portos_stats_dump()
+ *  every periodMs milliseconds, or change its period if it runs already.
+ *  Returns 0 on success, -1 if periodMs is not positive or if the thread
+ *  cannot be created.
+ */
+int portos_stats_start_reporter(int periodMs);
+
+#endif /*__PORTOS_STATS_H__*/
@@ -0,0 +1,113 @@
+/* priority.c
+
+   Thread priorities and attributes. A thread created with a name, a small
+   stack, a low priority and joinable must have all of them. Then two
+   threads spin for a while with a 1 ms quantum, a batch thread at the
+   lowest priority and an urgent thread at the highest: the urgent thread
+   must get more of the processor, and the batch one must get some. Their
+   priorities are swapped while both are runnable, which must reverse the
+   shares.
+
+   USAGE: ./priority
+*/
+
+#include "minithread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SMALL_STACK (32 * 1024)
+#define SPIN_MS 500
+
+volatile int spinning = 1;
+
+int spin(int* arg) {
+  while (spinning) ;
+  return 0;
+}
+
+int named(int* arg) {
+  minithread_stats_t stats;
+  minithread_get_stats(NULL, &stats);
+  if (strcmp(minithread_name(NULL), "worker") != 0 || minithread_get_priority(NULL) != 2 || stats.stackSize != SMALL_STACK) return -1;
+  return 0;
+}
+
+minithread_t* spinner(const char* name, int priority) {
+  minithread_attr_t attrs;
+  minithread_attr_init(&attrs);
+  attrs.name = name;
+  attrs.priority = priority;
+  attrs.joinable = 1;
+  minithread_t* t = minithread_create_with_attrs(spin, NULL, &attrs);
+  minithread_start(t);
+  return t;
+}
+
+// runs the two spinners for SPIN_MS, returns the processor time each got in *urgentUs and *batchUs
+void race(minithread_t* urgent, minithread_t* batch, unsigned long long* urgentUs, unsigned long long* batchUs) {
+  minithread_stats_t before, after;
+  minithread_get_stats(urgent, &before);
+  *urgentUs = before.runningUs;
+  minithread_get_stats(batch, &before);
+  *batchUs = before.runningUs;
+
+  minithread_sleep_with_timeout(SPIN_MS);
+
+  minithread_get_stats(urgent, &after);
+  *urgentUs = after.runningUs - *urgentUs;
+  minithread_get_stats(batch, &after);
+  *batchUs = after.runningUs - *batchUs;
+}
+
+int main_thread(int* arg) {
+  int errors = 0;
+  minithread_attr_t attrs;
+  int result;
+
+  minithread_attr_init(&attrs);
+  attrs.name = "worker";
+  attrs.stackSize = SMALL_STACK;
+  attrs.priority = 2;
+  attrs.joinable = 1;
+  minithread_t* t = minithread_create_with_attrs(named, NULL, &attrs);
+  minithread_start(t);
+  if (t == NULL || minithread_join(t, &result) != 0 || result != 0) errors++;
+
+  attrs.priority = MINITHREAD_PRIORITIES;
+  if (minithread_create_with_attrs(named, NULL, &attrs) != NULL) errors++;
+  attrs.priority = 0;
+  attrs.affinity = 1; // there is one processor
+  if (minithread_create_with_attrs(named, NULL, &attrs) != NULL) errors++;
+  attrs.affinity = 0;
+  attrs.stackSize = 100;
+  if (minithread_create_with_attrs(named, NULL, &attrs) != NULL) errors++;
+  if (minithread_set_priority(NULL, -1) != -1) errors++;
+  printf("Attributes checked, %d errors.\n", errors);
+
+  unsigned long long urgentUs, batchUs;
+  minithread_t* urgent = spinner("urgent", 0);
+  minithread_t* batch = spinner("batch", MINITHREAD_PRIORITIES - 1);
+  race(urgent, batch, &urgentUs, &batchUs);
+  printf("urgent ran %llu ms, batch ran %llu ms.\n", urgentUs / 1000, batchUs / 1000);
+  if (urgentUs <= batchUs || batchUs == 0) errors++;
+
+  minithread_set_priority(urgent, MINITHREAD_PRIORITIES - 1);
+  minithread_set_priority(batch, 0);
+  race(urgent, batch, &urgentUs, &batchUs);
+  printf("swapped, urgent ran %llu ms, batch ran %llu ms.\n", urgentUs / 1000, batchUs / 1000);
+  if (urgentUs >= batchUs || minithread_get_priority(batch) != 0) errors++;
+
+  spinning = 0;
+  minithread_join(urgent, NULL);
+  minithread_join(batch, NULL);
+  printf((errors == 0) ? "Priorities work.\n" : "FAILED.\n");
+  exit(0); // the system never stops on its own
+}
+
+int main(int argc, char** argv) {
+  minithread_set_quantum(1);
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}
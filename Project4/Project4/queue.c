@@ -128,6 +128,22 @@ int queue_peek(queue_t* queue, void** item) {
 	return 0;
 }
 
+int queue_splice(queue_t* dst, queue_t* src) {
+	if (dst == NULL || src == NULL || dst == src) return -1;
+	if (src->length == 0) return 0; //nothing to move
+
+	//link src's nodes after dst's tail
+	if (dst->length == 0) dst->head = src->head;
+	else dst->tail->next = src->head;
+	dst->tail = src->tail;
+	dst->length += src->length;
+
+	src->head = NULL;
+	src->tail = NULL;
+	src->length = 0;
+	return 0;
+}
+
 int
 queue_iterate(queue_t *queue, func_t f, void* item) {
 	//if queue is empty or null
@@ -155,7 +171,7 @@ queue_free(queue_t *queue) {
 
 //this method frees all the nodes as well as the queue itself (P1 and P3 spec)
 int
-int queue_free_nodes_and_queue(queue_t *queue, void(*free_data)(void*)) {
+queue_free_nodes_and_queue(queue_t *queue, void(*free_data)(void*)) {
 	//if queue is empty or null
 	if (queue == NULL) return 0;
 
@@ -163,7 +179,7 @@ int queue_free_nodes_and_queue(queue_t *queue, void(*free_data)(void*)) {
 	while (curr != NULL)
 	{
 		node_t* tempNext = curr->next;
-		free_data(curr->dataPtr);
+		free_data(curr->itemPtr);
 		free(curr);
 		curr = tempNext;
 	}
@@ -233,7 +249,7 @@ queue_ordered_insert(queue_t* queue, void* item, uint64_t orderVal) {
 	node_t *prev = NULL;
 	node_t *curr = queue->head;
 	// Traverse the queue such that newItem is ordered between prev and curr: prev->newItem->curr
-	while (curr != NULL && newItem->order > curr->order) //while the current node's priority is higher than ours and we haven't reached the end of the queue yet
+	while (curr != NULL && newItem->order >= curr->order) //while the current node's priority is not lower than ours and we haven't reached the end of the queue yet (equal orders keep insertion order)
 	{
 		prev = curr;
 		curr = curr->next;
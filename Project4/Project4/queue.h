@@ -85,4 +85,11 @@ int queue_ordered_insert(queue_t* queue, void* item, uint64_t orderVal);
 */
 int queue_peek(queue_t* queue, void** item);
 
+/*
+* Moves every item of queue src to the end of queue dst, in order, leaving src empty.
+* Takes constant time whatever the lengths.
+* Returns 0 if successful, -1 otherwise
+*/
+int queue_splice(queue_t* dst, queue_t* src);
+
 #endif /*__QUEUE_H__*/
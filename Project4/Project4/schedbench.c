@@ -0,0 +1,236 @@
+/* schedbench.c
+
+   Compares the schedulers on a mix of batch threads, which only compute,
+   and interactive threads, which wait and then handle a short request.
+   Reports the batch throughput, how evenly it was shared, and how long the
+   interactive threads waited for the processor after being woken up.
+
+   USAGE: ./schedbench [mlfq|round-robin|lottery|stride|edf] [sleep|network]
+
+   With "sleep" (the default) the interactive threads sleep between
+   requests. With "network" they are servers waiting for requests on a
+   minimsg port, and a client thread sends them requests in turn over the
+   loopback, each once the reply to the previous one is back; the latency is
+   then the round trip time of a request. The servers first compute for a
+   few ticks, as a thread that did some batch work before turning to
+   serving requests would.
+
+   The interactive threads get three times the tickets of the batch threads
+   and a 50 ms deadline instead of 1 s, which only the lottery, stride and
+   EDF schedulers look at. To compare all of them:
+
+     for s in mlfq round-robin lottery stride edf; do ./schedbench $s; done
+*/
+
+#include "minithread.h"
+#include "minimsg.h"
+#include "scheduler.h"
+#include "synch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_BATCH 3
+#define NUM_INTERACTIVE 3
+#define RUN_MS 5000
+#define SLEEP_MS 100
+#define REQUEST_ITERATIONS 100000
+#define FIRST_PORT 100
+#define WARMUP_TICKS 7
+
+const sched_ops_t* schedulers[] = { &sched_mlfq, &sched_round_robin, &sched_lottery, &sched_stride, &sched_edf };
+
+semaphore_t* done;
+semaphore_t* ready;
+volatile int stop = 0;
+int network = 0;
+
+unsigned long long batch_iterations[NUM_BATCH];
+
+unsigned int requests[NUM_INTERACTIVE];
+unsigned long long total_latency_us[NUM_INTERACTIVE];
+unsigned long long max_latency_us[NUM_INTERACTIVE];
+
+int batch(int* arg) {
+  int id = *arg;
+  while (!stop) batch_iterations[id]++;
+  semaphore_V(done);
+  return 0;
+}
+
+// records the latency of one request of interactive thread id
+void record_request(int id, unsigned long long latency) {
+  total_latency_us[id] += latency;
+  if (latency > max_latency_us[id]) max_latency_us[id] = latency;
+  requests[id]++;
+}
+
+// the work done for a request
+void handle_request() {
+  for (volatile int i = 0; i < REQUEST_ITERATIONS; i++) ;
+}
+
+int interactive(int* arg) {
+  int id = *arg;
+  minithread_stats_t before, after;
+
+  while (!stop) {
+    minithread_get_stats(NULL, &before);
+    minithread_sleep_with_timeout(SLEEP_MS);
+    minithread_get_stats(NULL, &after);
+
+    // the time spent READY across the sleep is how long we waited for the processor once woken up
+    record_request(id, after.readyUs - before.readyUs);
+    handle_request();
+  }
+  semaphore_V(done);
+  return 0;
+}
+
+int server(int* arg) {
+  int id = *arg;
+  miniport_t* port = miniport_create_unbound(FIRST_PORT + id);
+  miniport_t* from;
+  minithread_stats_t stats;
+  unsigned long long sent;
+  int length;
+
+  do {
+    minithread_get_stats(NULL, &stats);
+  } while (stats.ticksRun < WARMUP_TICKS);
+  semaphore_V(ready);
+
+  while (1) {
+    length = sizeof(sent);
+    minimsg_receive(port, &from, (char*)&sent, &length);
+    if (sent == 0) { // the client is done
+      miniport_destroy(from);
+      break;
+    }
+
+    handle_request();
+    minimsg_send(port, from, (char*)&sent, sizeof(sent)); // reply with the time the request was sent
+    miniport_destroy(from);
+  }
+  semaphore_V(done);
+  return 0;
+}
+
+int client(int* arg) {
+  network_address_t my_address;
+  miniport_t* local = miniport_create_unbound(FIRST_PORT + NUM_INTERACTIVE);
+  miniport_t* servers[NUM_INTERACTIVE];
+  miniport_t* from;
+  unsigned long long sent;
+  int length;
+
+  network_get_my_address(my_address);
+  for (int i = 0; i < NUM_INTERACTIVE; i++) servers[i] = miniport_create_bound(my_address, FIRST_PORT + i);
+
+  for (int i = 0; !stop; i = (i + 1) % NUM_INTERACTIVE) {
+    sent = currentTimeMicros();
+    minimsg_send(local, servers[i], (char*)&sent, sizeof(sent));
+
+    length = sizeof(sent);
+    minimsg_receive(local, &from, (char*)&sent, &length);
+    miniport_destroy(from);
+    record_request(i, currentTimeMicros() - sent);
+  }
+
+  sent = 0; // tell the servers to stop
+  for (int i = 0; i < NUM_INTERACTIVE; i++) minimsg_send(local, servers[i], (char*)&sent, sizeof(sent));
+  semaphore_V(done);
+  return 0;
+}
+
+int main_thread(int* arg) {
+  static int ids[NUM_BATCH + NUM_INTERACTIVE];
+  const char* name = (const char*)arg;
+  int num_threads = NUM_BATCH + NUM_INTERACTIVE;
+
+  done = semaphore_create();
+  semaphore_initialize(done, 0);
+
+  ready = semaphore_create();
+  semaphore_initialize(ready, 0);
+
+  for (int i = 0; i < NUM_INTERACTIVE; i++) {
+    ids[NUM_BATCH + i] = i;
+    minithread_t* t = minithread_fork(network ? server : interactive, &ids[NUM_BATCH + i]);
+    minithread_set_tickets(t, 3 * SCHED_DEFAULT_TICKETS);
+    minithread_set_deadline(t, 50);
+  }
+  if (network) { // start the clock once the servers are done with their batch work
+    for (int i = 0; i < NUM_INTERACTIVE; i++) semaphore_P(ready);
+  }
+
+  for (int i = 0; i < NUM_BATCH; i++) {
+    ids[i] = i;
+    minithread_t* t = minithread_fork(batch, &ids[i]);
+    minithread_set_tickets(t, SCHED_DEFAULT_TICKETS);
+    minithread_set_deadline(t, 1000);
+  }
+  if (network) {
+    minithread_t* t = minithread_fork(client, NULL);
+    minithread_set_tickets(t, 3 * SCHED_DEFAULT_TICKETS);
+    minithread_set_deadline(t, 50);
+    num_threads++;
+  }
+
+  // the main thread only sleeps, make sure it gets to stop the benchmark
+  minithread_set_tickets(NULL, 3 * SCHED_DEFAULT_TICKETS);
+  minithread_set_deadline(NULL, 50);
+
+  unsigned long long start = currentTimeMillis();
+  minithread_sleep_with_timeout(RUN_MS);
+  stop = 1;
+  unsigned long long elapsed = currentTimeMillis() - start;
+  for (int i = 0; i < num_threads; i++) semaphore_P(done);
+
+  unsigned long long total = 0, min = batch_iterations[0], max = batch_iterations[0];
+  for (int i = 0; i < NUM_BATCH; i++) {
+    total += batch_iterations[i];
+    if (batch_iterations[i] < min) min = batch_iterations[i];
+    if (batch_iterations[i] > max) max = batch_iterations[i];
+  }
+
+  unsigned int total_requests = 0;
+  unsigned long long latency = 0, max_latency = 0;
+  for (int i = 0; i < NUM_INTERACTIVE; i++) {
+    total_requests += requests[i];
+    latency += total_latency_us[i];
+    if (max_latency_us[i] > max_latency) max_latency = max_latency_us[i];
+  }
+
+  printf("%-12s %-8s batch: %llu Kiter/s, shares %llu%%-%llu%%; interactive: %u requests, wait avg %llu ms, max %llu ms\n",
+	 name, network ? "network" : "sleep", (elapsed > 0) ? total / elapsed : 0ULL,
+	 (total > 0) ? 100 * min / total : 0ULL, (total > 0) ? 100 * max / total : 0ULL,
+	 total_requests, (total_requests > 0) ? latency / total_requests / 1000 : 0ULL, max_latency / 1000);
+
+  exit(0); // the system never stops on its own, end the process so that the runs can be scripted
+}
+
+int main(int argc, char** argv) {
+  const sched_ops_t* scheduler = &sched_mlfq;
+  if (argc > 1) {
+    scheduler = NULL;
+    for (int i = 0; i < sizeof(schedulers) / sizeof(schedulers[0]); i++) {
+      if (strcmp(argv[1], schedulers[i]->name) == 0) scheduler = schedulers[i];
+    }
+    if (scheduler == NULL) {
+      printf("Unknown scheduler %s.\n", argv[1]);
+      return -1;
+    }
+  }
+
+  if (argc > 2 && strcmp(argv[2], "network") == 0) network = 1;
+  else if (argc > 2 && strcmp(argv[2], "sleep") != 0) {
+    printf("Unknown workload %s.\n", argv[2]);
+    return -1;
+  }
+
+  minithread_set_scheduler(scheduler);
+  minithread_system_initialize(main_thread, (int*)scheduler->name);
+  return -1;
+}
@@ -0,0 +1,94 @@
+/* schedtrace.c
+
+   Runs a CPU bound thread, a thread that keeps yielding and a thread that
+   keeps sleeping side by side with context switch tracing on, then prints
+   the accounting of each thread and the last switches of the trace.
+
+   USAGE: ./schedtrace [<chrome trace file>]
+
+   If a file name is given the trace is also written there in the Chrome
+   trace event format (open it in chrome://tracing or Perfetto).
+*/
+
+#include "minithread.h"
+#include "synch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TRACE_CAPACITY 4096
+#define RUN_MS 2000
+#define DUMP_EVENTS 20
+
+char* chrome_file = NULL;
+semaphore_t* done;
+volatile int stop = 0;
+
+int spinner(int* arg) {
+  while (!stop) ;
+  semaphore_V(done);
+  return 0;
+}
+
+int yielder(int* arg) {
+  while (!stop) minithread_yield();
+  semaphore_V(done);
+  return 0;
+}
+
+int sleeper(int* arg) {
+  while (!stop) minithread_sleep_with_timeout(200);
+  semaphore_V(done);
+  return 0;
+}
+
+int main_thread(int* arg) {
+  minithread_t* threads[3];
+
+  done = semaphore_create();
+  semaphore_initialize(done, 0);
+  minithread_trace_enable(TRACE_CAPACITY);
+
+  threads[0] = minithread_fork(spinner, NULL);
+  threads[1] = minithread_fork(yielder, NULL);
+  threads[2] = minithread_fork(sleeper, NULL);
+
+  minithread_sleep_with_timeout(RUN_MS);
+  minithread_trace_disable();
+
+  // take the statistics before the threads finish and are cleaned up
+  char* names[] = { "spinner", "yielder", "sleeper" };
+  for (int i = 0; i < 3; i++) {
+    printf("%s:\n", names[i]);
+    minithread_dump_stats(threads[i]);
+  }
+
+  minithread_trace_event_t events[DUMP_EVENTS];
+  int n = minithread_trace_read(events, DUMP_EVENTS);
+  printf("last %d context switches:\n", n);
+  for (int i = 0; i < n; i++) {
+    printf("  %d -> %d (%s)\n", events[i].fromId, events[i].toId,
+	   events[i].reason == TRACE_PREEMPT ? "preempt" :
+	   events[i].reason == TRACE_YIELD ? "yield" :
+	   events[i].reason == TRACE_BLOCK ? "block" :
+	   events[i].reason == TRACE_HANDOFF ? "handoff" : "exit");
+  }
+
+  if (chrome_file != NULL) {
+    if (minithread_trace_dump_chrome(chrome_file) == 0)
+      printf("Chrome trace written to %s.\n", chrome_file);
+    else
+      printf("Failed to write %s.\n", chrome_file);
+  }
+
+  stop = 1;
+  for (int i = 0; i < 3; i++) semaphore_P(done);
+  printf("Done.\n");
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) chrome_file = argv[1];
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}
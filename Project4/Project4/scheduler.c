@@ -0,0 +1,632 @@
+/*
+ * Implementation of the minithread scheduling policies.
+ */
+#include <stdlib.h>
+#include <assert.h>
+
+#include "scheduler.h"
+#include "minithread_private.h"
+#include "machineprimitives.h"
+#include "multilevel_queue.h"
+#include "queue.h"
+
+// ---- Internal Functions ---- //
+// current time in milliseconds, for deadlines
+static uint64_t now_ms()
+{
+	return currentTimeMicros() / 1000;
+}
+
+// whether the runnable thread t has waited for the processor for at least the given # of ticks; handoffs do not let
+// threads passing the processor back and forth go ahead of such a thread, or they could keep it from running forever
+static bool waited_ticks(minithread_t* t, int ticks)
+{
+	return currentTimeMicros() - t->statusSince >= (uint64_t)ticks * g_quantumMs * 1000;
+}
+
+// ---- Multilevel feedback queue ---- //
+#define MLFQ_NUM_LEVELS MINITHREAD_PRIORITIES	// Number of levels for multi-level threads, a thread's priority is the highest level it reaches
+static const int MLFQ_THREAD_QUANTA[] = { 1, 2, 4, 8 }; // Quanta (# of ticks) a thread gets at each level, array size must match MLFQ_NUM_LEVELS
+static const int MLFQ_LEVEL_QUANTA[] = { 80, 40, 24, 16 }; // Quanta (# of ticks) each level gets in turn, array size must match MLFQ_NUM_LEVELS
+
+#define MLFQ_BOOST_TICKS 50	// # of ticks between two boosts of all threads back to the level of their priority
+
+static multilevel_queue_t* g_mlfqQueue = NULL; //runnable threads, one queue per level
+static int g_mlfqLevel = 0; //level whose turn it is
+static int g_mlfqCountdown = 0; //# of ticks left until the next level's turn
+static int g_mlfqBoostCountdown = 0; //# of ticks left until the next boost
+static unsigned int g_mlfqBoostEpoch = 0; //# of boosts so far, threads that were waiting during a boost catch up when they wake up
+
+// moves thread t to the given level with the level's full quanta, counting the move for the thread
+static void mlfq_set_level(minithread_t* t, int level)
+{
+	if (level < t->level) t->stats.promotions++;
+	else if (level > t->level) t->stats.demotions++;
+
+	t->level = level;
+	t->quanta = MLFQ_THREAD_QUANTA[level];
+}
+
+// moves the runnable thread t to the queue of the given level
+static void mlfq_requeue(minithread_t* t, int level)
+{
+	int deleteSuccess = multilevel_queue_delete(g_mlfqQueue, t->level, t);
+	assert(deleteSuccess == 0);
+	t->level = level;
+	int appendSuccess = multilevel_queue_enqueue(g_mlfqQueue, t->level, t);
+	assert(appendSuccess == 0);
+}
+
+// moves thread t back to the level of its priority, or keeps the level it inherited if that is higher
+static void mlfq_boost_thread(minithread_t* t)
+{
+	t->boostEpoch = g_mlfqBoostEpoch;
+	mlfq_set_level(t, (t->savedLevel != -1 && t->level < t->priority) ? t->level : t->priority);
+	if (t->savedLevel != -1) t->savedLevel = t->priority;
+}
+
+// moves every thread back to the level of its priority; the waiting threads are moved when they wake up
+static void mlfq_boost(minithread_t* running)
+{
+	g_mlfqBoostEpoch++;
+
+	mlfq_boost_thread(running);
+	for (int level = 1; level < MLFQ_NUM_LEVELS; level++) {
+		minithread_t* t = NULL;
+		minithread_t* first = NULL; // first thread that stayed at this level, every thread has been moved once it is back at the head
+		while (multilevel_queue_length(g_mlfqQueue) > 0 && multilevel_queue_peek(g_mlfqQueue, level, (void**)&t) == level && t != first) {
+			multilevel_queue_dequeue(g_mlfqQueue, level, (void**)&t);
+			mlfq_boost_thread(t);
+			if (t->level == level && first == NULL) first = t;
+			int appendSuccess = multilevel_queue_enqueue(g_mlfqQueue, t->level, t);
+			assert(appendSuccess == 0);
+		}
+	}
+
+	g_mlfqLevel = 0;
+	g_mlfqCountdown = MLFQ_LEVEL_QUANTA[g_mlfqLevel];
+}
+
+static int mlfq_init()
+{
+	g_mlfqQueue = multilevel_queue_new(MLFQ_NUM_LEVELS);
+	g_mlfqLevel = 0;
+	g_mlfqCountdown = MLFQ_LEVEL_QUANTA[g_mlfqLevel];
+	g_mlfqBoostCountdown = MLFQ_BOOST_TICKS;
+	g_mlfqBoostEpoch = 0;
+	return (g_mlfqQueue == NULL) ? -1 : 0;
+}
+
+static void mlfq_thread_init(minithread_t* t)
+{
+	t->level = t->priority;
+	t->quanta = MLFQ_THREAD_QUANTA[t->level];
+	t->boostEpoch = g_mlfqBoostEpoch;
+}
+
+static int mlfq_enqueue(minithread_t* t)
+{
+	return multilevel_queue_enqueue(g_mlfqQueue, t->level, t);
+}
+
+static minithread_t* mlfq_pick_next()
+{
+	minithread_t* t = NULL;
+	int level = multilevel_queue_dequeue(g_mlfqQueue, g_mlfqLevel, (void**)&t); // first thread at or after the current level
+	if (level == -1) return NULL;
+
+	if (level != g_mlfqLevel) { // nothing to run at the current level, move on to the level of the picked thread
+		g_mlfqLevel = level;
+		g_mlfqCountdown = MLFQ_LEVEL_QUANTA[g_mlfqLevel];
+	}
+	t->dispatchTicks = t->stats.ticksRun;
+	return t;
+}
+
+static bool mlfq_tick(minithread_t* t)
+{
+	g_mlfqBoostCountdown--;
+	if (g_mlfqBoostCountdown == 0) {
+		g_mlfqBoostCountdown = MLFQ_BOOST_TICKS;
+		mlfq_boost(t);
+		return true;
+	}
+
+	// the thread has used up 1 quanta, move it down a level when its level's quanta are used up
+	t->quanta--;
+	if (t->quanta == 0) {
+		if (t->savedLevel != -1) { // running at an inherited level, it is its own level that goes down
+			if (t->savedLevel < MLFQ_NUM_LEVELS - 1) t->savedLevel++;
+			t->quanta = MLFQ_THREAD_QUANTA[t->level];
+		}
+		else {
+			mlfq_set_level(t, (t->level < MLFQ_NUM_LEVELS - 1) ? t->level + 1 : t->level); // no level change if already at the lowest level
+		}
+	}
+
+	// the current level has used up 1 quanta, pass the turn to the next level when they are used up
+	g_mlfqCountdown--;
+	if (g_mlfqCountdown == 0) {
+		g_mlfqLevel = (g_mlfqLevel + 1) % MLFQ_NUM_LEVELS;
+		g_mlfqCountdown = MLFQ_LEVEL_QUANTA[g_mlfqLevel];
+	}
+
+	return true; // pick_next() decides whether the thread's level is still the closest to the current one
+}
+
+static void mlfq_block(minithread_t* t)
+{
+	// blocking before a tick has passed is a sign of an interactive or I/O bound thread, restore its priority step by step
+	if (t->stats.ticksRun != t->dispatchTicks) return;
+
+	if (t->savedLevel != -1) { // running at an inherited level, it is its own level that goes up
+		if (t->savedLevel > t->priority) t->savedLevel--;
+	}
+	else if (t->level > t->priority) {
+		mlfq_set_level(t, t->level - 1);
+	}
+}
+
+// moves a thread that was waiting during a boost to the level of its priority, like the boost did for the others
+static void mlfq_catch_up(minithread_t* t)
+{
+	if (t->boostEpoch != g_mlfqBoostEpoch) mlfq_boost_thread(t);
+}
+
+static int mlfq_wake(minithread_t* t)
+{
+	mlfq_catch_up(t);
+
+	// a thread woken up by the network runs next, so that the packet is handled without waiting for the turn of
+	// the thread's level: it is raised to the level whose turn it is if its own level is lower
+	if (t->networkWakeup && t->level > g_mlfqLevel) mlfq_set_level(t, g_mlfqLevel);
+
+	// the lower levels only have the turn because the thread's level had nothing to run, it takes the turn back
+	void* first = NULL;
+	if (t->level < g_mlfqLevel && multilevel_queue_peek(g_mlfqQueue, t->level, &first) != t->level) {
+		g_mlfqLevel = t->level;
+		g_mlfqCountdown = MLFQ_LEVEL_QUANTA[g_mlfqLevel];
+	}
+
+	if (t->networkWakeup) return multilevel_queue_prepend(g_mlfqQueue, t->level, t);
+	return multilevel_queue_enqueue(g_mlfqQueue, t->level, t);
+}
+
+static int mlfq_length()
+{
+	return multilevel_queue_length(g_mlfqQueue);
+}
+
+static void mlfq_inherit(minithread_t* owner, minithread_t* waiter)
+{
+	if (waiter->level >= owner->level) return; // the owner is already at least as important
+
+	if (owner->savedLevel == -1) owner->savedLevel = owner->level;
+	if (owner->status == READY) mlfq_requeue(owner, waiter->level); // move it to the queue of its new level
+	else owner->level = waiter->level;
+}
+
+static void mlfq_restore(minithread_t* t)
+{
+	if (t->savedLevel == -1) return;
+
+	t->level = t->savedLevel;
+	t->quanta = MLFQ_THREAD_QUANTA[t->level];
+	t->savedLevel = -1;
+}
+
+static bool mlfq_handoff(minithread_t* waker, minithread_t* t)
+{
+	mlfq_catch_up(t);
+	if (t->level > waker->level) return false;
+
+	void* first = NULL;
+	if (multilevel_queue_peek(g_mlfqQueue, waker->level, &first) == waker->level && waited_ticks(first, MLFQ_THREAD_QUANTA[waker->level])) return false;
+
+	// the waker runs first at its level once t gives the processor up; the level's turn goes on, so
+	// threads passing the processor back and forth do not get more of it than the rest of their level
+	if (multilevel_queue_prepend(g_mlfqQueue, waker->level, waker) != 0) return false;
+	t->dispatchTicks = t->stats.ticksRun;
+	return true;
+}
+
+static void mlfq_reprioritize(minithread_t* t)
+{
+	int level = t->priority; // the thread starts over at the level of its new priority
+	if (t->savedLevel != -1) { // running at an inherited level, it is its own level that changes
+		t->savedLevel = level;
+		if (level > t->level) return; // the inherited level still applies
+	}
+	if (level != t->level) t->quanta = MLFQ_THREAD_QUANTA[level];
+	if (t->status == READY) mlfq_requeue(t, level);
+	else t->level = level;
+}
+
+const sched_ops_t sched_mlfq = {
+	"mlfq",
+	mlfq_init,
+	mlfq_thread_init,
+	mlfq_enqueue,
+	mlfq_pick_next,
+	mlfq_tick,
+	mlfq_block,
+	mlfq_wake,
+	mlfq_length,
+	mlfq_inherit,
+	mlfq_restore,
+	mlfq_handoff,
+	mlfq_reprioritize
+};
+
+// ---- Round robin ---- //
+#define RR_QUANTA 2	// # of ticks a thread runs before it is preempted
+
+static queue_t* g_rrQueue = NULL; //runnable threads in FIFO order
+
+static int rr_init()
+{
+	g_rrQueue = queue_new();
+	return (g_rrQueue == NULL) ? -1 : 0;
+}
+
+static void rr_thread_init(minithread_t* t)
+{
+	t->quanta = RR_QUANTA;
+}
+
+static int rr_enqueue(minithread_t* t)
+{
+	t->quanta = RR_QUANTA; // a full time slice the next time it runs
+	return queue_append(g_rrQueue, t);
+}
+
+static minithread_t* rr_pick_next()
+{
+	minithread_t* t = NULL;
+	if (queue_dequeue(g_rrQueue, (void**)&t) == -1) return NULL;
+	return t;
+}
+
+static bool rr_tick(minithread_t* t)
+{
+	t->quanta--;
+	return t->quanta <= 0;
+}
+
+static void rr_block(minithread_t* t)
+{
+}
+
+static void rr_inherit(minithread_t* owner, minithread_t* waiter)
+{
+}
+
+static void rr_restore(minithread_t* t)
+{
+}
+
+static void rr_reprioritize(minithread_t* t)
+{
+}
+
+static int rr_length()
+{
+	return queue_length(g_rrQueue);
+}
+
+static bool rr_handoff(minithread_t* waker, minithread_t* t)
+{
+	minithread_t* first = NULL;
+	if (queue_peek(g_rrQueue, (void**)&first) == 0 && waited_ticks(first, RR_QUANTA)) return false;
+	if (queue_prepend(g_rrQueue, waker) != 0) return false; // all threads are equal, the waker just goes first
+
+	t->quanta = waker->quanta; // t runs on the rest of the waker's time slice
+	return true;
+}
+
+const sched_ops_t sched_round_robin = {
+	"round-robin",
+	rr_init,
+	rr_thread_init,
+	rr_enqueue,
+	rr_pick_next,
+	rr_tick,
+	rr_block,
+	rr_enqueue,
+	rr_length,
+	rr_inherit,
+	rr_restore,
+	rr_handoff,
+	rr_reprioritize
+};
+
+// ---- Lottery ---- //
+static queue_t* g_lotteryQueue = NULL; //runnable threads
+static uint32_t g_lotterySeed = 2463534242U; //state of the ticket generator, kept apart from genrand() so that the network simulation stays reproducible
+
+// state of a drawing while iterating over the runnable threads
+typedef struct lottery_draw
+{
+	uint64_t tickets;		// # of tickets seen so far, or the winning ticket left to reach
+	minithread_t* winner;	// holder of the winning ticket, NULL until found
+} lottery_draw_t;
+
+// xorshift generator, good enough to draw tickets
+static uint32_t lottery_random()
+{
+	g_lotterySeed ^= g_lotterySeed << 13;
+	g_lotterySeed ^= g_lotterySeed >> 17;
+	g_lotterySeed ^= g_lotterySeed << 5;
+	return g_lotterySeed;
+}
+
+static void lottery_count_tickets(void* item, void* arg)
+{
+	((lottery_draw_t*)arg)->tickets += ((minithread_t*)item)->tickets;
+}
+
+static void lottery_find_winner(void* item, void* arg)
+{
+	lottery_draw_t* draw = (lottery_draw_t*)arg;
+	minithread_t* t = (minithread_t*)item;
+	if (draw->winner != NULL) return;
+
+	if (draw->tickets < (uint64_t)t->tickets) draw->winner = t;
+	else draw->tickets -= t->tickets;
+}
+
+static int lottery_init()
+{
+	g_lotteryQueue = queue_new();
+	return (g_lotteryQueue == NULL) ? -1 : 0;
+}
+
+static void lottery_thread_init(minithread_t* t)
+{
+}
+
+static int lottery_enqueue(minithread_t* t)
+{
+	return queue_append(g_lotteryQueue, t);
+}
+
+static minithread_t* lottery_pick_next()
+{
+	if (queue_length(g_lotteryQueue) == 0) return NULL;
+
+	// the tickets are counted at every drawing, so that minithread_set_tickets() applies right away
+	lottery_draw_t draw = { 0, NULL };
+	queue_iterate(g_lotteryQueue, lottery_count_tickets, &draw);
+	draw.tickets = lottery_random() % draw.tickets;
+	queue_iterate(g_lotteryQueue, lottery_find_winner, &draw);
+	assert(draw.winner != NULL);
+
+	queue_delete(g_lotteryQueue, draw.winner);
+	return draw.winner;
+}
+
+static bool lottery_tick(minithread_t* t)
+{
+	return true; // draw again at every tick
+}
+
+static void lottery_block(minithread_t* t)
+{
+}
+
+static void lottery_inherit(minithread_t* owner, minithread_t* waiter)
+{
+}
+
+static void lottery_restore(minithread_t* t)
+{
+}
+
+static void lottery_reprioritize(minithread_t* t)
+{
+}
+
+static int lottery_length()
+{
+	return queue_length(g_lotteryQueue);
+}
+
+static bool lottery_handoff(minithread_t* waker, minithread_t* t)
+{
+	return false; // only a drawing gives the processor away, or t would run without its tickets winning it
+}
+
+const sched_ops_t sched_lottery = {
+	"lottery",
+	lottery_init,
+	lottery_thread_init,
+	lottery_enqueue,
+	lottery_pick_next,
+	lottery_tick,
+	lottery_block,
+	lottery_enqueue,
+	lottery_length,
+	lottery_inherit,
+	lottery_restore,
+	lottery_handoff,
+	lottery_reprioritize
+};
+
+// ---- Stride ---- //
+#define STRIDE_ONE (1 << 20)	// stride of a thread holding a single ticket
+
+static queue_t* g_strideQueue = NULL; //runnable threads ordered by pass
+static uint64_t g_stridePass = 0; //pass of the thread picked last, the lowest of the runnable threads at that time
+
+static int stride_init()
+{
+	g_strideQueue = queue_new();
+	g_stridePass = 0;
+	return (g_strideQueue == NULL) ? -1 : 0;
+}
+
+static void stride_thread_init(minithread_t* t)
+{
+	t->pass = g_stridePass;
+}
+
+static int stride_enqueue(minithread_t* t)
+{
+	// a thread that was waiting does not get to use up the share it did not use meanwhile
+	if (t->pass < g_stridePass) t->pass = g_stridePass;
+	return queue_ordered_insert(g_strideQueue, t, t->pass);
+}
+
+static minithread_t* stride_pick_next()
+{
+	minithread_t* t = NULL;
+	if (queue_dequeue(g_strideQueue, (void**)&t) == -1) return NULL;
+
+	g_stridePass = t->pass;
+	return t;
+}
+
+static bool stride_tick(minithread_t* t)
+{
+	t->pass += STRIDE_ONE / t->tickets;
+	return true; // pick_next() decides whether someone else is behind now
+}
+
+static void stride_block(minithread_t* t)
+{
+}
+
+static void stride_inherit(minithread_t* owner, minithread_t* waiter)
+{
+}
+
+static void stride_restore(minithread_t* t)
+{
+}
+
+static void stride_reprioritize(minithread_t* t)
+{
+}
+
+static int stride_length()
+{
+	return queue_length(g_strideQueue);
+}
+
+static bool stride_handoff(minithread_t* waker, minithread_t* t)
+{
+	uint64_t pass = (t->pass < g_stridePass) ? g_stridePass : t->pass; // the catch up of stride_enqueue()
+	if (pass > waker->pass) return false;
+	if (queue_ordered_insert(g_strideQueue, waker, waker->pass) != 0) return false;
+
+	t->pass = pass;
+	g_stridePass = t->pass; // as if pick_next() had picked t
+	return true;
+}
+
+const sched_ops_t sched_stride = {
+	"stride",
+	stride_init,
+	stride_thread_init,
+	stride_enqueue,
+	stride_pick_next,
+	stride_tick,
+	stride_block,
+	stride_enqueue,
+	stride_length,
+	stride_inherit,
+	stride_restore,
+	stride_handoff,
+	stride_reprioritize
+};
+
+// ---- Earliest deadline first ---- //
+static queue_t* g_edfQueue = NULL; //runnable threads ordered by deadline
+
+static int edf_init()
+{
+	g_edfQueue = queue_new();
+	return (g_edfQueue == NULL) ? -1 : 0;
+}
+
+static void edf_thread_init(minithread_t* t)
+{
+	t->deadline = 0;
+}
+
+static int edf_enqueue(minithread_t* t)
+{
+	if (t->deadline == 0) t->deadline = now_ms() + t->deadlineMs; // a new thread starts its first job
+	return queue_ordered_insert(g_edfQueue, t, t->deadline);
+}
+
+static minithread_t* edf_pick_next()
+{
+	minithread_t* t = NULL;
+	if (queue_dequeue(g_edfQueue, (void**)&t) == -1) return NULL;
+	return t;
+}
+
+static bool edf_tick(minithread_t* t)
+{
+	uint64_t now = now_ms();
+	if (now >= t->deadline) t->deadline = now + t->deadlineMs; // overran its deadline, postpone the job
+
+	minithread_t* next = NULL;
+	if (queue_peek(g_edfQueue, (void**)&next) == -1) return false; // nobody else to run
+	return next->deadline < t->deadline;
+}
+
+static void edf_block(minithread_t* t)
+{
+}
+
+static int edf_wake(minithread_t* t)
+{
+	t->deadline = now_ms() + t->deadlineMs; // a new job is released
+	return queue_ordered_insert(g_edfQueue, t, t->deadline);
+}
+
+static void edf_inherit(minithread_t* owner, minithread_t* waiter)
+{
+}
+
+static void edf_restore(minithread_t* t)
+{
+}
+
+static void edf_reprioritize(minithread_t* t)
+{
+}
+
+static int edf_length()
+{
+	return queue_length(g_edfQueue);
+}
+
+static bool edf_handoff(minithread_t* waker, minithread_t* t)
+{
+	uint64_t deadline = now_ms() + t->deadlineMs; // the job edf_wake() would release
+	minithread_t* next = NULL;
+	if (queue_peek(g_edfQueue, (void**)&next) == 0 && next->deadline < deadline) return false; // a job due earlier runs first
+	if (queue_ordered_insert(g_edfQueue, waker, waker->deadline) != 0) return false;
+
+	t->deadline = deadline;
+	return true;
+}
+
+const sched_ops_t sched_edf = {
+	"edf",
+	edf_init,
+	edf_thread_init,
+	edf_enqueue,
+	edf_pick_next,
+	edf_tick,
+	edf_block,
+	edf_wake,
+	edf_length,
+	edf_inherit,
+	edf_restore,
+	edf_handoff,
+	edf_reprioritize
+};
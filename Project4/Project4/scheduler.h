@@ -0,0 +1,137 @@
+/*
+ * Scheduling policies for minithreads.
+ *
+ *      A scheduler keeps the runnable (READY) threads and decides which one
+ *      gets the processor next. The minithread layer does the context
+ *      switching and calls into the scheduler through the callbacks below.
+ *      The scheduler is selected with minithread_set_scheduler() before
+ *      minithread_system_initialize() is called. The idle thread is never
+ *      handed to the scheduler.
+ */
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <stdbool.h>
+
+#include "minithread.h"
+
+/* share of the processor a new thread gets under the lottery and stride schedulers */
+#define SCHED_DEFAULT_TICKETS 100
+
+/* relative deadline of a new thread under the EDF scheduler, in milliseconds */
+#define SCHED_DEFAULT_DEADLINE_MS 1000
+
+/*
+ * A scheduler. Every callback is required and is called with interrupts
+ * disabled.
+ *
+ *  init()           -- set up the scheduler's run queue; returns 0 or -1 on failure
+ *  thread_init(t)   -- set up the scheduling state of the new thread t
+ *  enqueue(t)       -- t is runnable: newly forked, or it gave up the processor
+ *                      through minithread_yield() or a preemption;
+ *                      returns 0 or -1 on failure
+ *  pick_next()      -- remove and return the thread to run next, NULL if none
+ *  tick(t)          -- a clock tick interrupted the running thread t; returns
+ *                      true if t should be preempted, in which case t is
+ *                      enqueued and pick_next() decides who runs (possibly t)
+ *  block(t)         -- the running thread t stops to wait (minithread_stop())
+ *  wake(t)          -- t was waiting and is runnable again (minithread_start());
+ *                      t->networkWakeup tells whether a network handler
+ *                      woke it up; returns 0 or -1 on failure
+ *  length()         -- # of runnable threads held by the scheduler
+ *  inherit(o, w)    -- thread w waits for a lock held by thread o (which may
+ *                      be runnable, running or waiting): o should run with at
+ *                      least the priority of w from now on
+ *  restore(t)       -- the running thread t released a lock and drops the
+ *                      priority it inherited; inherit() follows for the
+ *                      waiters of the locks it still holds
+ *  handoff(w, t)    -- the running thread w makes the waiting thread t
+ *                      runnable and offers it the processor (see
+ *                      minithread_handoff()); returns true if t is at least
+ *                      as important as w: the scheduler then queues w so that
+ *                      it runs again soon, and t runs right away on what is
+ *                      left of w's time slice. Returns false if t should
+ *                      wait its turn, in which case wake(t) follows; so
+ *                      does a scheduler that orders threads by a queue
+ *                      when a runnable thread has waited for a whole time
+ *                      slice, lest threads passing the processor back and
+ *                      forth keep it from ever running.
+ *  reprioritize(t)  -- the priority of thread t (which may be runnable,
+ *                      running or waiting) changed, see
+ *                      minithread_set_priority()
+ */
+struct sched_ops
+{
+	const char* name;
+	int(*init)(void);
+	void(*thread_init)(minithread_t* t);
+	int(*enqueue)(minithread_t* t);
+	minithread_t*(*pick_next)(void);
+	bool(*tick)(minithread_t* t);
+	void(*block)(minithread_t* t);
+	int(*wake)(minithread_t* t);
+	int(*length)(void);
+	void(*inherit)(minithread_t* owner, minithread_t* waiter);
+	void(*restore)(minithread_t* t);
+	bool(*handoff)(minithread_t* waker, minithread_t* t);
+	void(*reprioritize)(minithread_t* t);
+};
+
+/*
+ * Multilevel feedback queue with a level per priority. A thread starts at
+ * the level of its priority and moves down a level each time it uses up
+ * the quanta of its level, and the levels take turns with a share of the
+ * ticks that shrinks with the level. This is the default scheduler.
+ *
+ * So that threads are not stuck at a low level once their behaviour
+ * changes:
+ *  - every MLFQ_BOOST_TICKS ticks all threads move back to the level of
+ *    their priority;
+ *  - a thread that blocks before a tick has passed since it got the
+ *    processor moves up a level, up to the level of its priority;
+ *  - a thread woken up by a network handler runs next within the current
+ *    level's turn, raised to the current level if its own is lower.
+ *
+ * A thread that wakes up at a level above the one whose turn it is takes
+ * the turn back for its level if nothing else was queued there, so that
+ * sleeping and waiting threads do not wait for the lower levels' turns.
+ *
+ * A lock owner inherits the level of a waiter at a higher level, and goes
+ * back to the highest level of the waiters of the locks it still holds, or
+ * to its own, each time it releases a lock. The other schedulers do not
+ * implement priority inheritance, and ignore priorities.
+ */
+extern const sched_ops_t sched_mlfq;
+
+/*
+ * A single FIFO queue; the running thread is preempted after a fixed number
+ * of ticks.
+ */
+extern const sched_ops_t sched_round_robin;
+
+/*
+ * Lottery scheduling: at every tick a ticket is drawn among the runnable
+ * threads and its owner runs (see minithread_set_tickets()). Threads are
+ * never handed the processor: only a drawing gives it away.
+ */
+extern const sched_ops_t sched_lottery;
+
+/*
+ * Stride scheduling, the deterministic counterpart of lottery scheduling:
+ * every thread advances its pass by a stride inversely proportional to its
+ * tickets for each tick it runs, and the lowest pass runs next.
+ */
+extern const sched_ops_t sched_stride;
+
+/*
+ * Earliest deadline first. A thread that becomes runnable after waiting
+ * starts a job due its relative deadline later (see
+ * minithread_set_deadline()); the runnable job with the earliest deadline
+ * runs. A job that overruns its deadline is postponed by another relative
+ * deadline, so threads that never block cannot starve the others. A thread
+ * handed the processor runs right away unless a runnable job is due before
+ * its new one, even if the job of the thread handing it over is due first.
+ */
+extern const sched_ops_t sched_edf;
+
+#endif /*__SCHEDULER_H__*/
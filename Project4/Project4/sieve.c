@@ -7,21 +7,26 @@
  * into a pipeline. A consumer consumes numbers that make it through
  * the pipeline and prints them out as primes. It also creates a new
  * filter thread for each new prime, which subsequently filters out
- * all multiples of that prime from the pipe.
+ * all multiples of that prime from the pipe. Each stage of the pipe
+ * is a channel, through which the numbers move in batches.
  *
+ * USAGE: ./sieve [handoff]
+ *
+ * With handoff, each send switches straight to the stage it gives numbers
+ * to (see channel_set_handoff()). This sends a batch down the whole
+ * pipeline before the source sends the next one, so the stages move
+ * smaller batches: on our machine it prints about 15000 primes in 10 s,
+ * against 21000 without.
  */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
 #include "minithread.h"
-#include "synch.h"
+#include "channel.h"
 
 #define MAXPRIME 1000000
-
-typedef struct {
-  int value;
-  semaphore_t* produce;
-  semaphore_t* consume;
-} channel_t;
+#define BATCH 64 /* # of numbers a channel holds, and moves at once */
 
 typedef struct {
   channel_t* left;
@@ -31,77 +36,66 @@ typedef struct {
 
 
 int max = MAXPRIME;
+bool handoff = false;
+
+channel_t* new_channel() {
+  channel_t* c = channel_create(sizeof(int), BATCH);
+  channel_set_handoff(c, handoff);
+  return c;
+}
 
 /* produce all integers from 2 to max */
 int source(int* arg) {
   channel_t* c = (channel_t *) arg;
-  int i;
+  int values[BATCH];
+  int i, n = 0;
 
   for (i=2; i<=max; i++) {
-    c->value = i;
-    semaphore_V(c->consume);
-    semaphore_P(c->produce);
+    values[n++] = i;
+    if (n == BATCH || i == max) {
+      channel_send_batch(c, values, n);
+      n = 0;
+    }
   }
   
-  c->value = -1;
-  semaphore_V(c->consume);
+  channel_close(c);
 
   return 0;
 }
 
 int filter(int* arg) {
   filter_t* f = (filter_t *) arg;
-  int value;
-
-  for (;;) {
-    semaphore_P(f->left->consume);
-    value = f->left->value;
-    semaphore_V(f->left->produce);
-    if ((value == -1) || (value % f->prime != 0)) {
-      f->right->value = value;
-      semaphore_V(f->right->consume);
-      semaphore_P(f->right->produce);
-    }
-    if (value == -1)
-      break;
+  int values[BATCH];
+  int n, i, kept;
+
+  while ((n = channel_receive_batch(f->left, values, BATCH)) > 0) {
+    kept = 0;
+    for (i=0; i<n; i++)
+      if (values[i] % f->prime != 0)
+        values[kept++] = values[i];
+    channel_send_batch(f->right, values, kept);
   }
+  channel_close(f->right);
 
   return 0;
 }
 
 int sink(int* arg) {
-  channel_t* p = (channel_t *) malloc(sizeof(channel_t));
+  channel_t* p = new_channel();
   int value;
 
-  p->produce = semaphore_create();
-  semaphore_initialize(p->produce, 0);
-  p->consume = semaphore_create();
-  semaphore_initialize(p->consume, 0);
-
   minithread_fork(source, (int *) p);
   
-  for (;;) {
+  while (channel_receive(p, &value) == 0) {
     filter_t* f;
 
-    semaphore_P(p->consume);
-    value = p->value;
-    semaphore_V(p->produce);
-    
-    if (value == -1)
-      break;
-
     printf("%d is prime.\n", value);
     
     f = (filter_t *) malloc(sizeof(filter_t));
     f->left = p;
     f->prime = value;
     
-    p = (channel_t *) malloc(sizeof(channel_t));
-    p->produce = semaphore_create();
-    semaphore_initialize(p->produce, 0);
-    p->consume = semaphore_create();
-    semaphore_initialize(p->consume, 0);
-    
+    p = new_channel();
     f->right = p;
 
     minithread_fork(filter, (int *) f);
@@ -112,6 +106,8 @@ int sink(int* arg) {
 
 int
 main(int argc, char * argv[]) {
+  handoff = (argc > 1 && strcmp(argv[1], "handoff") == 0);
+  minithread_set_stack(64 * 1024, 0); /* the filters are shallow; guard pages would cap them at about 32000 */
   minithread_system_initialize(sink, NULL);
   return -1;
 }
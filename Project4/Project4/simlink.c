@@ -0,0 +1,129 @@
+/* simlink.c
+
+   The simulated link under network_send_pkt. Datagrams sent to ourselves
+   with a 50 ms delay and 20 ms of jitter must arrive no earlier than the
+   delay, and most within the delay plus the jitter and a clock tick (the
+   host may deschedule us now and then, so the worst one gets more slack).
+   A burst sent over a link with jitter must arrive in the order it was
+   sent, whether it leaves right away or after the delay. With 20% loss, about a fifth of 1000 datagrams must go missing. Last,
+   sending to more hosts than there are links must fail.
+
+   USAGE: ./simlink <port>
+
+   where <port> is the UDP port to use
+*/
+
+#include "minithread.h"
+#include "minimsg.h"
+#include "network.h"
+#include "machineprimitives.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#define QUANTUM_MS 10
+#define DELAY_MS 50
+#define JITTER_MS 20
+#define NUM_DELAYED 21
+#define NUM_ORDERED 200
+#define NUM_LOSSY 1000
+#define LOSS_RATE 0.2
+#define MAX_HOSTS 100 // more than the simulated links
+
+short udpPort;
+
+int main_thread(int* arg) {
+  int errors = 0;
+  network_address_t my_address;
+  network_get_my_address(my_address);
+  miniport_t* port = miniport_create_unbound(0);
+  miniport_t* to = miniport_create_bound(my_address, 0);
+  miniport_t* from;
+
+  network_sim_params_t params;
+  memset(&params, 0, sizeof(params));
+  params.delay_ms = DELAY_MS;
+  params.jitter_ms = JITTER_MS;
+  params.seed = 1;
+  network_simulated_link(&params);
+
+  unsigned long long delays[NUM_DELAYED];
+  for (int i = 0; i < NUM_DELAYED; i++) {
+    unsigned long long sentAt = currentTimeMicros(), receivedAt;
+    int length = sizeof(receivedAt);
+    minimsg_send(port, to, (char*)&sentAt, sizeof(sentAt));
+    minimsg_receive(port, &from, (char*)&receivedAt, &length);
+    miniport_destroy(from);
+    unsigned long long delay = (currentTimeMicros() - sentAt) / 1000;
+    int j = i; // insertion sort
+    for (; j > 0 && delays[j - 1] > delay; j--) delays[j] = delays[j - 1];
+    delays[j] = delay;
+  }
+  printf("%d datagrams delayed by %d+%d ms: min %llu ms, median %llu ms, max %llu ms.\n",
+    NUM_DELAYED, DELAY_MS, JITTER_MS, delays[0], delays[NUM_DELAYED / 2], delays[NUM_DELAYED - 1]);
+  if (delays[0] < DELAY_MS || delays[NUM_DELAYED / 2] > DELAY_MS + JITTER_MS + QUANTUM_MS) errors++;
+  if (delays[NUM_DELAYED - 1] > 2 * (DELAY_MS + JITTER_MS)) errors++;
+
+  int outOfOrder = 0;
+  for (int delayMs = 0; delayMs <= DELAY_MS; delayMs += DELAY_MS) {
+    memset(&params, 0, sizeof(params));
+    params.delay_ms = delayMs;
+    params.jitter_ms = JITTER_MS / 2 * (delayMs != 0); // packets catch up with the ones ahead of them
+    params.seed = 3;
+    network_simulated_link(&params);
+    for (int i = 0; i < NUM_ORDERED; i++) {
+      minimsg_send(port, to, (char*)&i, sizeof(i));
+      if (i % 10 == 0) minithread_yield(); // let the delivery thread fall behind the senders now and then
+    }
+    for (int i = 0; i < NUM_ORDERED; i++) {
+      int sequence, length = sizeof(sequence);
+      minimsg_receive(port, &from, (char*)&sequence, &length);
+      miniport_destroy(from);
+      if (sequence != i) outOfOrder++;
+    }
+  }
+  printf("%d of %d datagrams out of order.\n", outOfOrder, 2 * NUM_ORDERED);
+  if (outOfOrder != 0) errors++;
+
+  memset(&params, 0, sizeof(params));
+  params.loss_rate = LOSS_RATE;
+  params.seed = 2;
+  network_simulated_link(&params);
+  miniport_stats_t before, after;
+  miniport_get_stats(port, &before);
+  for (int i = 0; i < NUM_LOSSY; i++) minimsg_send(port, to, "x", 1);
+  miniport_get_stats(port, &after);
+  int lost = NUM_LOSSY - (after.packets_received - before.packets_received);
+  printf("%d of %d datagrams lost at a loss rate of %.0f%%.\n", lost, NUM_LOSSY, LOSS_RATE * 100);
+  if (lost < NUM_LOSSY * LOSS_RATE * 3 / 4 || lost > NUM_LOSSY * LOSS_RATE * 5 / 4) errors++;
+
+  memset(&params, 0, sizeof(params));
+  network_simulated_link(&params); // no loss, every link afresh
+  network_address_t host;
+  memcpy(host, my_address, sizeof(host));
+  int hosts = 0;
+  for (; hosts < MAX_HOSTS; hosts++) { // ports nobody listens on, one link each
+    host[1] = htons(udpPort + 1 + hosts);
+    if (network_send_pkt(host, 1, "x", 0, NULL) == -1) break;
+  }
+  host[1] = htons(udpPort + 1);
+  printf("links towards %d hosts.\n", hosts);
+  if (hosts == MAX_HOSTS || hosts == 0 || network_send_pkt(host, 1, "x", 0, NULL) != 1) errors++;
+
+  printf((errors == 0) ? "Simulated link works.\n" : "FAILED.\n");
+  exit(0); // the system never stops on its own
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    printf("FAILED.\n");
+    return -1;
+  }
+  udpPort = atoi(argv[1]);
+  network_udp_ports(udpPort, udpPort);
+  minithread_set_quantum(QUANTUM_MS);
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}
@@ -0,0 +1,102 @@
+/* stacks.c
+
+   Small stacks with guard pages, and the stack high-water marks. Threads
+   get 64 KB stacks behind guard pages. Many shallow threads block on a
+   semaphore and the distribution of their high-water marks is printed;
+   then a thread recurses about 32 KB deep and its high-water mark must
+   have grown by as much. With "overflow", a thread recurses without end
+   instead, and the program must stop with a report of the overflow.
+
+   USAGE: ./stacks [overflow]
+*/
+
+#include "minithread.h"
+#include "synch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define STACK_SIZE (64 * 1024)
+#define NUM_SHALLOW 1000
+#define DEEP_KB 32
+
+semaphore_t* gate;
+semaphore_t* done;
+minithread_t* shallow[NUM_SHALLOW];
+size_t deepUsed = 0;
+
+int idle(int* arg) {
+  semaphore_P(gate);
+  semaphore_V(done);
+  return 0;
+}
+
+// recurse kb frames of a KB each, then measure the stack
+int recurse(int kb) {
+  volatile char frame[1024];
+  memset((char*)frame, kb, sizeof(frame));
+  if (kb <= 1) {
+    minithread_stats_t stats;
+    minithread_get_stats(NULL, &stats);
+    deepUsed = stats.stackUsed;
+    return frame[0];
+  }
+  return recurse(kb - 1) + frame[kb % sizeof(frame)];
+}
+
+int deep(int* arg) {
+  recurse(*arg);
+  semaphore_V(done);
+  return 0;
+}
+
+int main_thread(int* arg) {
+  gate = semaphore_create();
+  semaphore_initialize(gate, 0);
+  done = semaphore_create();
+  semaphore_initialize(done, 0);
+
+  if (arg != NULL) { // recurse until the guard page stops the thread
+    static int forever = 1 << 30;
+    minithread_fork(deep, &forever);
+    semaphore_P(done);
+    printf("FAILED: the recursion did not overflow.\n");
+    exit(-1);
+  }
+
+  for (int i = 0; i < NUM_SHALLOW; i++) shallow[i] = minithread_fork(idle, NULL);
+  minithread_sleep_with_timeout(200); // let every thread block
+
+  size_t least = STACK_SIZE, most = 0, total = 0;
+  for (int i = 0; i < NUM_SHALLOW; i++) {
+    minithread_stats_t stats;
+    minithread_get_stats(shallow[i], &stats);
+    if (stats.stackUsed < least) least = stats.stackUsed;
+    if (stats.stackUsed > most) most = stats.stackUsed;
+    total += stats.stackUsed;
+  }
+  printf("%d blocked threads use %zu to %zu bytes of their %d KB stacks, %zu on average.\n",
+         NUM_SHALLOW, least, most, STACK_SIZE / 1024, total / NUM_SHALLOW);
+  for (int i = 0; i < NUM_SHALLOW; i++) semaphore_V(gate);
+  for (int i = 0; i < NUM_SHALLOW; i++) semaphore_P(done);
+
+  int depth = DEEP_KB;
+  minithread_fork(deep, &depth);
+  semaphore_P(done);
+  printf("A thread %d KB deep used %zu bytes of its stack.\n", DEEP_KB, deepUsed);
+
+  bool ok = (least > 0 && most < STACK_SIZE / 4 && deepUsed >= DEEP_KB * 1024 && deepUsed < STACK_SIZE);
+  printf(ok ? "Stacks work.\n" : "FAILED.\n");
+  exit(0); // the system never stops on its own
+}
+
+int main(int argc, char** argv) {
+  if (minithread_set_stack(STACK_SIZE, 1) != 0) {
+    printf("ERROR: could not set the stacks.\n");
+    exit(-1);
+  }
+  minithread_system_initialize(main_thread, (argc > 1 && strcmp(argv[1], "overflow") == 0) ? (int*)1 : NULL);
+  return -1;
+}
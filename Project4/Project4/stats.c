@@ -0,0 +1,95 @@
+/* stats.c
+
+   The statistics registry. A counter, a gauge and a histogram registered
+   by the test must hold what was added, set and recorded, and registering
+   a name again must return the same statistic unless the kind differs.
+   Then the threads sleep and wait on a semaphore, which the built-in
+   statistics of the scheduler, alarms and semaphores must count, and the
+   formatted dump must hold them. Last, the reporter thread prints every
+   statistic once.
+
+   USAGE: ./stats
+*/
+
+#include "minithread.h"
+#include "synch.h"
+#include "portos_stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_SLEEPS 5
+#define REPORT_MS 50
+
+semaphore_t* ready;
+int answer = 42;
+
+int waker(int* arg) {
+  minithread_sleep_with_timeout(10);
+  semaphore_V(ready);
+  return 0;
+}
+
+long long read_answer(void* arg) {
+  return *(int*)arg;
+}
+
+int main_thread(int* arg) {
+  int errors = 0;
+
+  portos_stat_t* counter = portos_stats_counter("test", "events");
+  portos_stat_t* gauge = portos_stats_gauge("test", "level");
+  portos_stat_t* histogram = portos_stats_histogram("test", "sizes");
+  portos_stat_t* answerStat = portos_stats_register("test", "answer", PORTOS_STAT_GAUGE, read_answer, &answer);
+  if (counter == NULL || gauge == NULL || histogram == NULL || answerStat == NULL) errors++;
+  if (portos_stats_counter("test", "events") != counter || portos_stats_gauge("test", "events") != NULL) errors++;
+  if (portos_stats_find("test", "sizes") != histogram || portos_stats_find("test", "none") != NULL) errors++;
+
+  portos_stats_add(counter, 3);
+  portos_stats_add(counter, 4);
+  portos_stats_set(gauge, 10);
+  portos_stats_set(gauge, -2);
+  for (int i = 1; i <= 100; i++) portos_stats_record(histogram, i);
+  answer = 43;
+  if (portos_stats_value(counter) != 7 || portos_stats_value(gauge) != -2 || portos_stats_value(answerStat) != 43) errors++;
+  if (portos_stats_value(histogram) != 100 || portos_stats_percentile(histogram, 0) != 1 || portos_stats_percentile(histogram, 100) != 100) errors++;
+  unsigned long long p50 = portos_stats_percentile(histogram, 50), p99 = portos_stats_percentile(histogram, 99);
+  if (p50 < 45 || p50 > 55 || p99 < 94 || p99 > 100) errors++; // interpolated within their buckets, 32 to 63 and 64 to 100
+  printf("User statistics checked, %d errors.\n", errors);
+
+  portos_stat_t* switches = portos_stats_find("scheduler", "switches");
+  portos_stat_t* fired = portos_stats_find("alarm", "fired");
+  portos_stat_t* waits = portos_stats_find("semaphore", "waits");
+  if (switches == NULL || fired == NULL || waits == NULL || portos_stats_find("network", "packets_sent") == NULL) {
+    printf("FAILED.\n");
+    exit(0);
+  }
+  long long switchesBefore = portos_stats_value(switches), firedBefore = portos_stats_value(fired), waitsBefore = portos_stats_value(waits);
+
+  ready = semaphore_create();
+  semaphore_initialize(ready, 0);
+  for (int i = 0; i < NUM_SLEEPS; i++) minithread_sleep_with_timeout(1);
+  minithread_fork(waker, NULL);
+  semaphore_P(ready); // the waker sleeps first, so this blocks
+  if (portos_stats_value(switches) <= switchesBefore || portos_stats_value(fired) < firedBefore + NUM_SLEEPS + 1 || portos_stats_value(waits) != waitsBefore + 1) errors++;
+  if (portos_stats_value(portos_stats_find("alarm", "lateness_us")) < NUM_SLEEPS + 1) errors++;
+  printf("Built-in statistics checked, %d errors.\n", errors);
+
+  char buffer[8192];
+  int length = portos_stats_format(buffer, sizeof(buffer));
+  if (length <= 0 || length >= sizeof(buffer) || strlen(buffer) != length) errors++;
+  if (strstr(buffer, "!$STAT: #alarm.fired: ") == NULL || strstr(buffer, "!$STAT: #test.events: 7\n") == NULL || strstr(buffer, "#scheduler.run_delay_us: n=") == NULL) errors++;
+  char small[16];
+  if (portos_stats_format(small, sizeof(small)) != length || strlen(small) != sizeof(small) - 1 || strncmp(small, buffer, sizeof(small) - 1) != 0) errors++;
+
+  if (portos_stats_start_reporter(0) != -1 || portos_stats_start_reporter(REPORT_MS) != 0) errors++;
+  minithread_sleep_with_timeout(REPORT_MS * 3 / 2); // one report
+  printf((errors == 0) ? "Stats work.\n" : "FAILED.\n");
+  exit(0); // the system never stops on its own
+}
+
+int main(int argc, char** argv) {
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}
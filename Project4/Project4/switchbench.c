@@ -0,0 +1,114 @@
+/* switchbench.c
+
+   Measures the cost of context switches:
+
+     yield    -- two threads call minithread_yield() in turn
+     tick     -- a thread computes alone; the time a clock interrupt takes
+                 it away for, when it gets the processor right back
+     preempt  -- two threads compute; the time from the last instruction of
+                 one to the first of the other when the clock switches
+                 between them
+
+   USAGE: ./switchbench
+*/
+
+#include "minithread.h"
+#include "synch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define YIELDS 1000000
+#define PREEMPTIONS 15 // # of gaps recorded by each test
+#define SPIN 100
+#define GAP_US 3 // a tick takes longer than this, an iteration much less
+
+semaphore_t* done;
+
+volatile int stop = 0;
+volatile unsigned long long last_us = 0; // when a computing thread last looked at the clock
+volatile int last_id = -1; // which thread it was
+unsigned long long gap_us[PREEMPTIONS];
+int gaps = 0;
+
+int yielder(int* arg) {
+  for (int i = 0; i < YIELDS; i++) minithread_yield();
+  semaphore_V(done);
+  return 0;
+}
+
+// computes, recording how long the clock interrupts took the processor away:
+// alone (id 2), the jumps of the clock across a tick; otherwise, the jumps
+// from one thread to the other
+int computer(int* arg) {
+  int id = *arg;
+  minithread_stats_t stats;
+  unsigned long long ticks = 0;
+
+  while (!stop) {
+    for (volatile int i = 0; i < SPIN; i++) ;
+    unsigned long long now = currentTimeMicros();
+    if (last_id != -1 && now > last_us) { // the other thread may have been switched in between reading the clock and publishing it
+      int interrupted = (last_id != id);
+      if (id == 2 && now - last_us > GAP_US) { // make sure it was a tick, not the host taking the processor away
+	minithread_get_stats(NULL, &stats);
+	interrupted = (ticks != 0 && stats.ticksRun != ticks);
+	ticks = stats.ticksRun;
+      }
+      if (interrupted && gaps < PREEMPTIONS) gap_us[gaps++] = now - last_us;
+      if (gaps == PREEMPTIONS) stop = 1;
+    }
+    last_us = now;
+    last_id = id;
+  }
+  semaphore_V(done);
+  return 0;
+}
+
+int compare_gaps(const void* a, const void* b) {
+  unsigned long long x = *(const unsigned long long*)a, y = *(const unsigned long long*)b;
+  return (x > y) - (x < y);
+}
+
+// reports the median of the recorded gaps, the host sometimes takes the processor away too
+void report_gaps(const char* name) {
+  qsort(gap_us, gaps, sizeof(gap_us[0]), compare_gaps);
+  printf("%-8s %8d switches, %6llu ns each (median)\n", name, gaps,
+	 gap_us[gaps / 2] * 1000);
+}
+
+int main_thread(int* arg) {
+  static int lone = 2;
+  static int ids[2] = { 0, 1 };
+
+  done = semaphore_create();
+  semaphore_initialize(done, 0);
+
+  unsigned long long start = currentTimeMicros();
+  minithread_fork(yielder, NULL);
+  minithread_fork(yielder, NULL);
+  semaphore_P(done);
+  semaphore_P(done);
+  unsigned long long elapsed_ns = (currentTimeMicros() - start) * 1000;
+  printf("%-8s %8d switches, %6llu ns each\n", "yield", 2 * YIELDS, elapsed_ns / (2 * YIELDS));
+
+  minithread_fork(computer, &lone);
+  semaphore_P(done);
+  report_gaps("tick");
+
+  stop = 0;
+  last_id = -1;
+  gaps = 0;
+  minithread_fork(computer, &ids[0]);
+  minithread_fork(computer, &ids[1]);
+  semaphore_P(done);
+  semaphore_P(done);
+  report_gaps("preempt");
+
+  exit(0);
+}
+
+int main(int argc, char** argv) {
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}
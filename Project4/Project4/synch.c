@@ -5,12 +5,14 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "defs.h"
 #include "synch.h"
 #include "queue.h"
 #include "minithread.h"
 #include "interrupts.h"
+#include "portos_stats.h"
 
 /*
  *      You must implement the procedures and types defined in this interface.
@@ -22,8 +24,20 @@
 struct semaphore {
 	int count;
 	queue_t* semaWaitQ; //sema waiting queue
+	bool handoff; //whether V switches to the thread it wakes up, see semaphore_set_handoff()
 };
 
+portos_stat_t* g_semaphoreWaitsStat = NULL; //# of times a thread blocked in semaphore_P()
+portos_stat_t* g_mutexWaitsStat = NULL; //# of times a thread blocked in mutex_lock()
+
+void synch_initialize() {
+	g_semaphoreWaitsStat = portos_stats_counter("semaphore", "waits");
+	g_mutexWaitsStat = portos_stats_counter("mutex", "waits");
+}
+
+// The wait queue holds waiting threads and, tagged with ASYNC_WAITER in the low bit, the waiters of semaphore_P_async()
+#define ASYNC_WAITER 1
+
 
 semaphore_t* semaphore_create() {
 	semaphore_t *s = malloc(sizeof(semaphore_t));
@@ -31,6 +45,7 @@ semaphore_t* semaphore_create() {
 
 	s->count = -1; //set to invalid value to ensure semaphore_initialize() called before using semaphore
 	s->semaWaitQ = queue_new();
+	s->handoff = false;
 
 	if (s->semaWaitQ == NULL)
 	{
@@ -84,6 +99,7 @@ void semaphore_P(semaphore_t *sem) {
 		minithread_t* currThread = minithread_self(); //get the calling thread
 		AbortOnCondition(currThread == NULL, "Failed in minithread_self() method in semaphore_P()");
 		queue_append(sem->semaWaitQ, currThread); //put thread onto semaphore's wait queue
+		portos_stats_add(g_semaphoreWaitsStat, 1);
 
 		minithread_stop(); //block calling thread, yield processor
 	}
@@ -109,14 +125,455 @@ void semaphore_V(semaphore_t *sem) {
 		int dequeueSuccess = queue_dequeue(sem->semaWaitQ, (void**) &t);
 		assert(t != NULL);
 		AbortOnCondition(dequeueSuccess != 0, "Failed in queue_dequeue operation in semaphore_V()");
-		
-		minithread_start(t);
+
+		if ((uintptr_t)t & ASYNC_WAITER) { // hand the semaphore to a semaphore_P_async() caller
+			semaphore_waiter_t* waiter = (semaphore_waiter_t*)((uintptr_t)t & ~(uintptr_t)ASYNC_WAITER);
+			waiter->ready(waiter->arg);
+		}
+		else if (sem->handoff && old_level == ENABLED) minithread_handoff(t); //switching is only safe if the caller does not expect interrupts to stay off
+		else minithread_start(t);
 	}
 	set_interrupt_level(old_level); //restore interrupts
 }
 
+void semaphore_P_async(semaphore_t* sem, semaphore_waiter_t* waiter) {
+	AbortOnCondition(sem == NULL || waiter == NULL || ((uintptr_t)waiter & ASYNC_WAITER), "Invalid arguments passed to semaphore_P_async()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupts
+
+	if (sem->count > 0) {
+		sem->count--;
+		waiter->ready(waiter->arg);
+	}
+	else {
+		int appendSuccess = queue_append(sem->semaWaitQ, (void*)((uintptr_t)waiter | ASYNC_WAITER)); //wait behind the threads queued before
+		AbortOnCondition(appendSuccess != 0, "Failed in queue_append operation in semaphore_P_async()");
+	}
+	set_interrupt_level(old_level); //restore interrupt level
+}
+
 bool semaphore_has_sleep_thread(semaphore_t* sem)
 {
 	AbortOnCondition(sem == NULL, "Null argument sem in semaphore_has_sleep_thread()"); // validate argument
 	return queue_length(sem->semaWaitQ) > 0;
 }
+
+void semaphore_set_handoff(semaphore_t* sem, bool handoff)
+{
+	AbortOnCondition(sem == NULL, "Null argument sem in semaphore_set_handoff()"); // validate argument
+	sem->handoff = handoff;
+}
+
+/*
+ * Mutexes.
+ */
+#define MUTEX_MAX_CHAIN 64 //# of owners priority inheritance follows, a longer chain of owners waiting for one another is a deadlock
+
+struct mutex {
+	struct semaphore sema;	//binary semaphore, its count is 1 when the mutex is free; its wait queue holds the waiters
+	minithread_t* owner;	//thread holding the mutex, NULL if free
+	struct mutex* nextContended;	//next mutex in g_contendedMutexes
+};
+
+mutex_t* g_contendedMutexes = NULL; //mutexes that have waiters, their owners inherit the waiters' priority
+
+// this function is called by queue_iterate() for each waiter of a mutex, arg is the mutex's owner
+void mutex_inherit_from_waiter(void* waiter, void* owner)
+{
+	minithread_inherit_priority((minithread_t*)owner, (minithread_t*)waiter);
+}
+
+// owner inherits the priority of waiter, and so on down the chain of owners waiting for a mutex themselves,
+// so that a thread holding up owner runs at least at waiter's priority too. Caller must disable interrupts.
+static void mutex_inherit_along_chain(minithread_t* owner, minithread_t* waiter)
+{
+	minithread_t* first = waiter;
+	for (int i = 0; i < MUTEX_MAX_CHAIN && owner != NULL && owner != first; i++) {
+		minithread_inherit_priority(owner, waiter);
+		mutex_t* next = minithread_lock_waited_for(owner);
+		if (next == NULL) break;
+		waiter = owner;
+		owner = next->owner;
+	}
+}
+
+// removes mutex from g_contendedMutexes once its last waiter has got it. Caller must disable interrupts.
+static void mutex_remove_contended(mutex_t* mutex)
+{
+	mutex_t** link = &g_contendedMutexes;
+	while (*link != mutex) link = &(*link)->nextContended;
+	*link = mutex->nextContended;
+	mutex->nextContended = NULL;
+}
+
+mutex_t* mutex_create() {
+	mutex_t* m = malloc(sizeof(mutex_t));
+	if (m == NULL) return NULL;
+
+	m->sema.count = 1; //available
+	m->sema.handoff = false; //unused, mutex_unlock() wakes the next owner itself
+	m->sema.semaWaitQ = queue_new();
+	m->owner = NULL;
+	m->nextContended = NULL;
+
+	if (m->sema.semaWaitQ == NULL)
+	{
+		free(m); //free memory just allocated
+		return NULL;
+	}
+
+	return m;
+}
+
+void mutex_destroy(mutex_t* mutex) {
+	//Validate input arguments, return if mutex is already null
+	if (mutex == NULL) return;
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interruption
+
+	//critical section
+	AbortOnCondition(mutex->owner != NULL, "Locked mutex passed to mutex_destroy()");
+	int freeQueueSuccess = queue_free(mutex->sema.semaWaitQ); //release waiting queue
+	AbortOnCondition(freeQueueSuccess != 0, "Free Queue failed in mutex_destroy()");
+	free(mutex); //release mutex
+
+	set_interrupt_level(old_level); //restore interruption level
+}
+
+void mutex_lock(mutex_t* mutex) {
+	//Validate input arguments, abort if invalid argument is seen
+	AbortOnCondition(mutex == NULL, "Null argument mutex in mutex_lock()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupts
+
+	//critical section
+	minithread_t* currThread = minithread_self(); //get the calling thread
+	AbortOnCondition(mutex->owner == currThread, "Mutex locked twice by the same thread in mutex_lock()");
+
+	if (mutex->sema.count > 0)
+	{
+		mutex->sema.count--;
+		mutex->owner = currThread;
+		minithread_lock_acquired(currThread);
+	}
+	else
+	{
+		mutex_inherit_along_chain(mutex->owner, currThread); //the owner runs at least at our priority until it unlocks
+		if (queue_length(mutex->sema.semaWaitQ) == 0) {
+			mutex->nextContended = g_contendedMutexes;
+			g_contendedMutexes = mutex;
+		}
+		queue_append(mutex->sema.semaWaitQ, currThread); //put thread onto mutex's wait queue
+		minithread_set_lock_waited_for(currThread, mutex);
+		portos_stats_add(g_mutexWaitsStat, 1);
+
+		minithread_stop(); //block calling thread, yield processor; mutex_unlock() hands us the mutex
+		assert(mutex->owner == currThread);
+	}
+	set_interrupt_level(old_level); //restore interrupt level
+}
+
+void mutex_unlock(mutex_t* mutex) {
+	//Validate input arguments, abort if invalid argument is seen
+	AbortOnCondition(mutex == NULL, "Null argument mutex in mutex_unlock()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupts
+
+	//critical section
+	minithread_t* currThread = minithread_self();
+	AbortOnCondition(mutex->owner != currThread, "Mutex unlocked by a thread that does not hold it in mutex_unlock()");
+
+	if (queue_length(mutex->sema.semaWaitQ) == 0)
+	{
+		mutex->sema.count++;
+		mutex->owner = NULL;
+	}
+	else
+	{
+		//hand the mutex over to the first waiter, it inherits the priority of the remaining waiters
+		minithread_t* t = NULL;
+		int dequeueSuccess = queue_dequeue(mutex->sema.semaWaitQ, (void**)&t);
+		AbortOnCondition(dequeueSuccess != 0, "Failed in queue_dequeue operation in mutex_unlock()");
+		if (queue_length(mutex->sema.semaWaitQ) == 0) mutex_remove_contended(mutex);
+
+		mutex->owner = t;
+		minithread_set_lock_waited_for(t, NULL); //before t runs, so that a chain of owners never leads back to the mutex
+		minithread_lock_acquired(t);
+		queue_iterate(mutex->sema.semaWaitQ, mutex_inherit_from_waiter, t);
+		minithread_start(t);
+	}
+
+	//drop the priority inherited through this mutex, keeping that of the waiters of the mutexes still held
+	minithread_lock_released(currThread);
+	for (mutex_t* m = g_contendedMutexes; m != NULL; m = m->nextContended) {
+		if (m->owner == currThread) queue_iterate(m->sema.semaWaitQ, mutex_inherit_from_waiter, currThread);
+	}
+	set_interrupt_level(old_level); //restore interrupts
+}
+
+// makes every thread in the wait queue waitQ runnable, emptying the queue in constant time. Caller must disable interrupts.
+void start_all_waiters(queue_t* waitQ)
+{
+	minithread_start_all(waitQ);
+}
+
+// puts the calling thread on the wait queue waitQ and blocks it. Caller must disable interrupts.
+void wait_on_queue(queue_t* waitQ)
+{
+	minithread_t* currThread = minithread_self(); //get the calling thread
+	int appendSuccess = queue_append(waitQ, currThread);
+	AbortOnCondition(appendSuccess != 0, "Queue append error in wait_on_queue()");
+
+	minithread_stop(); //block calling thread, yield processor
+}
+
+/*
+ * Condition variables.
+ */
+struct condvar {
+	queue_t* waitQ;	//threads waiting on the condition
+};
+
+condvar_t* condvar_create() {
+	condvar_t* cv = malloc(sizeof(condvar_t));
+	if (cv == NULL) return NULL;
+
+	cv->waitQ = queue_new();
+	if (cv->waitQ == NULL)
+	{
+		free(cv); //free memory just allocated
+		return NULL;
+	}
+
+	return cv;
+}
+
+void condvar_destroy(condvar_t* cond) {
+	//Validate input arguments, return if cond is already null
+	if (cond == NULL) return;
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interruption
+
+	//critical section
+	int freeQueueSuccess = queue_free(cond->waitQ); //release waiting queue, fails if a thread waits
+	AbortOnCondition(freeQueueSuccess != 0, "Free Queue failed in condvar_destroy()");
+	free(cond);
+
+	set_interrupt_level(old_level); //restore interruption level
+}
+
+void condvar_wait(condvar_t* cond, mutex_t* mutex) {
+	//Validate input arguments, abort if invalid argument is seen
+	AbortOnCondition(cond == NULL || mutex == NULL, "Null argument in condvar_wait()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupts so that no signal is missed between unlocking and waiting
+
+	//critical section
+	mutex_unlock(mutex);
+	wait_on_queue(cond->waitQ);
+	mutex_lock(mutex);
+
+	set_interrupt_level(old_level); //restore interrupt level
+}
+
+void condvar_signal(condvar_t* cond) {
+	//Validate input arguments, abort if invalid argument is seen
+	AbortOnCondition(cond == NULL, "Null argument cond in condvar_signal()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupts
+
+	//critical section
+	minithread_t* t = NULL;
+	if (queue_dequeue(cond->waitQ, (void**)&t) == 0) minithread_start(t);
+
+	set_interrupt_level(old_level); //restore interrupts
+}
+
+void condvar_broadcast(condvar_t* cond) {
+	//Validate input arguments, abort if invalid argument is seen
+	AbortOnCondition(cond == NULL, "Null argument cond in condvar_broadcast()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupts
+
+	//critical section
+	start_all_waiters(cond->waitQ);
+
+	set_interrupt_level(old_level); //restore interrupts
+}
+
+/*
+ * Reader-writer locks.
+ */
+struct rwlock {
+	int readers;			//# of readers holding the lock
+	minithread_t* writer;	//writer holding the lock, NULL if none
+	queue_t* readWaitQ;		//readers waiting for the lock
+	queue_t* writeWaitQ;	//writers waiting for the lock
+};
+
+rwlock_t* rwlock_create() {
+	rwlock_t* lock = malloc(sizeof(rwlock_t));
+	if (lock == NULL) return NULL;
+
+	lock->readers = 0;
+	lock->writer = NULL;
+	lock->readWaitQ = queue_new();
+	lock->writeWaitQ = queue_new();
+
+	if (lock->readWaitQ == NULL || lock->writeWaitQ == NULL)
+	{
+		queue_free(lock->readWaitQ); //free memory just allocated
+		queue_free(lock->writeWaitQ);
+		free(lock);
+		return NULL;
+	}
+
+	return lock;
+}
+
+void rwlock_destroy(rwlock_t* lock) {
+	//Validate input arguments, return if lock is already null
+	if (lock == NULL) return;
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interruption
+
+	//critical section
+	AbortOnCondition(lock->readers != 0 || lock->writer != NULL, "Held lock passed to rwlock_destroy()");
+	int freeQueueSuccess = queue_free(lock->readWaitQ);
+	freeQueueSuccess |= queue_free(lock->writeWaitQ);
+	AbortOnCondition(freeQueueSuccess != 0, "Free Queue failed in rwlock_destroy()");
+	free(lock);
+
+	set_interrupt_level(old_level); //restore interruption level
+}
+
+void rwlock_read_lock(rwlock_t* lock) {
+	//Validate input arguments, abort if invalid argument is seen
+	AbortOnCondition(lock == NULL, "Null argument lock in rwlock_read_lock()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupts
+
+	//critical section
+	if (lock->writer == NULL && queue_length(lock->writeWaitQ) == 0) lock->readers++;
+	else wait_on_queue(lock->readWaitQ); //the writer that wakes us up counts us as a reader
+
+	set_interrupt_level(old_level); //restore interrupt level
+}
+
+void rwlock_read_unlock(rwlock_t* lock) {
+	//Validate input arguments, abort if invalid argument is seen
+	AbortOnCondition(lock == NULL, "Null argument lock in rwlock_read_unlock()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupts
+
+	//critical section
+	AbortOnCondition(lock->readers <= 0, "Lock not held for reading in rwlock_read_unlock()");
+	lock->readers--;
+	if (lock->readers == 0 && queue_length(lock->writeWaitQ) > 0) // the last reader hands the lock to the first waiting writer
+	{
+		int dequeueSuccess = queue_dequeue(lock->writeWaitQ, (void**)&lock->writer);
+		AbortOnCondition(dequeueSuccess != 0, "Failed in queue_dequeue operation in rwlock_read_unlock()");
+		minithread_start(lock->writer);
+	}
+
+	set_interrupt_level(old_level); //restore interrupts
+}
+
+void rwlock_write_lock(rwlock_t* lock) {
+	//Validate input arguments, abort if invalid argument is seen
+	AbortOnCondition(lock == NULL, "Null argument lock in rwlock_write_lock()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupts
+
+	//critical section
+	if (lock->writer == NULL && lock->readers == 0) lock->writer = minithread_self();
+	else wait_on_queue(lock->writeWaitQ); //the thread that wakes us up makes us the writer
+
+	set_interrupt_level(old_level); //restore interrupt level
+}
+
+void rwlock_write_unlock(rwlock_t* lock) {
+	//Validate input arguments, abort if invalid argument is seen
+	AbortOnCondition(lock == NULL, "Null argument lock in rwlock_write_unlock()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupts
+
+	//critical section
+	AbortOnCondition(lock->writer != minithread_self(), "Lock not held for writing in rwlock_write_unlock()");
+	lock->writer = NULL;
+	if (queue_length(lock->readWaitQ) > 0) // the readers that waited go first, all at once
+	{
+		lock->readers += queue_length(lock->readWaitQ);
+		start_all_waiters(lock->readWaitQ);
+	}
+	else if (queue_length(lock->writeWaitQ) > 0) // then the next writer
+	{
+		int dequeueSuccess = queue_dequeue(lock->writeWaitQ, (void**)&lock->writer);
+		AbortOnCondition(dequeueSuccess != 0, "Failed in queue_dequeue operation in rwlock_write_unlock()");
+		minithread_start(lock->writer);
+	}
+
+	set_interrupt_level(old_level); //restore interrupts
+}
+
+/*
+ * Barriers.
+ */
+struct barrier {
+	int parties;	//# of threads to wait for
+	int arrived;	//# of threads waiting in the current phase
+	queue_t* waitQ;	//threads waiting in the current phase
+};
+
+barrier_t* barrier_create(int parties) {
+	if (parties <= 0) return NULL;
+
+	barrier_t* barrier = malloc(sizeof(barrier_t));
+	if (barrier == NULL) return NULL;
+
+	barrier->parties = parties;
+	barrier->arrived = 0;
+	barrier->waitQ = queue_new();
+	if (barrier->waitQ == NULL)
+	{
+		free(barrier); //free memory just allocated
+		return NULL;
+	}
+
+	return barrier;
+}
+
+void barrier_destroy(barrier_t* barrier) {
+	//Validate input arguments, return if barrier is already null
+	if (barrier == NULL) return;
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interruption
+
+	//critical section
+	int freeQueueSuccess = queue_free(barrier->waitQ); //release waiting queue, fails if a thread waits
+	AbortOnCondition(freeQueueSuccess != 0, "Free Queue failed in barrier_destroy()");
+	free(barrier);
+
+	set_interrupt_level(old_level); //restore interruption level
+}
+
+int barrier_wait(barrier_t* barrier) {
+	//Validate input arguments, abort if invalid argument is seen
+	AbortOnCondition(barrier == NULL, "Null argument barrier in barrier_wait()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //disable interrupts
+
+	//critical section
+	int last = 0;
+	barrier->arrived++;
+	if (barrier->arrived < barrier->parties) wait_on_queue(barrier->waitQ);
+	else // everyone is here, release the phase
+	{
+		barrier->arrived = 0;
+		start_all_waiters(barrier->waitQ);
+		last = 1;
+	}
+
+	set_interrupt_level(old_level); //restore interrupt level
+	return last;
+}
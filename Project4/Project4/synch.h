@@ -9,6 +9,17 @@
 #include <stdbool.h>
 
 typedef struct semaphore semaphore_t;
+typedef struct mutex mutex_t;
+typedef struct condvar condvar_t;
+typedef struct rwlock rwlock_t;
+typedef struct barrier barrier_t;
+
+/*
+ * synch_initialize()
+ *  Register the statistics of the primitives, the # of times a thread
+ *  blocked on a semaphore or mutex; called by minithread_system_initialize().
+ */
+void synch_initialize();
 
 /*
  * Semaphores.
@@ -52,5 +63,164 @@ void semaphore_V(semaphore_t *sem);
 */
 bool semaphore_has_sleep_thread(semaphore_t* sem);
 
+/*
+ * semaphore_set_handoff(semaphore_t* sem, bool handoff)
+ *  In handoff mode, semaphore_V() switches straight to the thread it wakes
+ *  up when that thread is at least as important as the caller, instead of
+ *  queueing it behind the other runnable threads (see minithread_handoff()).
+ *  This cuts the latency of producer/consumer and request/reply exchanges.
+ *  It is off by default, and V never hands off from an interrupt handler or
+ *  with interrupts disabled.
+ */
+void semaphore_set_handoff(semaphore_t* sem, bool handoff);
+
+/*
+ * semaphore_P_async(semaphore_t* sem, semaphore_waiter_t* waiter)
+ *  P on the semaphore without blocking the caller: once the semaphore has
+ *  been taken, waiter->ready(waiter->arg) is called. That happens right
+ *  away if the count is positive, otherwise in the semaphore_V() that hands
+ *  the semaphore over, after the threads and waiters queued before. ready
+ *  is called with interrupts disabled, possibly from an interrupt handler,
+ *  and must not block. The waiter must stay allocated until then.
+ */
+typedef struct semaphore_waiter {
+	void (*ready)(void* arg);
+	void* arg;
+} semaphore_waiter_t;
+
+void semaphore_P_async(semaphore_t* sem, semaphore_waiter_t* waiter);
+
+/*
+ * Mutexes.
+ *
+ *  A mutex is a lock with an owner: only the thread that locked it may
+ *  unlock it. While threads wait for a mutex, its owner runs with at least
+ *  the priority of the most important of them (priority inheritance), so
+ *  that a low priority owner cannot hold up high priority threads for many
+ *  quanta. Waiters get the mutex in FIFO order.
+ */
+
+/*
+ * mutex_t* mutex_create()
+ *  Allocate a new, unlocked mutex. Returns NULL on failure.
+ */
+mutex_t* mutex_create();
+
+/*
+ * mutex_destroy(mutex_t* mutex)
+ *  Deallocate a mutex. It must not be locked.
+ */
+void mutex_destroy(mutex_t* mutex);
+
+/*
+ * mutex_lock(mutex_t* mutex)
+ *  Lock the mutex, waiting for its owner to unlock it if needed.
+ *  A thread may not lock a mutex it already holds.
+ */
+void mutex_lock(mutex_t* mutex);
+
+/*
+ * mutex_unlock(mutex_t* mutex)
+ *  Unlock a mutex held by the caller, handing it to the first waiter.
+ */
+void mutex_unlock(mutex_t* mutex);
+
+/*
+ * Condition variables.
+ *
+ *  Mesa style: a woken thread re-acquires the mutex before it returns from
+ *  condvar_wait() and must check its condition again.
+ */
+
+/*
+ * condvar_t* condvar_create()
+ *  Allocate a new condition variable. Returns NULL on failure.
+ */
+condvar_t* condvar_create();
+
+/*
+ * condvar_destroy(condvar_t* cond)
+ *  Deallocate a condition variable. No thread may be waiting on it.
+ */
+void condvar_destroy(condvar_t* cond);
+
+/*
+ * condvar_wait(condvar_t* cond, mutex_t* mutex)
+ *  Atomically unlock mutex, which the caller must hold, and wait on cond.
+ *  The mutex is locked again when the call returns.
+ */
+void condvar_wait(condvar_t* cond, mutex_t* mutex);
+
+/*
+ * condvar_signal(condvar_t* cond)
+ *  Wake up the thread that has been waiting on cond the longest, if any.
+ */
+void condvar_signal(condvar_t* cond);
+
+/*
+ * condvar_broadcast(condvar_t* cond)
+ *  Wake up all the threads waiting on cond.
+ */
+void condvar_broadcast(condvar_t* cond);
+
+/*
+ * Reader-writer locks.
+ *
+ *  Any number of readers or a single writer hold the lock. A writer that
+ *  waits keeps new readers out, and the readers that waited meanwhile go
+ *  before the next writer, so neither side starves.
+ */
+
+/*
+ * rwlock_t* rwlock_create()
+ *  Allocate a new, unlocked reader-writer lock. Returns NULL on failure.
+ */
+rwlock_t* rwlock_create();
+
+/*
+ * rwlock_destroy(rwlock_t* lock)
+ *  Deallocate a reader-writer lock. It must not be held.
+ */
+void rwlock_destroy(rwlock_t* lock);
+
+/*
+ * rwlock_read_lock(rwlock_t* lock), rwlock_read_unlock(rwlock_t* lock)
+ *  Acquire and release the lock for reading.
+ */
+void rwlock_read_lock(rwlock_t* lock);
+void rwlock_read_unlock(rwlock_t* lock);
+
+/*
+ * rwlock_write_lock(rwlock_t* lock), rwlock_write_unlock(rwlock_t* lock)
+ *  Acquire and release the lock for writing.
+ */
+void rwlock_write_lock(rwlock_t* lock);
+void rwlock_write_unlock(rwlock_t* lock);
+
+/*
+ * Barriers.
+ */
+
+/*
+ * barrier_t* barrier_create(int parties)
+ *  Allocate a barrier for parties threads. Returns NULL on failure or if
+ *  parties is not positive.
+ */
+barrier_t* barrier_create(int parties);
+
+/*
+ * barrier_destroy(barrier_t* barrier)
+ *  Deallocate a barrier. No thread may be waiting on it.
+ */
+void barrier_destroy(barrier_t* barrier);
+
+/*
+ * int barrier_wait(barrier_t* barrier)
+ *  Wait until parties threads have called barrier_wait(), then release them
+ *  all; the barrier is then ready for the next phase. Returns 1 in the last
+ *  thread to arrive and 0 in the others.
+ */
+int barrier_wait(barrier_t* barrier);
+
 
 #endif /*__SYNCH_H__*/
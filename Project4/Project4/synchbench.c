@@ -0,0 +1,187 @@
+/* synchbench.c
+
+   Microbenchmarks for the condition variables, reader-writer locks and
+   barriers in synch.h:
+
+     condvar  -- two threads hand a token back and forth through a mutex
+                 and two condition variables, then one thread broadcasts
+                 to NUM_WAITERS waiters over and over
+     rwlock   -- NUM_READERS threads read a shared table, yielding inside
+                 the critical section, once under a mutex and once under a
+                 reader-writer lock; a writer updates the table now and then
+     barrier  -- NUM_PARTIES threads go through barrier phases
+
+   USAGE: ./synchbench
+*/
+
+#include "minithread.h"
+#include "synch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PINGPONG_ROUNDS 100000
+#define NUM_WAITERS 16
+#define BROADCAST_ROUNDS 10000
+#define NUM_READERS 8
+#define READS_PER_READER 20000
+#define WRITE_EVERY 1000
+#define TABLE_SIZE 64
+#define NUM_PARTIES 8
+#define BARRIER_PHASES 20000
+
+mutex_t* mutex;
+semaphore_t* done;
+unsigned long long startTime;
+
+// reports the operations per second since startTime
+void report(const char* name, unsigned long long ops) {
+  unsigned long long elapsed = currentTimeMillis() - startTime;
+  printf("%-22s %8llu ops in %5llu ms (%llu ops/s)\n", name, ops, elapsed,
+         (elapsed > 0) ? ops * 1000 / elapsed : 0ULL);
+}
+
+/* ---- condition variables ---- */
+condvar_t* turnChanged;
+condvar_t* allArrived;
+int turn = 0;
+int generation = 0;
+int waiting = 0;
+
+int pinger(int* arg) {
+  int me = *arg;
+  mutex_lock(mutex);
+  for (int i = 0; i < PINGPONG_ROUNDS; i++) {
+    while (turn != me) condvar_wait(turnChanged, mutex);
+    turn = 1 - me;
+    condvar_signal(turnChanged);
+  }
+  mutex_unlock(mutex);
+  semaphore_V(done);
+  return 0;
+}
+
+int broadcast_waiter(int* arg) {
+  mutex_lock(mutex);
+  for (int i = 0; i < BROADCAST_ROUNDS; i++) {
+    int g = generation;
+    waiting++;
+    condvar_signal(allArrived);
+    while (generation == g) condvar_wait(turnChanged, mutex);
+  }
+  mutex_unlock(mutex);
+  semaphore_V(done);
+  return 0;
+}
+
+void bench_condvar() {
+  static int ids[2] = { 0, 1 };
+
+  turnChanged = condvar_create();
+  allArrived = condvar_create();
+
+  startTime = currentTimeMillis();
+  minithread_fork(pinger, &ids[0]);
+  minithread_fork(pinger, &ids[1]);
+  semaphore_P(done);
+  semaphore_P(done);
+  report("condvar ping-pong", 2 * PINGPONG_ROUNDS);
+
+  startTime = currentTimeMillis();
+  for (int i = 0; i < NUM_WAITERS; i++) minithread_fork(broadcast_waiter, NULL);
+  mutex_lock(mutex);
+  for (int i = 0; i < BROADCAST_ROUNDS; i++) {
+    while (waiting < NUM_WAITERS) condvar_wait(allArrived, mutex);
+    waiting = 0;
+    generation++;
+    condvar_broadcast(turnChanged);
+  }
+  mutex_unlock(mutex);
+  for (int i = 0; i < NUM_WAITERS; i++) semaphore_P(done);
+  report("condvar broadcast", (unsigned long long)BROADCAST_ROUNDS * NUM_WAITERS);
+
+  condvar_destroy(turnChanged);
+  condvar_destroy(allArrived);
+}
+
+/* ---- reader-writer locks ---- */
+rwlock_t* rwlock;
+int table[TABLE_SIZE];
+volatile int sum;
+int useRwlock;
+
+int reader(int* arg) {
+  for (int i = 0; i < READS_PER_READER; i++) {
+    if (i % WRITE_EVERY == 0 && *arg == 0) { // reader 0 also writes now and then
+      if (useRwlock) rwlock_write_lock(rwlock); else mutex_lock(mutex);
+      table[i % TABLE_SIZE]++;
+      if (useRwlock) rwlock_write_unlock(rwlock); else mutex_unlock(mutex);
+    }
+
+    if (useRwlock) rwlock_read_lock(rwlock); else mutex_lock(mutex);
+    int s = 0;
+    for (int j = 0; j < TABLE_SIZE; j++) s += table[j];
+    minithread_yield(); // give the other readers a chance to share the lock
+    sum = s;
+    if (useRwlock) rwlock_read_unlock(rwlock); else mutex_unlock(mutex);
+  }
+  semaphore_V(done);
+  return 0;
+}
+
+void bench_readers(int rw) {
+  static int ids[NUM_READERS];
+
+  useRwlock = rw;
+  startTime = currentTimeMillis();
+  for (int i = 0; i < NUM_READERS; i++) {
+    ids[i] = i;
+    minithread_fork(reader, &ids[i]);
+  }
+  for (int i = 0; i < NUM_READERS; i++) semaphore_P(done);
+  report(rw ? "rwlock reads" : "mutex reads", (unsigned long long)NUM_READERS * READS_PER_READER);
+}
+
+/* ---- barriers ---- */
+barrier_t* barrier;
+int lastCount = 0;
+
+int party(int* arg) {
+  for (int i = 0; i < BARRIER_PHASES; i++) {
+    if (barrier_wait(barrier)) lastCount++;
+  }
+  semaphore_V(done);
+  return 0;
+}
+
+void bench_barrier() {
+  barrier = barrier_create(NUM_PARTIES);
+
+  startTime = currentTimeMillis();
+  for (int i = 0; i < NUM_PARTIES; i++) minithread_fork(party, NULL);
+  for (int i = 0; i < NUM_PARTIES; i++) semaphore_P(done);
+  report("barrier phases", BARRIER_PHASES);
+  if (lastCount != BARRIER_PHASES) printf("ERROR: %d threads were last, expected %d.\n", lastCount, BARRIER_PHASES);
+
+  barrier_destroy(barrier);
+}
+
+int main_thread(int* arg) {
+  mutex = mutex_create();
+  done = semaphore_create();
+  semaphore_initialize(done, 0);
+  rwlock = rwlock_create();
+
+  bench_condvar();
+  bench_readers(0);
+  bench_readers(1);
+  bench_barrier();
+
+  printf("Done.\n");
+  exit(0);
+}
+
+int main(int argc, char** argv) {
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}
@@ -0,0 +1,152 @@
+/*
+ * Implementation of the lightweight tasks.
+ */
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "defs.h"
+#include "task.h"
+#include "minithread.h"
+#include "interrupts.h"
+#include "alarm.h"
+
+struct task {
+	semaphore_waiter_t waiter;	//wakes the task up, see task_wake()
+	task_proc_t next;			//the step to run next, NULL while a step runs until it awaits
+	void* arg;
+	task_t* nextReady;			//link in the ready list
+	minisocket_t* socket;		//the socket of an awaited receive, NULL if none
+	char* msg;					//where the awaited receive stores its data
+	int maxLen;					//the buffer size of the awaited receive, then what it returned
+	minisocket_error error;		//the error of the awaited receive
+};
+
+static task_t* g_readyHead = NULL;			//the tasks ready to run their next step, oldest first
+static task_t* g_readyTail = NULL;
+static minithread_t* g_taskRunner = NULL;	//the thread running the tasks, created on the first spawn
+static bool g_taskRunnerWaiting = false;	//whether the runner has stopped for lack of ready tasks
+
+// This function makes the task ready, starting the runner if it waits. Called with interrupts disabled.
+static void task_wake(void* arg)
+{
+	task_t* task = (task_t*)arg;
+	task->nextReady = NULL;
+	if (g_readyTail == NULL) g_readyHead = task;
+	else g_readyTail->nextReady = task;
+	g_readyTail = task;
+
+	if (g_taskRunnerWaiting) {
+		g_taskRunnerWaiting = false;
+		minithread_start(g_taskRunner);
+	}
+}
+
+// This function is the alarm handler of task_await_sleep()
+static void task_alarm_handler(void* arg)
+{
+	task_wake(arg);
+}
+
+// This function is the body of the runner thread: it runs the next step of each ready task, forever
+static int task_runner(int* arg)
+{
+	while (1) {
+		interrupt_level_t old_level = set_interrupt_level(DISABLED);
+		while (g_readyHead == NULL) {
+			g_taskRunnerWaiting = true;
+			minithread_stop(); //this reenables interrupts
+			set_interrupt_level(DISABLED);
+		}
+		task_t* task = g_readyHead;
+		g_readyHead = task->nextReady;
+		if (g_readyHead == NULL) g_readyTail = NULL;
+		set_interrupt_level(old_level);
+
+		if (task->socket != NULL) { // the awaited receive can now complete without blocking
+			task->maxLen = minisocket_receive_ready(task->socket, task->msg, task->maxLen, &task->error);
+			task->socket = NULL;
+		}
+
+		task_proc_t step = task->next;
+		task->next = NULL;
+		step(task, task->arg);
+		if (task->next == NULL) free(task); //the step did not await, the task is done
+	}
+	return 0;
+}
+
+task_t* task_spawn(task_proc_t proc, void* arg)
+{
+	AbortOnCondition(proc == NULL, "Null argument proc in task_spawn()");
+
+	task_t* task = malloc(sizeof(task_t));
+	if (task == NULL) return NULL;
+	task->waiter.ready = task_wake;
+	task->waiter.arg = task;
+	task->next = proc;
+	task->arg = arg;
+	task->socket = NULL;
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	if (g_taskRunner == NULL) {
+		g_taskRunner = minithread_create(task_runner, NULL);
+		AbortOnCondition(g_taskRunner == NULL, "Failed to create the task runner in task_spawn()");
+		g_taskRunnerWaiting = true; //task_wake() schedules it
+	}
+	task_wake(task);
+	set_interrupt_level(old_level);
+	return task;
+}
+
+void task_await_P(task_t* task, semaphore_t* sem, task_proc_t next)
+{
+	AbortOnCondition(task == NULL || next == NULL || task->next != NULL, "Invalid arguments passed to task_await_P()");
+
+	task->next = next;
+	semaphore_P_async(sem, &task->waiter);
+}
+
+void task_await_sleep(task_t* task, int delay, task_proc_t next)
+{
+	AbortOnCondition(task == NULL || next == NULL || task->next != NULL, "Invalid arguments passed to task_await_sleep()");
+
+	task->next = next;
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //the alarm must not go off before it is registered
+	alarm_id newAlarm = register_alarm(delay, task_alarm_handler, task);
+	set_interrupt_level(old_level);
+	AbortOnCondition(newAlarm == NULL, "Failed to register an alarm in task_await_sleep()");
+}
+
+void task_await_receive(task_t* task, minisocket_t* socket, char* msg, int max_len, task_proc_t next)
+{
+	AbortOnCondition(task == NULL || next == NULL || task->next != NULL, "Invalid arguments passed to task_await_receive()");
+
+	task->next = next;
+	if (socket == NULL || msg == NULL || max_len <= 0) { // minisocket_receive() would not wait either
+		task->maxLen = minisocket_receive(socket, msg, max_len, &task->error);
+		task_yield(task, next);
+		return;
+	}
+	task->socket = socket;
+	task->msg = msg;
+	task->maxLen = max_len;
+	minisocket_receive_notify(socket, &task->waiter);
+}
+
+void task_yield(task_t* task, task_proc_t next)
+{
+	AbortOnCondition(task == NULL || next == NULL, "Invalid arguments passed to task_yield()");
+
+	task->next = next;
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	task_wake(task);
+	set_interrupt_level(old_level);
+}
+
+int task_received(task_t* task, minisocket_error* error)
+{
+	AbortOnCondition(task == NULL, "Null argument task in task_received()");
+
+	if (error != NULL) *error = task->error;
+	return task->maxLen;
+}
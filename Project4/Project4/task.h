@@ -0,0 +1,64 @@
+/*
+ * task.h:
+ *  Lightweight tasks, for work that mostly waits (e.g. one per connection).
+ *
+ *  A task has no stack of its own. It is written as a chain of steps: each
+ *  step is a task_proc_t that runs to completion and, instead of blocking,
+ *  ends by calling one of the task_await_*() functions with the step to
+ *  continue with once the wait is over. A step that returns without
+ *  awaiting finishes the task. Anything a later step needs must be kept in
+ *  arg, not in local variables.
+ *
+ *  All tasks are run one step at a time by a single minithread, created by
+ *  the first task_spawn(), which the scheduler runs like any other thread
+ *  and which stops while no task is ready. A waiting task costs a few words
+ *  plus the wait queue entry of what it waits on (about 110 bytes of heap
+ *  for a semaphore, see tasks.c); a connection adds its minisocket.
+ */
+#ifndef __TASK_H__
+#define __TASK_H__
+
+#include "synch.h"
+#include "minisocket.h"
+
+typedef struct task task_t;
+
+typedef void (*task_proc_t)(task_t* task, void* arg);
+
+/*
+ * task_t* task_spawn(task_proc_t proc, void* arg)
+ *  Create a task whose first step is proc(task, arg). It is run after the
+ *  tasks already ready. Returns NULL if out of memory.
+ */
+task_t* task_spawn(task_proc_t proc, void* arg);
+
+/*
+ * Awaiting. Each must be the last thing a step does, and a step awaits at
+ * most once; next then runs with the same task and arg.
+ *
+ * task_await_P(task_t* task, semaphore_t* sem, task_proc_t next)
+ *  Continue with next once the task has taken sem, as semaphore_P() would.
+ *
+ * task_await_sleep(task_t* task, int delay, task_proc_t next)
+ *  Continue with next after delay milliseconds, as
+ *  minithread_sleep_with_timeout() would.
+ *
+ * task_await_receive(task_t* task, minisocket_t* socket, char* msg, int max_len, task_proc_t next)
+ *  Receive into msg as minisocket_receive() would, and continue with next
+ *  once it completes; next reads the outcome with task_received().
+ *
+ * task_yield(task_t* task, task_proc_t next)
+ *  Continue with next after the other ready tasks.
+ */
+void task_await_P(task_t* task, semaphore_t* sem, task_proc_t next);
+void task_await_sleep(task_t* task, int delay, task_proc_t next);
+void task_await_receive(task_t* task, minisocket_t* socket, char* msg, int max_len, task_proc_t next);
+void task_yield(task_t* task, task_proc_t next);
+
+/*
+ * int task_received(task_t* task, minisocket_error* error)
+ *  The return value and error of the task's last task_await_receive().
+ */
+int task_received(task_t* task, minisocket_error* error);
+
+#endif /*__TASK_H__*/
@@ -0,0 +1,208 @@
+/* tasks.c
+
+   Lightweight tasks. First, NUM_CONNS tasks each wait to receive on the
+   server end of their own loopback connection, as the connections of a
+   server would, and each must receive the one byte a thread then sends
+   over every connection. Then 100000 tasks wait on a semaphore at the same
+   time, and all run once it is V'ed as many times. For both, the memory
+   each waiting task adds to the heap is printed; for the connections, it
+   covers the sockets at both ends. Three tasks sleep for different delays
+   and must wake up shortest first. Last, a task receives over a loopback
+   minisocket, in two awaits through a small buffer, the message a thread
+   sends it.
+
+   USAGE: ./tasks [<udp port>]
+
+   where <udp port> is the UDP port of the simulated network, 9200 by default.
+*/
+
+#include "minithread.h"
+#include "minisocket.h"
+#include "synch.h"
+#include "task.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#define NUM_IDLE 100000
+#define SOCKET_PORT 80
+#define NUM_CONNS 5000
+#define CONN_PORT 1000 // server port of the first of the NUM_CONNS connections
+#define MESSAGE "hello from a thread"
+
+semaphore_t* gate;
+semaphore_t* done;
+int passed = 0;
+int woken[3];
+int numWoken = 0;
+int errors = 0;
+
+void idle_passed(task_t* task, void* arg) {
+  if (++passed == NUM_IDLE) semaphore_V(done);
+}
+
+void idle(task_t* task, void* arg) {
+  task_await_P(task, gate, idle_passed);
+}
+
+void sleeper_woken(task_t* task, void* arg) {
+  woken[numWoken++] = *(int*)arg;
+  if (numWoken == 3) semaphore_V(done);
+}
+
+void sleeper(task_t* task, void* arg) {
+  task_await_sleep(task, *(int*)arg, sleeper_woken);
+}
+
+typedef struct receive_state {
+  minisocket_t* socket;
+  char message[64];
+  int length;
+} receive_state_t;
+
+void receive_rest(task_t* task, void* arg);
+
+void received(task_t* task, void* arg) {
+  receive_state_t* state = arg;
+  minisocket_error error;
+  int n = task_received(task, &error);
+  if (n <= 0) {
+    printf("ERROR: receive failed with error %d.\n", error);
+    exit(-1);
+  }
+  state->length += n;
+  receive_rest(task, arg);
+}
+
+void receive_rest(task_t* task, void* arg) {
+  receive_state_t* state = arg;
+  if (state->length < (int)strlen(MESSAGE)) { // receive at most 8 bytes at a time, so that it takes several awaits
+    task_await_receive(task, state->socket, state->message + state->length, 8, received);
+    return;
+  }
+  state->message[state->length] = '\0';
+  if (strcmp(state->message, MESSAGE) != 0) errors++;
+  semaphore_V(done);
+}
+
+semaphore_t* listening; // V'ed by the listener right before it waits for the next connection
+minisocket_t* servers[NUM_CONNS];
+minisocket_t* clients[NUM_CONNS];
+char bytes[NUM_CONNS];
+int numReceived = 0;
+
+// the bytes of heap in use, freed memory that is reused does not count twice
+long heap_bytes() {
+  return (long)mallinfo2().uordblks;
+}
+
+void conn_received(task_t* task, void* arg) {
+  minisocket_error error;
+  if (task_received(task, &error) != 1) errors++;
+  if (++numReceived == NUM_CONNS) semaphore_V(done);
+}
+
+void conn_wait(task_t* task, void* arg) {
+  int i = (int)(intptr_t)arg;
+  task_await_receive(task, servers[i], &bytes[i], 1, conn_received);
+}
+
+int listener(int* arg) {
+  minisocket_error error;
+  for (int i = 0; i < NUM_CONNS; i++) {
+    semaphore_V(listening);
+    servers[i] = minisocket_server_create(CONN_PORT + i, &error);
+    if (servers[i] == NULL) {
+      printf("ERROR: server_create failed with error %d.\n", error);
+      exit(-1);
+    }
+    task_spawn(conn_wait, (void*)(intptr_t)i);
+  }
+  semaphore_V(listening);
+  return 0;
+}
+
+int sender(int* arg) {
+  minisocket_error error;
+  minisocket_t* socket = minisocket_server_create(SOCKET_PORT, &error);
+  if (socket == NULL) {
+    printf("ERROR: server_create failed with error %d.\n", error);
+    exit(-1);
+  }
+  minithread_sleep_with_timeout(100); // the task is waiting by now
+  minisocket_send(socket, MESSAGE, strlen(MESSAGE), &error);
+  return 0;
+}
+
+int main_thread(int* arg) {
+  network_address_t my_address;
+  minisocket_error error;
+  network_get_my_address(my_address);
+  gate = semaphore_create();
+  semaphore_initialize(gate, 0);
+  done = semaphore_create();
+  semaphore_initialize(done, 0);
+  listening = semaphore_create();
+  semaphore_initialize(listening, 0);
+
+  long before = heap_bytes();
+  minithread_fork(listener, NULL);
+  for (int i = 0; i < NUM_CONNS; i++) {
+    semaphore_P(listening); // the listener waits for connection i by now
+    clients[i] = minisocket_client_create(my_address, CONN_PORT + i, &error);
+    if (clients[i] == NULL) {
+      printf("ERROR: client_create failed with error %d.\n", error);
+      exit(-1);
+    }
+  }
+  semaphore_P(listening); // the last task waits too
+  long bytes = heap_bytes() - before;
+  printf("%d tasks waiting on their own connection: %ld KB, %ld bytes each.\n", NUM_CONNS, bytes / 1024, bytes / NUM_CONNS);
+  for (int i = 0; i < NUM_CONNS; i++) minisocket_send(clients[i], "x", 1, &error);
+  semaphore_P(done);
+  printf("%d of %d connections received a byte.\n", numReceived, NUM_CONNS);
+
+  before = heap_bytes();
+  for (int i = 0; i < NUM_IDLE; i++) {
+    if (task_spawn(idle, NULL) == NULL) {
+      printf("ERROR: out of memory after %d tasks.\n", i);
+      exit(-1);
+    }
+  }
+  minithread_sleep_with_timeout(100); // let every task wait
+  if (passed != 0) errors++;
+  bytes = heap_bytes() - before;
+  printf("%d tasks waiting on a semaphore: %ld KB, %ld bytes each.\n", NUM_IDLE, bytes / 1024, bytes / NUM_IDLE);
+  for (int i = 0; i < NUM_IDLE; i++) semaphore_V(gate);
+  semaphore_P(done);
+  printf("%d tasks passed the semaphore.\n", passed);
+
+  static int delays[3] = { 300, 100, 200 };
+  for (int i = 0; i < 3; i++) task_spawn(sleeper, &delays[i]);
+  semaphore_P(done);
+  printf("Sleeping tasks woke up after %d, %d and %d ms.\n", woken[0], woken[1], woken[2]);
+  if (woken[0] != 100 || woken[1] != 200 || woken[2] != 300) errors++;
+
+  static receive_state_t state;
+  minithread_fork(sender, NULL);
+  state.socket = minisocket_client_create(my_address, SOCKET_PORT, &error);
+  if (state.socket == NULL) {
+    printf("ERROR: client_create failed with error %d.\n", error);
+    exit(-1);
+  }
+  task_spawn(receive_rest, &state);
+  semaphore_P(done);
+  printf("A task received \"%s\".\n", state.message);
+
+  printf((passed == NUM_IDLE && numReceived == NUM_CONNS && errors == 0) ? "Tasks work.\n" : "FAILED.\n");
+  exit(0); // the system never stops on its own
+}
+
+int main(int argc, char** argv) {
+  short port = (argc > 1) ? atoi(argv[1]) : 9200;
+  network_udp_ports(port, port);
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}
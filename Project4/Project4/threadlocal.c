@@ -0,0 +1,85 @@
+/* threadlocal.c
+
+   Thread-local storage and per-thread object caches. Several threads each
+   keep a counter under the same key and bump it while yielding to each
+   other; every thread must only ever see its own counter, and the
+   destructor must free each counter once its thread finishes. Then each
+   thread frees an object into a cache and allocates one: it must get its
+   own object back.
+
+   USAGE: ./threadlocal
+*/
+
+#include "minithread.h"
+#include "synch.h"
+#include "objcache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_THREADS 4
+#define ROUNDS 100
+
+minithread_key_t counterKey;
+objcache_t* cache;
+semaphore_t* done;
+int destroyed = 0;
+int errors = 0;
+
+void destroy_counter(void* value) {
+  destroyed++;
+  free(value);
+}
+
+int counter(int* arg) {
+  int* count = malloc(sizeof(int));
+  *count = 0;
+  if (minithread_getspecific(counterKey) != NULL) errors++; // nothing set yet
+  minithread_setspecific(counterKey, count);
+
+  for (int i = 0; i < ROUNDS; i++) {
+    int* mine = minithread_getspecific(counterKey);
+    if (mine != count) errors++;
+    (*mine)++;
+    minithread_yield();
+  }
+  if (*count != ROUNDS) errors++;
+
+  void* object = objcache_alloc(cache);
+  objcache_free(cache, object);
+  if (objcache_alloc(cache) != object) errors++; // the thread's own object comes back
+  objcache_free(cache, object);
+
+  semaphore_V(done);
+  return 0;
+}
+
+int main_thread(int* arg) {
+  done = semaphore_create();
+  semaphore_initialize(done, 0);
+  cache = objcache_create(64, 4);
+  if (minithread_key_create(&counterKey, destroy_counter) != 0 || cache == NULL) {
+    printf("ERROR: could not create the key or the cache.\n");
+    exit(-1);
+  }
+
+  for (int i = 0; i < NUM_THREADS; i++) minithread_fork(counter, NULL);
+  for (int i = 0; i < NUM_THREADS; i++) semaphore_P(done);
+  minithread_sleep_with_timeout(200); // let the threads finish
+
+  // a deleted key drops the caller's value, and the key can be created again
+  minithread_setspecific(counterKey, &errors);
+  minithread_key_delete(counterKey);
+  if (minithread_getspecific(counterKey) != NULL) errors++;
+  minithread_key_t key;
+  if (minithread_key_create(&key, NULL) != 0 || minithread_getspecific(key) != NULL) errors++;
+
+  printf("%d of %d counters destroyed, %d errors.\n", destroyed, NUM_THREADS, errors);
+  printf((destroyed == NUM_THREADS && errors == 0) ? "Thread-local storage works.\n" : "FAILED.\n");
+  exit(0); // the system never stops on its own
+}
+
+int main(int argc, char** argv) {
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}
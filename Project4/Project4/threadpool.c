@@ -0,0 +1,188 @@
+/*
+ * Implementation of the thread pools.
+ */
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "defs.h"
+#include "threadpool.h"
+#include "synch.h"
+#include "interrupts.h"
+
+// a submitted call
+typedef struct pool_call {
+	proc_t proc;					//NULL tells the worker to stop
+	arg_t arg;
+	minithread_future_t* future;	//NULL if the caller does not wait for it
+} pool_call_t;
+
+struct minithread_pool {
+	pool_call_t* calls;		//queue of the submitted calls, a ring of capacity entries
+	int capacity;
+	int head;				//index of the oldest call
+	int length;				//# of calls queued
+	semaphore_t* slots;		//counts the free entries of calls
+	semaphore_t* items;		//counts the queued calls
+	int numWorkers;
+	minithread_t** workers;	//joinable, joined by minithread_pool_destroy()
+};
+
+struct minithread_future {
+	bool done;				//whether the call returned
+	int result;				//what it returned
+	minithread_t* waiter;	//thread in minithread_future_wait(), NULL if none
+};
+
+// This function is the body of the workers: it runs the queued calls until it takes a stop call
+static int pool_worker(int* arg)
+{
+	minithread_pool_t* pool = (minithread_pool_t*)arg;
+	while (1) {
+		semaphore_P(pool->items);
+		interrupt_level_t old_level = set_interrupt_level(DISABLED); //the queue is shared with the other workers
+		pool_call_t call = pool->calls[pool->head];
+		pool->head = (pool->head + 1) % pool->capacity;
+		pool->length--;
+		set_interrupt_level(old_level);
+		semaphore_V(pool->slots);
+
+		if (call.proc == NULL) return 0;
+		int result = call.proc(call.arg);
+		if (call.future != NULL) {
+			old_level = set_interrupt_level(DISABLED);
+			call.future->result = result;
+			call.future->done = true;
+			if (call.future->waiter != NULL) minithread_start(call.future->waiter);
+			set_interrupt_level(old_level);
+		}
+	}
+}
+
+// This function appends a call to the queue, waiting for a free entry
+static void pool_enqueue(minithread_pool_t* pool, proc_t proc, arg_t arg, minithread_future_t* future)
+{
+	semaphore_P(pool->slots);
+	interrupt_level_t old_level = set_interrupt_level(DISABLED);
+	pool_call_t* call = &pool->calls[(pool->head + pool->length) % pool->capacity];
+	call->proc = proc;
+	call->arg = arg;
+	call->future = future;
+	pool->length++;
+	set_interrupt_level(old_level);
+	semaphore_V(pool->items);
+}
+
+// This function allocates the future of a call
+static minithread_future_t* future_new()
+{
+	minithread_future_t* future = malloc(sizeof(minithread_future_t));
+	if (future == NULL) return NULL;
+	future->done = false;
+	future->result = 0;
+	future->waiter = NULL;
+	return future;
+}
+
+minithread_pool_t* minithread_pool_create(int workers, int capacity)
+{
+	if (workers <= 0 || capacity <= 0) return NULL;
+
+	minithread_pool_t* pool = malloc(sizeof(minithread_pool_t));
+	if (pool == NULL) return NULL;
+	pool->calls = malloc(capacity * sizeof(pool_call_t));
+	pool->workers = malloc(workers * sizeof(minithread_t*));
+	pool->slots = semaphore_create();
+	pool->items = semaphore_create();
+	if (pool->calls == NULL || pool->workers == NULL || pool->slots == NULL || pool->items == NULL) {
+		free(pool->calls);
+		free(pool->workers);
+		if (pool->slots != NULL) semaphore_destroy(pool->slots);
+		if (pool->items != NULL) semaphore_destroy(pool->items);
+		free(pool);
+		return NULL;
+	}
+	pool->capacity = capacity;
+	pool->head = 0;
+	pool->length = 0;
+	semaphore_initialize(pool->slots, capacity);
+	semaphore_initialize(pool->items, 0);
+
+	for (pool->numWorkers = 0; pool->numWorkers < workers; pool->numWorkers++) {
+		minithread_t* worker = minithread_fork_joinable(pool_worker, (arg_t)pool);
+		if (worker == NULL) { // out of memory, stop the workers forked so far
+			minithread_pool_destroy(pool);
+			return NULL;
+		}
+		pool->workers[pool->numWorkers] = worker;
+	}
+	return pool;
+}
+
+void minithread_pool_destroy(minithread_pool_t* pool)
+{
+	AbortOnCondition(pool == NULL, "Null argument pool in minithread_pool_destroy()");
+
+	for (int i = 0; i < pool->numWorkers; i++) pool_enqueue(pool, NULL, NULL, NULL); //after the calls queued before
+	for (int i = 0; i < pool->numWorkers; i++) minithread_join(pool->workers[i], NULL);
+
+	semaphore_destroy(pool->slots);
+	semaphore_destroy(pool->items);
+	free(pool->calls);
+	free(pool->workers);
+	free(pool);
+}
+
+int minithread_pool_submit(minithread_pool_t* pool, proc_t proc, arg_t arg, minithread_future_t** future)
+{
+	if (pool == NULL || proc == NULL) return -1;
+
+	minithread_future_t* newFuture = NULL;
+	if (future != NULL) {
+		newFuture = future_new();
+		if (newFuture == NULL) return -1;
+		*future = newFuture;
+	}
+	pool_enqueue(pool, proc, arg, newFuture);
+	return 0;
+}
+
+int minithread_pool_submit_batch(minithread_pool_t* pool, proc_t proc, arg_t* args, int n, minithread_future_t** futures)
+{
+	if (pool == NULL || proc == NULL || n < 0 || (args == NULL && n > 0)) return -1;
+
+	if (futures != NULL) {
+		for (int i = 0; i < n; i++) {
+			futures[i] = future_new();
+			if (futures[i] == NULL) { // out of memory, submit nothing
+				while (--i >= 0) free(futures[i]);
+				return -1;
+			}
+		}
+	}
+	for (int i = 0; i < n; i++) pool_enqueue(pool, proc, args[i], (futures != NULL) ? futures[i] : NULL);
+	return 0;
+}
+
+int minithread_future_done(minithread_future_t* future)
+{
+	AbortOnCondition(future == NULL, "Null argument future in minithread_future_done()");
+
+	return future->done;
+}
+
+int minithread_future_wait(minithread_future_t* future)
+{
+	AbortOnCondition(future == NULL || future->waiter != NULL, "Invalid argument future in minithread_future_wait()");
+
+	interrupt_level_t old_level = set_interrupt_level(DISABLED); //the worker must not finish the call between the check and the stop
+	while (!future->done) {
+		future->waiter = minithread_self();
+		minithread_stop(); //this reenables interrupts
+		set_interrupt_level(DISABLED);
+	}
+	set_interrupt_level(old_level);
+
+	int result = future->result;
+	free(future);
+	return result;
+}
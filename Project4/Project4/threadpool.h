@@ -0,0 +1,61 @@
+/*
+ * threadpool.h:
+ *  Pools of worker minithreads that run submitted calls.
+ *
+ *  A pool forks its workers once; each then runs calls taken from the
+ *  pool's queue, so that running a short call costs no thread creation.
+ *  The queue is bounded: submitting to a full queue blocks until a worker
+ *  takes a call. A call may be given a future, through which the caller
+ *  waits for it and gets the value it returned.
+ */
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include "minithread.h"
+
+typedef struct minithread_pool minithread_pool_t;
+typedef struct minithread_future minithread_future_t;
+
+/*
+ * minithread_pool_t* minithread_pool_create(int workers, int capacity)
+ *  Create a pool of workers threads with a queue of capacity calls.
+ *  Returns NULL if either is not positive or if out of memory.
+ */
+minithread_pool_t* minithread_pool_create(int workers, int capacity);
+
+/*
+ * minithread_pool_destroy(minithread_pool_t* pool)
+ *  Wait for the calls submitted so far to finish, then stop the workers and
+ *  free the pool. Must not be called by a worker of the pool.
+ */
+void minithread_pool_destroy(minithread_pool_t* pool);
+
+/*
+ * int minithread_pool_submit(minithread_pool_t* pool, proc_t proc, arg_t arg, minithread_future_t** future)
+ *  Have a worker call proc(arg). Unless future is NULL, *future is set to a
+ *  future of the call, which must be passed to minithread_future_wait().
+ *  Blocks while the queue is full. Returns 0 on success, -1 on a NULL pool
+ *  or proc, or if out of memory.
+ *
+ * int minithread_pool_submit_batch(minithread_pool_t* pool, proc_t proc, arg_t* args, int n, minithread_future_t** futures)
+ *  Submit proc(args[i]) for i from 0 to n - 1, setting futures[i] unless
+ *  futures is NULL, blocking whenever the queue is full. All the futures
+ *  are allocated first, so that either all the calls are submitted or
+ *  none: returns 0 on success, -1 on invalid arguments or if out of
+ *  memory.
+ */
+int minithread_pool_submit(minithread_pool_t* pool, proc_t proc, arg_t arg, minithread_future_t** future);
+int minithread_pool_submit_batch(minithread_pool_t* pool, proc_t proc, arg_t* args, int n, minithread_future_t** futures);
+
+/*
+ * int minithread_future_done(minithread_future_t* future)
+ *  Whether the call of future has returned.
+ *
+ * int minithread_future_wait(minithread_future_t* future)
+ *  Wait for the call of future to return, free the future and return the
+ *  value of the call. Only one thread may wait for a future.
+ */
+int minithread_future_done(minithread_future_t* future);
+int minithread_future_wait(minithread_future_t* future);
+
+#endif /*__THREADPOOL_H__*/
@@ -0,0 +1,82 @@
+/* timing.c
+
+   Sleeps against the wall clock, with a 10 ms quantum. First the threads
+   sleep while the rest of the system is idle: most must wake up within a
+   quantum of their deadline, and all within a quantum and the time the
+   host may take the processor away for. Then a thread sleeps while the
+   host thread is blocked in the operating system, when no clock ticks come
+   as the clock counts processor time: the sleeper must still wake up
+   within that bound of the host thread running again, not a whole delay
+   later.
+
+   USAGE: ./timing
+*/
+
+#include "minithread.h"
+#include "synch.h"
+#include "machineprimitives.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define QUANTUM_MS 10
+#define NUM_SLEEPS 21
+#define SLEEP_MS 20
+#define BLOCKED_SLEEP_MS 100
+#define BLOCKED_MS 300
+// how long a loaded host may keep the process from running on top of a quantum: Linux lets a
+// runnable process wait at most its scheduling latency, 24 ms by default on any number of CPUs
+#define HOST_SLACK_MS 25
+
+semaphore_t* done;
+unsigned long long wokeAt;
+
+int sleeper(int* arg) {
+  minithread_sleep_with_timeout(BLOCKED_SLEEP_MS);
+  wokeAt = currentTimeMillis();
+  semaphore_V(done);
+  return 0;
+}
+
+int main_thread(int* arg) {
+  int errors = 0;
+  done = semaphore_create();
+  semaphore_initialize(done, 0);
+
+  unsigned long long sleeps[NUM_SLEEPS];
+  for (int i = 0; i < NUM_SLEEPS; i++) {
+    unsigned long long start = currentTimeMillis();
+    minithread_sleep_with_timeout(SLEEP_MS);
+    unsigned long long slept = currentTimeMillis() - start;
+    if (slept < SLEEP_MS) errors++;
+    int j = i; // insertion sort
+    for (; j > 0 && sleeps[j - 1] > slept; j--) sleeps[j] = sleeps[j - 1];
+    sleeps[j] = slept;
+  }
+  printf("%d sleeps of %d ms took %llu ms (median), at most %llu ms.\n", NUM_SLEEPS, SLEEP_MS, sleeps[NUM_SLEEPS / 2], sleeps[NUM_SLEEPS - 1]);
+  if (sleeps[NUM_SLEEPS / 2] > SLEEP_MS + QUANTUM_MS) errors++;
+  if (sleeps[NUM_SLEEPS - 1] > SLEEP_MS + QUANTUM_MS + HOST_SLACK_MS) errors++;
+
+  unsigned long long start = currentTimeMillis();
+  minithread_fork(sleeper, NULL);
+  minithread_yield(); // let it register its alarm
+  usleep(BLOCKED_MS * 1000); // blocks every minithread
+  semaphore_P(done);
+  unsigned long long slept = wokeAt - start;
+  printf("a sleep of %d ms across %d ms blocked took %llu ms.\n", BLOCKED_SLEEP_MS, BLOCKED_MS, slept);
+  if (slept > BLOCKED_MS + QUANTUM_MS + HOST_SLACK_MS) errors++; // counting ticks, it took BLOCKED_MS + BLOCKED_SLEEP_MS
+
+  if (minithread_set_quantum(QUANTUM_MS) != -1) errors++; // the clock is running
+  printf((errors == 0) ? "Timing works.\n" : "FAILED.\n");
+  exit(0); // the system never stops on its own
+}
+
+int main(int argc, char** argv) {
+  if (minithread_set_quantum(0) != -1 || minithread_set_quantum(QUANTUM_MS) != 0) {
+    printf("FAILED.\n");
+    return -1;
+  }
+  minithread_system_initialize(main_thread, NULL);
+  return -1;
+}